@@ -0,0 +1,560 @@
+#define REICH_NO_MAIN
+#include "reich.c"
+
+/* Headless benchmark for the rasterizer and the terrain pipeline. Every
+ * result is one JSON object per line in reich_bench.jsonl (or the file named
+ * on the command line), so runs can be diffed and tracked over time. */
+
+#define BENCH_WIDTH         1280
+#define BENCH_HEIGHT        720
+#define BENCH_MIN_SECONDS   0.05
+#define BENCH_MAX_BATCH     4096
+#define BENCH_WARMUP_FRAMES 8
+#define BENCH_FLY_FRAMES    240
+#define BENCH_LOD_FRAMES    60
+#define BENCH_NOISE_SAMPLES 65536
+#define BENCH_TEX_SIZE      64
+#define BENCH_TEX_NPOT      48
+#define BENCH_LARGE_WORLD   16384
+
+enum {
+  BENCH_PIXEL,
+  BENCH_LINE,
+  BENCH_LINE_THICK,
+  BENCH_RECT,
+  BENCH_RECT_FILL,
+  BENCH_RECT_GRADIENT,
+  BENCH_RECT_ROUNDED,
+  BENCH_CIRCLE,
+  BENCH_CIRCLE_FILL,
+  BENCH_ELLIPSE,
+  BENCH_ELLIPSE_FILL,
+  BENCH_TRIANGLE,
+  BENCH_TRIANGLE_FILL,
+  BENCH_TRIANGLE_TEX,
+  BENCH_TRIANGLE_TEX_BILINEAR,
+  BENCH_TRIANGLE_TEXTURED,
+  BENCH_TRIANGLE_TEXTURED_NPOT,
+  BENCH_QUAD,
+  BENCH_QUAD_FILL,
+  BENCH_BEZIER_QUAD,
+  BENCH_BEZIER_CUBIC,
+  BENCH_CHECKERBOARD,
+  BENCH_TEXT,
+  BENCH_CANVAS_SCALED,
+  BENCH_GLASS,
+  BENCH_UI_BUTTON,
+  BENCH_UI_PANEL,
+  BENCH_UI_WINDOW,
+  BENCH_KIND_COUNT
+};
+
+static const char* BENCH_KIND_NAMES[BENCH_KIND_COUNT] = {
+    "pixel",
+    "line",
+    "line_thick",
+    "rect",
+    "rect_fill",
+    "rect_gradient",
+    "rect_rounded",
+    "circle",
+    "circle_fill",
+    "ellipse",
+    "ellipse_fill",
+    "triangle",
+    "triangle_fill",
+    "triangle_tex",
+    "triangle_tex_bilinear",
+    "triangle_textured",
+    "triangle_textured_npot",
+    "quad",
+    "quad_fill",
+    "bezier_quad",
+    "bezier_cubic",
+    "checkerboard",
+    "text",
+    "canvas_scaled",
+    "glass",
+    "ui_button",
+    "ui_panel",
+    "ui_window"};
+
+static const int32 BENCH_SIZES[] = {8, 64, 256};
+static const uint32 BENCH_ALPHAS[] = {255, 128};
+static const char* BENCH_SIMD_NAMES[] = {"scalar", "sse2", "avx2"};
+
+static uint32 benchTexels[BENCH_TEX_SIZE * BENCH_TEX_SIZE];
+static uint32 benchTexMips[BENCH_TEX_SIZE * BENCH_TEX_SIZE / 2];
+static reichTexture benchTexture;
+static reichCanvas benchSource;
+static reichHandle benchOut;
+static volatile real32 benchSink;
+
+static real64 bench_ms(int64 ticks) {
+  return (real64)ticks * 1000.0 / (real64)reich_sys_get_freq();
+}
+
+static void bench_emit(const char* line) {
+  reich_sys_log(REICH_LOG_INFO, "%s", line);
+  if (benchOut) {
+    reich_sys_file_write(benchOut, line, (reichSize)reich_strlen(line));
+    reich_sys_file_write(benchOut, "\n", 1);
+  }
+}
+
+/* Pixels written since the counters were last cleared, as reported by the
+ * per-primitive profiler counters. Zero when built with REICH_NO_PROFILE. */
+static real64 bench_pixels(reichContext* ctx) {
+  real64 total = 0.0;
+  int32 i;
+  for (i = 0; i < REICH_PRIM_COUNT; ++i) {
+    total += (real64)ctx->prof.prims[i].opaque + (real64)ctx->prof.prims[i].blended;
+  }
+  return total;
+}
+
+static void bench_setup_assets(reichContext* ctx) {
+  int32 x, y;
+  for (y = 0; y < BENCH_TEX_SIZE; y++) {
+    for (x = 0; x < BENCH_TEX_SIZE; x++) {
+      benchTexels[y * BENCH_TEX_SIZE + x] = ((x ^ y) & 8) ? 0xFFC08040 : 0xFF4080C0;
+    }
+  }
+  reich_texture_init(&benchTexture, benchTexels, BENCH_TEX_SIZE, BENCH_TEX_SIZE, benchTexMips);
+
+  benchSource = reich_canvas_create(&ctx->permMem, 128, 128);
+  if (benchSource.pixels) {
+    for (y = 0; y < benchSource.height; y++) {
+      for (x = 0; x < benchSource.width; x++) {
+        benchSource.pixels[y * benchSource.width + x] =
+            0xC0000000 | ((uint32)(x * 2) << 16) | ((uint32)(y * 2) << 8) | 0x80;
+      }
+    }
+  }
+}
+
+/* One primitive of roughly size x size pixels. Positions walk across the
+ * canvas so consecutive calls do not hit the same cache lines. */
+static void bench_draw(reichContext* ctx, int32 kind, int32 size, uint32 color, int32 i) {
+  real32 s = (real32)size;
+  real32 x = (real32)((i * 37) % (ctx->canvas.width - size - 2) + 1);
+  real32 y = (real32)((i * 53) % (ctx->canvas.height - size - 2) + 1);
+  reichTexVertex v0, v1, v2;
+
+  switch (kind) {
+    case BENCH_PIXEL:
+      reich_draw_pixel(ctx, (int32)x, (int32)y, color);
+      break;
+    case BENCH_LINE:
+      reich_draw_line(ctx, x, y, x + s, y + s * 0.7f, color);
+      break;
+    case BENCH_LINE_THICK:
+      reich_draw_line_thick(ctx, x, y, x + s, y + s * 0.7f, 4.0f, color);
+      break;
+    case BENCH_RECT:
+      reich_draw_rect(ctx, x, y, s, s, color);
+      break;
+    case BENCH_RECT_FILL:
+      reich_draw_rect_fill(ctx, x, y, s, s, color);
+      break;
+    case BENCH_RECT_GRADIENT:
+      reich_draw_rect_gradient(ctx, x, y, s, s, color, color ^ 0x00FF0000, color ^ 0x0000FF00, color ^ 0x000000FF);
+      break;
+    case BENCH_RECT_ROUNDED:
+      reich_draw_rect_rounded(ctx, x, y, s, s, s * 0.125f, 0.0f, color);
+      break;
+    case BENCH_CIRCLE:
+      reich_draw_circle(ctx, x + s * 0.5f, y + s * 0.5f, s * 0.5f, 2.0f, color);
+      break;
+    case BENCH_CIRCLE_FILL:
+      reich_draw_circle_fill(ctx, x + s * 0.5f, y + s * 0.5f, s * 0.5f, color);
+      break;
+    case BENCH_ELLIPSE:
+      reich_draw_ellipse(ctx, x + s * 0.5f, y + s * 0.5f, s * 0.5f, s * 0.3f, 2.0f, color);
+      break;
+    case BENCH_ELLIPSE_FILL:
+      reich_draw_ellipse_fill(ctx, x + s * 0.5f, y + s * 0.5f, s * 0.5f, s * 0.3f, color);
+      break;
+    case BENCH_TRIANGLE:
+      reich_draw_triangle(ctx, x, y, x + s, y + s * 0.25f, x + s * 0.4f, y + s, color);
+      break;
+    case BENCH_TRIANGLE_FILL:
+      reich_draw_triangle_fill(ctx, x, y, x + s, y + s * 0.25f, x + s * 0.4f, y + s, color);
+      break;
+    case BENCH_TRIANGLE_TEX:
+    case BENCH_TRIANGLE_TEX_BILINEAR:
+      v0.x = x;            v0.y = y;            v0.w = 1.0f; v0.u = 0.0f; v0.v = 0.0f;
+      v1.x = x + s;        v1.y = y + s * 0.25f; v1.w = 1.0f; v1.u = 1.0f; v1.v = 0.0f;
+      v2.x = x + s * 0.4f; v2.y = y + s;        v2.w = 1.0f; v2.u = 0.5f; v2.v = 1.0f;
+      reich_draw_triangle_tex(ctx, &benchTexture, &v0, &v1, &v2, color | 0x00FFFFFF,
+          kind == BENCH_TRIANGLE_TEX ? REICH_TEX_NEAREST : REICH_TEX_BILINEAR | REICH_TEX_MIPMAP);
+      break;
+    case BENCH_TRIANGLE_TEXTURED:
+    case BENCH_TRIANGLE_TEXTURED_NPOT:
+      reich_draw_triangle_textured(ctx, x, y, 0.0f, 0.0f, x + s, y + s * 0.25f, 1.0f, 0.0f,
+          x + s * 0.4f, y + s, 0.5f, 1.0f, benchTexels,
+          kind == BENCH_TRIANGLE_TEXTURED ? BENCH_TEX_SIZE : BENCH_TEX_NPOT, BENCH_TEX_SIZE,
+          color | 0x00FFFFFF);
+      break;
+    case BENCH_QUAD:
+      reich_draw_quad(ctx, x + s * 0.2f, y, x + s, y + s * 0.1f, x + s * 0.8f, y + s, x, y + s * 0.9f, color);
+      break;
+    case BENCH_QUAD_FILL:
+      reich_draw_quad_fill(ctx, x + s * 0.2f, y, x + s, y + s * 0.1f, x + s * 0.8f, y + s, x, y + s * 0.9f, color);
+      break;
+    case BENCH_BEZIER_QUAD:
+      reich_draw_bezier_quad(ctx, x, y + s, x + s * 0.5f, y - s, x + s, y + s, 16, 2.0f, color);
+      break;
+    case BENCH_BEZIER_CUBIC:
+      reich_draw_bezier_cubic(ctx, x, y + s, x + s * 0.3f, y, x + s * 0.7f, y + s, x + s, y, 16, 2.0f, color);
+      break;
+    case BENCH_CHECKERBOARD:
+      /* Always covers the whole canvas; the size is the tile edge */
+      reich_draw_checkerboard(ctx, size, color);
+      break;
+    case BENCH_TEXT:
+      reich_draw_text(ctx, (int32)x, (int32)y, "The quick brown fox", color);
+      break;
+    case BENCH_CANVAS_SCALED:
+      reich_draw_canvas_scaled(ctx, &benchSource, (int32)x, (int32)y, size, size);
+      break;
+    case BENCH_GLASS:
+      /* Begin snapshots the canvas into frame memory on every call */
+      reich_arena_reset(&ctx->frameMem);
+      if (reich_draw_glass_begin(ctx)) {
+        reich_draw_glass_rect(ctx, x, y, s, s, s * 0.2f);
+        reich_draw_glass_end(ctx);
+      }
+      break;
+    case BENCH_UI_BUTTON:
+      reich_draw_rect_ui_button(ctx, (int32)x, (int32)y, (int32)(x + s), (int32)(y + s), i & 1);
+      break;
+    case BENCH_UI_PANEL:
+      reich_draw_rect_ui_panel(ctx, (int32)x, (int32)y, (int32)(x + s), (int32)(y + s), i & 1);
+      break;
+    case BENCH_UI_WINDOW:
+      reich_draw_rect_ui_window(ctx, (int32)x, (int32)y, (int32)(x + s), (int32)(y + s));
+      break;
+  }
+}
+
+static void bench_primitive(reichContext* ctx, int32 kind, int32 size, uint32 alpha, int32 simd) {
+  char line[512];
+  int32 calls = 0, batch = 1, i;
+  uint32 color = (alpha << 24) | 0x3080C0;
+  int64 start, elapsed;
+  real64 ms, pixels;
+
+  reich_draw_clear(ctx, 0xFF202020);
+  reich_memset(ctx->prof.prims, 0, sizeof(ctx->prof.prims));
+  start = reich_sys_get_ticks();
+  do {
+    for (i = 0; i < batch; i++) { bench_draw(ctx, kind, size, color, calls + i); }
+    calls += batch;
+    if (batch < BENCH_MAX_BATCH) { batch *= 2; }
+    elapsed = reich_sys_get_ticks() - start;
+  } while (bench_ms(elapsed) < BENCH_MIN_SECONDS * 1000.0);
+
+  ms = bench_ms(elapsed);
+  pixels = bench_pixels(ctx);
+  reich_string_format(line, sizeof(line),
+      "{\"bench\":\"draw\",\"name\":\"%s\",\"size\":%d,\"alpha\":%d,\"simd\":\"%s\","
+      "\"calls\":%d,\"ns_per_call\":%.1f,\"px_per_call\":%.1f,\"mpix_s\":%.2f}",
+      BENCH_KIND_NAMES[kind], size, (int32)alpha, BENCH_SIMD_NAMES[simd], calls,
+      ms * 1000000.0 / (real64)calls, pixels / (real64)calls, pixels / (ms * 1000.0));
+  bench_emit(line);
+}
+
+static void bench_primitives(reichContext* ctx) {
+  int32 simd, kind, s, a, best = reich_simd_detect();
+  for (simd = REICH_SIMD_SCALAR; simd <= best; simd++) {
+    reich_simd_set_level(simd);
+    for (kind = 0; kind < BENCH_KIND_COUNT; kind++) {
+      if (kind == BENCH_TEXT && ctx->fontCount == 0) { continue; }
+      for (s = 0; s < (int32)(sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0])); s++) {
+        /* Single pixels and text do not scale with the size parameter */
+        if ((kind == BENCH_PIXEL || kind == BENCH_TEXT) && s > 0) { break; }
+        for (a = 0; a < (int32)(sizeof(BENCH_ALPHAS) / sizeof(BENCH_ALPHAS[0])); a++) {
+          /* Canvas and glass take their alpha from the source, the textured
+           * wrapper is always opaque and the UI frames use palette colors */
+          if ((kind == BENCH_CANVAS_SCALED || kind == BENCH_GLASS ||
+               kind == BENCH_TRIANGLE_TEXTURED || kind == BENCH_TRIANGLE_TEXTURED_NPOT ||
+               kind >= BENCH_UI_BUTTON) && a > 0) {
+            break;
+          }
+          bench_primitive(ctx, kind, BENCH_SIZES[s], BENCH_ALPHAS[a], simd);
+        }
+      }
+    }
+  }
+  reich_simd_set_level(-1);
+}
+
+/* Every source alpha against every destination alpha through the span
+ * blend kernels at each SIMD level, compared with the per-pixel macros they
+ * must match bit for bit. Spans start at shifting offsets so both the
+ * vector bodies and the scalar tails see every pair. Returns the number of
+ * mismatched pixels. */
+static int32 bench_blend_exact(void) {
+  static const uint32 rgbs[] = {0x000000, 0xFFFFFF, 0x80FF01, 0x3C7FC3};
+  static const char* kernels[] = {"blend", "blend_premul"};
+  static uint32 dst[256 + 8], ref[256 + 8];
+  int32 simd, kernel, sa, c, d, i, off, mismatches, total = 0;
+  int32 rgbCount = (int32)(sizeof(rgbs) / sizeof(rgbs[0])), best = reich_simd_detect();
+  uint32 color, pixel;
+  char line[256];
+
+  for (simd = REICH_SIMD_SCALAR; simd <= best; simd++) {
+    reich_simd_set_level(simd);
+    for (kernel = 0; kernel < 2; kernel++) {
+      mismatches = 0;
+      for (sa = 0; sa < 256; sa++) {
+        for (c = 0; c < rgbCount; c++) {
+          for (d = 0; d < rgbCount; d++) {
+            color = ((uint32)sa << 24) | rgbs[c];
+            if (kernel) { color = REICH_PREMUL(color); }
+            off = (sa + c + d) & 7;
+            for (i = 0; i < 256; i++) {
+              pixel = ((uint32)i << 24) | rgbs[d];
+              if (kernel) { pixel = REICH_PREMUL(pixel); }
+              dst[off + i] = pixel;
+              ref[off + i] = pixel;
+              if (kernel) {
+                REICH_BLEND_PREMUL(color, ref[off + i]);
+              } else {
+                REICH_BLEND_FAST(color, ref[off + i]);
+              }
+            }
+            if (kernel) {
+              reich_span_blend_premul(dst + off, 256, color);
+            } else {
+              reich_span_blend(dst + off, 256, color);
+            }
+            for (i = 0; i < 256; i++) {
+              if (dst[off + i] != ref[off + i]) { mismatches++; }
+            }
+          }
+        }
+      }
+      reich_string_format(line, sizeof(line),
+          "{\"bench\":\"blend_exact\",\"kernel\":\"%s\",\"simd\":\"%s\",\"pixels\":%d,"
+          "\"mismatches\":%d}",
+          kernels[kernel], BENCH_SIMD_NAMES[simd], 256 * 256 * rgbCount * rgbCount, mismatches);
+      bench_emit(line);
+      total += mismatches;
+    }
+  }
+  reich_simd_set_level(-1);
+  return total;
+}
+
+static void bench_noise_emit(const char* name, int32 octaves, int32 simd, real64 ms) {
+  char line[256];
+  reich_string_format(line, sizeof(line),
+      "{\"bench\":\"noise\",\"name\":\"%s\",\"octaves\":%d,\"simd\":\"%s\",\"calls\":%d,"
+      "\"ns_per_call\":%.1f,\"msamples_s\":%.2f}",
+      name, octaves, BENCH_SIMD_NAMES[simd], BENCH_NOISE_SAMPLES,
+      ms * 1000000.0 / BENCH_NOISE_SAMPLES, BENCH_NOISE_SAMPLES / (ms * 1000.0));
+  bench_emit(line);
+}
+
+/* Scalar fbm2 against the batched and the grid entry points over the same
+ * 256 x 256 lattice that a terrain chunk samples. */
+static void bench_noise(void) {
+  static const int32 octaves[] = {1, 4, MAX_FADE_OCTAVES};
+  static real32 xs[BENCH_NOISE_SAMPLES], ys[BENCH_NOISE_SAMPLES], out[BENCH_NOISE_SAMPLES];
+  static real32 rowY[256];
+  int32 o, i, simd, best = reich_simd_detect();
+  real32 sum = 0.0f;
+  int64 start;
+
+  for (i = 0; i < BENCH_NOISE_SAMPLES; i++) {
+    xs[i] = (real32)(i & 255) * 0.006f;
+    ys[i] = (real32)(i >> 8) * 0.006f;
+  }
+  for (i = 0; i < 256; i++) {
+    rowY[i] = (real32)i * 0.006f;
+  }
+  for (o = 0; o < (int32)(sizeof(octaves) / sizeof(octaves[0])); o++) {
+    start = reich_sys_get_ticks();
+    for (i = 0; i < BENCH_NOISE_SAMPLES; i++) {
+      sum += reich_noise_fbm2(xs[i], ys[i], octaves[o], 1.9f, 0.5f);
+    }
+    bench_noise_emit("fbm2", octaves[o], REICH_SIMD_SCALAR, bench_ms(reich_sys_get_ticks() - start));
+
+    for (simd = REICH_SIMD_SCALAR; simd <= best; simd++) {
+      reich_simd_set_level(simd);
+      start = reich_sys_get_ticks();
+      reich_noise_fbm2_n(xs, ys, out, BENCH_NOISE_SAMPLES, octaves[o], 1.9f, 0.5f);
+      bench_noise_emit("fbm2_n", octaves[o], simd, bench_ms(reich_sys_get_ticks() - start));
+      sum += out[BENCH_NOISE_SAMPLES - 1];
+
+      start = reich_sys_get_ticks();
+      reich_noise_fbm2_grid(out, xs, 256, rowY, BENCH_NOISE_SAMPLES / 256, octaves[o], 1.9f, 0.5f);
+      bench_noise_emit("fbm2_grid", octaves[o], simd, bench_ms(reich_sys_get_ticks() - start));
+      sum += out[BENCH_NOISE_SAMPLES - 1];
+    }
+    reich_simd_set_level(-1);
+  }
+  benchSink = sum;
+}
+
+static void bench_sort(real64* v, int32 n) {
+  int32 i, j;
+  for (i = 1; i < n; i++) {
+    real64 key = v[i];
+    for (j = i - 1; j >= 0 && v[j] > key; j--) { v[j + 1] = v[j]; }
+    v[j + 1] = key;
+  }
+}
+
+static real64 bench_percentile(const real64* sorted, int32 n, int32 pct) {
+  int32 idx = (n * pct + 99) / 100 - 1;
+  if (idx < 0) { idx = 0; }
+  if (idx >= n) { idx = n - 1; }
+  return sorted[idx];
+}
+
+/* Scripted camera path: one lap around the map centre while the zoom
+ * sweeps through every level of detail and the pitch rocks. */
+static void bench_fly_camera(int32 frame) {
+  static const real64 zooms[] = {0.3, 1.0, 3.0, 8.0, 20.0, 60.0, 20.0, 3.0, 0.3};
+  int32 keys = (int32)(sizeof(zooms) / sizeof(zooms[0])) - 1;
+  real64 t = (real64)frame / (real64)BENCH_FLY_FRAMES;
+  real64 k = t * keys;
+  int32 ki = (int32)k;
+  if (ki >= keys) { ki = keys - 1; }
+  mainCamera.x = terrainStore.width * 0.5 + 300.0 * reich_cos((float)(t * 2.0 * REICH_PI));
+  mainCamera.y = terrainStore.height * 0.5 + 300.0 * reich_sin((float)(t * 2.0 * REICH_PI));
+  mainCamera.angle = REICH_PI / 4 + t * 2.0 * REICH_PI;
+  mainCamera.pitch = 0.6 + 0.3 * reich_sin((float)(t * 4.0 * REICH_PI));
+  mainCamera.zoom = zooms[ki] + (zooms[ki + 1] - zooms[ki]) * (k - ki);
+}
+
+static void bench_world(reichContext* ctx, const char* name) {
+  static real64 frameMs[BENCH_FLY_FRAMES];
+  char line[512];
+  int32 f;
+  int64 start;
+  real64 total = 0.0, pixels = 0.0, nodes = 0.0, quads = 0.0;
+
+  ctx->input.mouseX = ctx->canvas.width / 2;
+  ctx->input.mouseY = ctx->canvas.height / 2;
+  for (f = -BENCH_WARMUP_FRAMES; f < BENCH_FLY_FRAMES; f++) {
+    bench_fly_camera(f < 0 ? 0 : f);
+    start = reich_sys_get_ticks();
+    reich_begin_frame(ctx);
+    my_render(ctx, 0.0);
+    if (f >= 0) {
+      pixels += bench_pixels(ctx);
+      nodes += terrainStore.frameNodes;
+      quads += terrainStore.frameQuads;
+    }
+    reich_end_frame(ctx);
+    if (f >= 0) {
+      frameMs[f] = bench_ms(reich_sys_get_ticks() - start);
+      total += frameMs[f];
+    }
+  }
+  bench_sort(frameMs, BENCH_FLY_FRAMES);
+  reich_string_format(line, sizeof(line),
+      "{\"bench\":\"world\",\"name\":\"%s\",\"width\":%d,\"height\":%d,"
+      "\"world\":%d,\"threads\":%d,\"frames\":%d,\"mean_ms\":%.3f,\"p50_ms\":%.3f,"
+      "\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f,\"mpix_s\":%.2f,"
+      "\"nodes\":%.1f,\"quads\":%.0f,\"chunks_resident\":%d,\"chunks_generated\":%d,\"chunks_evicted\":%d}",
+      name, ctx->canvas.width, ctx->canvas.height, terrainStore.width, reich_jobs_thread_count(),
+      BENCH_FLY_FRAMES, total / BENCH_FLY_FRAMES,
+      bench_percentile(frameMs, BENCH_FLY_FRAMES, 50),
+      bench_percentile(frameMs, BENCH_FLY_FRAMES, 90),
+      bench_percentile(frameMs, BENCH_FLY_FRAMES, 99),
+      frameMs[BENCH_FLY_FRAMES - 1], pixels / (total * 1000.0),
+      nodes / BENCH_FLY_FRAMES, quads / BENCH_FLY_FRAMES, terrainStore.usedSlots, terrainStore.generated, terrainStore.evicted);
+  bench_emit(line);
+}
+
+/* Fixed views at the lowest pitch, where quads are flattest on screen and
+ * LOD has the most to merge, drawn with it and then with every node at the
+ * finest level. The quad counts of each pair show what it saves. */
+static void bench_lod(reichContext* ctx) {
+  static const real64 zooms[] = {1.5, 4.5, 9.0, 20.0};
+  char line[512];
+  int32 z, lod, f;
+  int64 start;
+  real64 total;
+
+  ctx->input.mouseX = ctx->canvas.width / 2;
+  ctx->input.mouseY = ctx->canvas.height / 2;
+  for (z = 0; z < (int32)(sizeof(zooms) / sizeof(zooms[0])); z++) {
+    for (lod = 1; lod >= 0; lod--) {
+      useTerrainLod = lod;
+      mainCamera.x = terrainStore.width * 0.5;
+      mainCamera.y = terrainStore.height * 0.5;
+      mainCamera.angle = REICH_PI / 4;
+      mainCamera.pitch = CAMERA_MIN_PITCH;
+      mainCamera.zoom = zooms[z];
+      total = 0.0;
+      for (f = -BENCH_WARMUP_FRAMES; f < BENCH_LOD_FRAMES; f++) {
+        start = reich_sys_get_ticks();
+        reich_begin_frame(ctx);
+        my_render(ctx, 0.0);
+        reich_end_frame(ctx);
+        if (f >= 0) { total += bench_ms(reich_sys_get_ticks() - start); }
+      }
+      reich_string_format(line, sizeof(line),
+          "{\"bench\":\"world\",\"name\":\"lod_low_pitch\",\"width\":%d,\"height\":%d,"
+          "\"world\":%d,\"zoom\":%.1f,\"pitch\":%.2f,\"lod\":%d,\"frames\":%d,\"mean_ms\":%.3f,"
+          "\"nodes\":%d,\"quads\":%d}",
+          ctx->canvas.width, ctx->canvas.height, terrainStore.width, zooms[z], CAMERA_MIN_PITCH, lod,
+          BENCH_LOD_FRAMES, total / BENCH_LOD_FRAMES, terrainStore.frameNodes, terrainStore.frameQuads);
+      bench_emit(line);
+    }
+  }
+  useTerrainLod = 1;
+}
+
+static int32 run_bench(const char* outName) {
+  char line[256];
+  int64 start;
+  int32 blendMismatches;
+
+  if (!reich_init(&mainContext, "REICH Bench", BENCH_WIDTH, BENCH_HEIGHT, 60.0)) {
+    return -1;
+  }
+  benchOut = reich_sys_file_open(outName, REICH_FILE_WRITE);
+  reich_jobs_init(0);
+  bench_setup_assets(&mainContext);
+  blendMismatches = bench_blend_exact();
+
+  /* Maps the cache on every run after the first, which writes it */
+  start = reich_sys_get_ticks();
+  terrain_load(TERRAIN_WORLD_WIDTH, TERRAIN_WORLD_HEIGHT);
+  reich_string_format(line, sizeof(line),
+      "{\"bench\":\"terrain\",\"name\":\"terrain_load\",\"width\":%d,\"height\":%d,"
+      "\"threads\":%d,\"mapped\":%d,\"ms\":%.3f}",
+      TERRAIN_WORLD_WIDTH, TERRAIN_WORLD_HEIGHT, reich_jobs_thread_count(),
+      terrainStore.cache != NULL, bench_ms(reich_sys_get_ticks() - start));
+  bench_emit(line);
+
+  bench_primitives(&mainContext);
+  bench_noise();
+  bench_world(&mainContext, "fly_through");
+  bench_lod(&mainContext);
+
+  /* Too large to cache, every chunk comes from the noise */
+  terrain_load(BENCH_LARGE_WORLD, BENCH_LARGE_WORLD);
+  bench_world(&mainContext, "fly_through_large");
+
+  reich_jobs_shutdown();
+  if (benchOut) { reich_sys_file_close(benchOut); }
+  return blendMismatches ? 1 : 0;
+}
+
+#if defined(REICH_PLATFORM_WIN32)
+void mainCRTStartup(void) {
+  ExitProcess(run_bench("reich_bench.jsonl"));
+}
+#else
+int main(int argc, char** argv) {
+  return run_bench(argc > 1 ? argv[1] : "reich_bench.jsonl");
+}
+#endif
@@ -1,13 +1,20 @@
 #define REICH_IMPLEMENTATION
 #include "reich.h"
 #include <emmintrin.h>
+#if defined(REICH_PLATFORM_WIN32)
 #include <windows.h>
+#endif
 
+#ifndef TRUE
 #define TRUE                  1
 #define FALSE                 0
-#define REICH_MAX_GRID_WIDTH  1024
-#define REICH_MAX_GRID_HEIGHT 1024
-#define REICH_MAX_GRID_SIZE   (REICH_MAX_GRID_WIDTH * REICH_MAX_GRID_HEIGHT)
+#endif
+#ifndef TERRAIN_WORLD_WIDTH
+#define TERRAIN_WORLD_WIDTH   4096
+#endif
+#ifndef TERRAIN_WORLD_HEIGHT
+#define TERRAIN_WORLD_HEIGHT  4096
+#endif
 
 #define CAMERA_MIN_ZOOM       0.1
 #define CAMERA_MAX_ZOOM       200.0
@@ -21,18 +28,38 @@
 #define WATER_LVL             40.0f
 #define TILE_TEX_WIDTH        64
 #define TILE_TEX_HEIGHT       64
+#define TILE_TEX_MIN_ZOOM     4.0f
 #define MAX_FADE_OCTAVES      8
-
-#define NUM_THREADS           8
+#define TERRAIN_BAND_ROWS     64
+#define TERRAIN_CACHE_MAGIC   0x52455452 /* "RTER" */
+#define TERRAIN_CACHE_VERSION 2
+#define TERRAIN_CACHE_MAX_CELLS (4096 * 4096)
+#define TERRAIN_CHUNK_SHIFT   6
+#define TERRAIN_CHUNK_SIZE    (1 << TERRAIN_CHUNK_SHIFT)   /* Quads per chunk side */
+#define TERRAIN_CHUNK_MASK    (TERRAIN_CHUNK_SIZE - 1)
+#define TERRAIN_CHUNK_STRIDE  (TERRAIN_CHUNK_SIZE + 1)     /* Plus the first row and column of the next chunk */
+#define TERRAIN_CHUNK_CELLS   (TERRAIN_CHUNK_STRIDE * TERRAIN_CHUNK_STRIDE)
+#define TERRAIN_CHUNK_SLOTS   512
+#define TERRAIN_LEVELS        8                            /* Chunk grids sampling every 1..128 cells */
+#define TERRAIN_LOD_ERROR_PX  2.0f                         /* Largest height error a coarser node may show, in pixels */
+#define TERRAIN_LOD_QUAD_PX   8.0f                         /* Largest on-screen quad height a coarser node may use */
+#define TERRAIN_BLOCK_SHIFT   4
+#define TERRAIN_BLOCK_SIZE    (1 << TERRAIN_BLOCK_SHIFT)   /* Quads per side of a LOD node and of a max height block */
+#define TERRAIN_BLOCKS        (TERRAIN_CHUNK_SIZE / TERRAIN_BLOCK_SIZE)
+#define TERRAIN_LIGHT_TOLERANCE 0.99985f                   /* Cosine of how far the sun turns (~1 degree) before cached lighting goes stale */
+#define TERRAIN_RELIGHT_CHUNKS 16                          /* Stale chunks relit per frame, on top of new ones */
+
+#define RASTER_TILE_SIZE      64
+#define QUAD_BATCH_SIZE       512                          /* Quads per geometry job item, compacted as one run */
+#define QUAD_RUN_CAP          (TERRAIN_CHUNK_SIZE + 16)    /* Vertices per row of a run, padded for a full vector past the end */
 #define REICH_ABS(x)          ((x) < 0 ? -(x) : (x))
 
-uint32 REICH_GRID_DATA[REICH_MAX_GRID_SIZE];
-real32 REICH_HEIGHT_DATA[REICH_MAX_GRID_SIZE];      /* Pre-clamped */
-real32 REICH_RAW_HEIGHT_DATA[REICH_MAX_GRID_SIZE];  /* Original terrain */
-
 uint32 TILE_TEXTURE[TILE_TEX_WIDTH * TILE_TEX_HEIGHT];
+uint32 TILE_TEXTURE_MIPS[TILE_TEX_WIDTH * TILE_TEX_HEIGHT / 2];
+static reichTexture tileTexture;
+static int32 tileTextureFlags = REICH_TEX_BILINEAR | REICH_TEX_MIPMAP;
 
-static reichCamera mainCamera = {REICH_MAX_GRID_WIDTH/2.0f, REICH_MAX_GRID_HEIGHT/2.0f, 10.0, 2.0, REICH_PI/4, 0.5};
+static reichCamera mainCamera = {TERRAIN_WORLD_WIDTH/2.0f, TERRAIN_WORLD_HEIGHT/2.0f, 10.0, 2.0, REICH_PI/4, 0.5};
 static reichContext mainContext;
 
 static int32 selectionMinX = -1;
@@ -53,25 +80,125 @@ static real64 selectionStartWorldY = 0;
 static real64 selectionEndWorldX = 0;
 static real64 selectionEndWorldY = 0;
 
-static real64 globalTime = 0.25;
+typedef struct {
+  uint32 seed;
+  int32 octaves;
+  real32 lacunarity;
+  real32 gain;
+  real32 waterLevel;
+  real64 scale;
+} TerrainParams;
+
+static TerrainParams terrainParams = {0, MAX_FADE_OCTAVES, 1.9f, 0.5f, WATER_LVL, 0.006};
+
+/* Cache file header, ahead of the fbm of every cell in row order. The whole
+ * header, padding included, must match for a cache to be used. */
+typedef struct {
+  uint32 magic;
+  uint32 version;
+  uint32 key;
+  uint32 width;
+  uint32 height;
+  TerrainParams params;
+  uint32 reserved[4];
+} TerrainCacheHeader;
 
 typedef struct {
-  float x00, y00, x10, y10, x11, y11, x01, y01;
-  float cullTri1, cullTri2;
-  uint32 quadColor;
-  int32 visible;
-  int32 isTextured;
-} QuadDrawCmd;
+  int32 level, chunkX, chunkY;
+  uint32 lastUse;
+  real32 minHeight, maxHeight;
+  uint32 litVersion;  /* Sun the light values are for, 0 before the first */
+  int32 litLevel;     /* Level its shadow rays started at */
+  real32 height[TERRAIN_CHUNK_CELLS];     /* Pre-clamped */
+  real32 rawHeight[TERRAIN_CHUNK_CELLS];  /* Original terrain */
+  uint32 color[TERRAIN_CHUNK_CELLS];
+  real32 blockMax[TERRAIN_BLOCKS * TERRAIN_BLOCKS];    /* Highest sample per block */
+  real32 blockError[TERRAIN_BLOCKS * TERRAIN_BLOCKS];  /* Largest height the next coarser level would drop per block */
+  real32 light[TERRAIN_CHUNK_CELLS];      /* N.L times shadow per quad */
+} TerrainChunk;
+
+/* Resident terrain: a fixed pool of chunk slots, recycled least recently
+ * used first, and per level a directory from chunk coordinates to slot + 1
+ * (0 when not resident). Level k samples every (1 << k)th cell, so coarse
+ * views never pull in full resolution chunks. */
+typedef struct {
+  int32 width, height;
+  int32 chunksX[TERRAIN_LEVELS], chunksY[TERRAIN_LEVELS];
+  int32* directory[TERRAIN_LEVELS];
+  real32 invStep[TERRAIN_LEVELS];
+  TerrainChunk* chunks;
+  int32 usedSlots;
+  uint32 frame;
+  int32 generated, evicted;
+  int32 frameNodes, frameQuads;
+  real64 noiseOffsetX, noiseOffsetY;
+  uint32 lightVersion;  /* Bumped each time the sun turns past TERRAIN_LIGHT_TOLERANCE */
+  real32 lightDirX, lightDirY, lightDirZ;
+  const real32* cache;  /* Mapped fbm of the whole world, or NULL */
+  void* cacheView;
+  reichSize cacheSize;
+} TerrainStore;
+
+static TerrainChunk terrainChunks[TERRAIN_CHUNK_SLOTS];
+static TerrainStore terrainStore;
 
+static real64 globalTime = 0.25;
+static int32 useTileRaster = 1;
+static int32 useTerrainLod = 1;
+static int32 showProfiler = 0;
+
+/* Visible quads in painter's order, a field per array so each pass over
+ * them streams only the fields it reads */
+typedef struct {
+  float *x00, *y00, *x10, *y10, *x11, *y11, *x01, *y01;
+  float *cullTri1, *cullTri2;
+  uint32* quadColor;
+  int32 count;
+  int32 isTextured;  /* Per frame rather than per node, so coarser nodes keep the same shade */
+} QuadDrawList;
+
+/* A quadtree leaf picked for this frame: one block of a resident chunk
+ * drawn at the chunk's level, clipped to the view and walked in painter's
+ * order. */
+typedef struct {
+  const TerrainChunk* chunk;
+  int32 level;
+  int32 localX0, localY0;  /* First quad of the block within the chunk, where its seams start */
+  int32 quadX0, quadY0;
+  int32 stepX, stepY;
+  int32 numX, numY;
+  int32 firstCmd;
+  int32 stitch[4];  /* Level of a coarser neighbour on the -x, +x, -y, +y edge, else 0 */
+} TerrainNode;
+
+/* A projected row of vertices, tagged with the run it was made for */
+typedef struct {
+  const TerrainNode* node;  /* NULL until the first projection */
+  int32 quadX, vertexY, count;
+  float x[QUAD_RUN_CAP], y[QUAD_RUN_CAP], h[QUAD_RUN_CAP];
+} QuadVertexRow;
+
+/* One node row of quads, left to right: the two vertex rows they share and
+ * what the vector pass found for each quad. The vertex rows outlive the run,
+ * so the next row of the node picks up the shared one already projected. */
 typedef struct {
-  int32 startIdx;
-  int32 endIdx;
-  int32 numX;
-  int32 gStart_Y;
-  int32 gStep_Y;
-  int32 gStart_X;
-  int32 gStep_X;
-  int32 levelOfDetail;
+  QuadVertexRow rows[2];
+  QuadVertexRow *top, *bot;
+  float cullTri1[QUAD_RUN_CAP], cullTri2[QUAD_RUN_CAP];
+  uint32 color[QUAD_RUN_CAP];
+  uint8 visible[QUAD_RUN_CAP];
+} QuadRun;
+
+struct QuadJobData;
+typedef void (*QuadRunKernel)(
+    const struct QuadJobData* td, const TerrainNode* node, int32 quadX, int32 quadY, int32 count, QuadRun* run);
+
+typedef struct QuadJobData {
+  const TerrainNode* nodes;
+  int32 numNodes;
+  TerrainChunk** chunks;  /* Distinct chunks the nodes draw from */
+  int32 numChunks;
+  int32 baseLevel;  /* Finest level drawn this frame, where shadow rays start */
   int32 selBoxMinX;
   int32 selBoxMaxX;
   int32 selBoxMinY;
@@ -79,22 +206,109 @@ typedef struct {
   float hw, hh, cx, cy, cz, zm, cY, sY, cP, sP;
   real32 lightDirX, lightDirY, lightDirZ;
   uint32 sunColor, ambientColor, skyColor;
-  uint32 *grid;
+  TerrainStore* store;
   reichRect clipRect;
-  real64 mouseX, mouseY;
-  int32 threadHoverX, threadHoverY;
-  QuadDrawCmd* cmds;
-} ThreadData;
+  int32 hoverX, hoverY;  /* Picked cell, -1 when the cursor is off the terrain */
+  int32 numQuads;
+  QuadDrawList* batches;  /* Room for every quad, batch b writing from b * QUAD_BATCH_SIZE */
+  int32* batchCounts;
+  QuadRunKernel runKernel;  /* Widest the CPU supports, picked per frame */
+} QuadJobData;
+
+typedef struct {
+  real32* band;
+  const real32* noiseX;
+  const real32* noiseY;
+  int32 width;
+  int32 firstRow;
+} TerrainCacheJob;
+
+typedef struct {
+  TerrainStore* store;
+  const int32* slots;
+} TerrainStreamJob;
+
+typedef struct {
+  const TerrainStore* store;
+  TerrainChunk** chunks;
+  int32 level;
+} TerrainLightJob;
+
+typedef struct {
+  const QuadDrawList* src;
+  QuadDrawList* dst;
+  const int32* batchCounts;
+  const int32* batchStarts;
+} QuadMergeJob;
+
+typedef struct {
+  reichContext* threadCtx;
+  reichRect clipRect;
+  const QuadDrawList* quads;
+  int32* binStart;
+  int32* binItems;
+  int32 tilesX;
+  int32 drawBounds;
+} RasterJobData;
+
+static void terrain_shape(real32 fbm, real32* rawHeight, real32* height, uint32* color) {
+  real64 noiseValue = fbm*0.5f + 0.5f;
+  real32 raw;
+  noiseValue *= (real64)reich_sqrt((double)noiseValue);
+
+  /* Keep the un-clamped height for fast water depth calculations during drawing */
+  raw = (real32)(noiseValue * 255.0) - 40.0f;
+  *rawHeight = raw;
+
+  /* Pre-clamped heights so draw_world and cast_shadow do zero branching */
+  *height = raw < terrainParams.waterLevel ? terrainParams.waterLevel : raw;
+
+  if (raw < 12.0f) {
+    *color = 0xFFEEDD99;
+  } else if (raw < 25.0f) {
+    *color = 0xFF66AA44;
+  } else if (raw < 45.0f) {
+    *color = 0xFF448833;
+  } else if (raw < 70.0f) {
+    *color = 0xFF666666;
+  } else {
+    *color = 0xFFF0F0F0;
+  }
+}
+
+static real32 terrain_noise_coord(int32 cell, real64 offset) {
+  return (real32)((real64)cell * terrainParams.scale + offset);
+}
+
+/* Full resolution height of one cell, from its chunk when that is resident
+ * and straight from the cache or the noise otherwise. */
+static real32 terrain_cell_height(int32 cellX, int32 cellY) {
+  TerrainStore* store = &terrainStore;
+  int32 slot = store->directory[0][(cellY >> TERRAIN_CHUNK_SHIFT) * store->chunksX[0] + (cellX >> TERRAIN_CHUNK_SHIFT)];
+  real32 fbm, rawHeight, height;
+  uint32 color;
+  if (slot) {
+    return store->chunks[slot - 1].height[(cellY & TERRAIN_CHUNK_MASK) * TERRAIN_CHUNK_STRIDE + (cellX & TERRAIN_CHUNK_MASK)];
+  }
+  if (store->cache) {
+    fbm = store->cache[(reichSize)cellY * store->width + cellX];
+  } else {
+    fbm = reich_noise_fbm2(terrain_noise_coord(cellX, store->noiseOffsetX), terrain_noise_coord(cellY, store->noiseOffsetY),
+        terrainParams.octaves, terrainParams.lacunarity, terrainParams.gain);
+  }
+  terrain_shape(fbm, &rawHeight, &height, &color);
+  return height;
+}
 
 static real32 get_terrain_height(real64 worldX, real64 worldY) {
   int32 gridX = (int32)reich_floor((float)worldX);
   int32 gridY = (int32)reich_floor((float)worldY);
-  if (gridX >= 0 && gridX < REICH_MAX_GRID_WIDTH - 1 &&
-      gridY >= 0 && gridY < REICH_MAX_GRID_HEIGHT - 1) {
-    real32 height00 = REICH_HEIGHT_DATA[gridY * REICH_MAX_GRID_WIDTH + gridX];
-    real32 height10 = REICH_HEIGHT_DATA[gridY * REICH_MAX_GRID_WIDTH + (gridX + 1)];
-    real32 height11 = REICH_HEIGHT_DATA[(gridY + 1) * REICH_MAX_GRID_WIDTH + (gridX + 1)];
-    real32 height01 = REICH_HEIGHT_DATA[(gridY + 1) * REICH_MAX_GRID_WIDTH + gridX];
+  if (gridX >= 0 && gridX < terrainStore.width - 1 &&
+      gridY >= 0 && gridY < terrainStore.height - 1) {
+    real32 height00 = terrain_cell_height(gridX, gridY);
+    real32 height10 = terrain_cell_height(gridX + 1, gridY);
+    real32 height11 = terrain_cell_height(gridX + 1, gridY + 1);
+    real32 height01 = terrain_cell_height(gridX, gridY + 1);
 
     real64 fractX = worldX - (real64)gridX;
     real64 fractY = worldY - (real64)gridY;
@@ -105,31 +319,46 @@ static real32 get_terrain_height(real64 worldX, real64 worldY) {
       return (real32)(height00 + (height11 - height01) * (real32)fractX + (height01 - height00) * (real32)fractY);
     }
   }
-  if (gridX >= 0 && gridX < REICH_MAX_GRID_WIDTH &&
-      gridY >= 0 && gridY < REICH_MAX_GRID_HEIGHT) {
-    return REICH_HEIGHT_DATA[gridY * REICH_MAX_GRID_WIDTH + gridX];
+  if (gridX >= 0 && gridX < terrainStore.width &&
+      gridY >= 0 && gridY < terrainStore.height) {
+    return terrain_cell_height(gridX, gridY);
   }
-  return WATER_LVL;
+  return terrainParams.waterLevel;
 }
 
-/* Highly optimized version for shadow raycasting bypassing bounds checking entirely */
-static real32 get_terrain_height_fast(real32 worldX, real32 worldY) {
-  int32 gridX = (int32)worldX;
-  int32 gridY = (int32)worldY;
-  real32 fractX = worldX - (real32)gridX;
-  real32 fractY = worldY - (real32)gridY;
-
-  int32 idx = gridY * REICH_MAX_GRID_WIDTH + gridX;
-  real32 h00 = REICH_HEIGHT_DATA[idx];
-  real32 h10 = REICH_HEIGHT_DATA[idx + 1];
-  real32 h01 = REICH_HEIGHT_DATA[idx + REICH_MAX_GRID_WIDTH];
-  real32 h11 = REICH_HEIGHT_DATA[idx + REICH_MAX_GRID_WIDTH + 1];
+/* Shadow raycasting fast path: bilinear height from the resident chunks,
+ * starting at one level and falling back to coarser ones, which the LOD
+ * walk keeps resident. FALSE when no level covers the position. Callers
+ * keep the position inside the map. */
+static int32 terrain_level_height(const TerrainStore* store, int32 level, real32 worldX, real32 worldY, real32* height) {
+  real32 levelX, levelY, fractX, fractY, h00, h10, h01, h11;
+  int32 gridX, gridY, slot = 0, idx;
+  const real32* heights;
+
+  for (; level < TERRAIN_LEVELS; level++) {
+    levelX = worldX * store->invStep[level];
+    levelY = worldY * store->invStep[level];
+    gridX = (int32)levelX;
+    gridY = (int32)levelY;
+    slot = store->directory[level][(gridY >> TERRAIN_CHUNK_SHIFT) * store->chunksX[level] + (gridX >> TERRAIN_CHUNK_SHIFT)];
+    if (slot) { break; }
+  }
+  if (!slot) { return FALSE; }
+  fractX = levelX - (real32)gridX;
+  fractY = levelY - (real32)gridY;
+  heights = store->chunks[slot - 1].height;
+  idx = (gridY & TERRAIN_CHUNK_MASK) * TERRAIN_CHUNK_STRIDE + (gridX & TERRAIN_CHUNK_MASK);
+  h00 = heights[idx];
+  h10 = heights[idx + 1];
+  h01 = heights[idx + TERRAIN_CHUNK_STRIDE];
+  h11 = heights[idx + TERRAIN_CHUNK_STRIDE + 1];
 
   if (fractX >= fractY) {
-    return h00 + (h10 - h00) * fractX + (h11 - h10) * fractY;
+    *height = h00 + (h10 - h00) * fractX + (h11 - h10) * fractY;
   } else {
-    return h00 + (h11 - h01) * fractX + (h01 - h00) * fractY;
+    *height = h00 + (h11 - h01) * fractX + (h01 - h00) * fractY;
   }
+  return TRUE;
 }
 
 void apply_pan_delta(reichCamera* cam, real64 dSx, real64 dSy) {
@@ -168,6 +397,7 @@ static void anchor_camera_to_terrain(reichCamera* cam) {
 
 /* Rewritten for single-precision fast-path */
 static real32 cast_shadow_fast(
+    const TerrainStore* store, int32 level,
     real32 worldX, real32 worldY, real32 worldZ,
     real32 lightDirX, real32 lightDirY, real32 lightDirZ,
     int32 levelOfDetail) {
@@ -183,11 +413,11 @@ static real32 cast_shadow_fast(
     sampleY = worldY + lightDirY * currentT;
     sampleZ = worldZ + lightDirZ * currentT;
 
-    if (sampleZ > TERRAIN_MAX_Z || sampleX < 0.0f || sampleX >= (real32)(REICH_MAX_GRID_WIDTH - 1) || sampleY < 0.0f || sampleY >= (real32)(REICH_MAX_GRID_HEIGHT - 1)) {
+    if (sampleZ > TERRAIN_MAX_Z || sampleX < 0.0f || sampleX >= (real32)(store->width - 1) || sampleY < 0.0f || sampleY >= (real32)(store->height - 1) ||
+        !terrain_level_height(store, level, sampleX, sampleY, &terrainHeight)) {
       break;
     }
 
-    terrainHeight = get_terrain_height_fast(sampleX, sampleY);
     if (sampleZ < terrainHeight) {
         return 0.1f;
     }
@@ -203,6 +433,113 @@ static real32 cast_shadow_fast(
   return shadowFactor < 0.1f ? 0.1f : shadowFactor;
 }
 
+/* Ray parameter where a ray leaves [boxMin, boxMin + boxSize) along one axis */
+static real64 terrain_pick_exit(real64 origin, real64 dir, real64 boxMin, real64 boxSize) {
+  if (dir > 0.0) { return (boxMin + boxSize - origin) / dir; }
+  if (dir < 0.0) { return (boxMin - origin) / dir; }
+  return 1e30;
+}
+
+/* Picks the cell under a screen point by marching the view ray down from
+ * TERRAIN_MAX_Z, front to back. Chunks, then max height blocks, that the
+ * ray clears are stepped over whole, so only cells near the surface get the
+ * exact test against their two triangles. Casts at one level, falling back
+ * to coarser resident chunks like the shadow rays, and returns the hit
+ * cell's origin in world cells, or FALSE when the ray leaves the map. */
+static int32 terrain_pick(
+    reichContext* ctx, reichCamera* cam, const TerrainStore* store, int32 level,
+    real64 screenX, real64 screenY, int32* gridX, int32* gridY) {
+  real64 topX, topY, dirX, dirY, t = 0.0, tEnd = 1.0, t0, t1, exitT, tDiag, x, y, boxX, boxY, boxSize, fx, fy, z;
+  const real64 dz = TERRAIN_MIN_Z - TERRAIN_MAX_Z;
+  const TerrainChunk* chunk;
+  const real32* h;
+  int32 axis, chunkLevel, cellX = 0, cellY = 0, slot = 0, block, i, hit, above, wasAbove = FALSE, steps;
+
+  reich_screen_to_world(ctx, cam, screenX, screenY, (real32)TERRAIN_MAX_Z, &topX, &topY);
+  reich_screen_to_world(ctx, cam, screenX, screenY, (real32)TERRAIN_MIN_Z, &dirX, &dirY);
+  dirX -= topX;
+  dirY -= topY;
+
+  /* Clip to the cells of the map */
+  for (axis = 0; axis < 2; axis++) {
+    x = axis ? topY : topX;
+    y = axis ? dirY : dirX;
+    boxSize = (real64)((axis ? store->height : store->width) - 1);
+    if (y == 0.0) {
+      if (x < 0.0 || x >= boxSize) { return FALSE; }
+      continue;
+    }
+    t0 = -x / y;
+    t1 = (boxSize - x) / y;
+    if (t0 > t1) { exitT = t0; t0 = t1; t1 = exitT; }
+    t = REICH_MAX(t, t0);
+    tEnd = REICH_MIN(tEnd, t1);
+  }
+
+  for (steps = 0; t < tEnd && steps < 65536; steps++) {
+    /* Nudged forward so a point on an edge lands in the cell ahead */
+    x = topX + dirX * (t + 1e-9);
+    y = topY + dirY * (t + 1e-9);
+    if (x < 0.0 || y < 0.0 || x >= (real64)(store->width - 1) || y >= (real64)(store->height - 1)) { break; }
+    for (chunkLevel = level; chunkLevel < TERRAIN_LEVELS; chunkLevel++) {
+      cellX = (int32)x >> chunkLevel;
+      cellY = (int32)y >> chunkLevel;
+      slot = store->directory[chunkLevel][(cellY >> TERRAIN_CHUNK_SHIFT) * store->chunksX[chunkLevel] + (cellX >> TERRAIN_CHUNK_SHIFT)];
+      if (slot) { break; }
+    }
+    if (chunkLevel == TERRAIN_LEVELS) { return FALSE; }
+    chunk = &store->chunks[slot - 1];
+
+    /* Only a chunk at the cast level bounds its area: a coarser fallback
+     * may be under a finer chunk that is resident for part of it */
+    if (chunkLevel == level) {
+      for (i = 0; i < 2; i++) {
+        boxSize = (real64)((i ? TERRAIN_BLOCK_SIZE : TERRAIN_CHUNK_SIZE) << level);
+        boxX = i ? (real64)((cellX & ~(TERRAIN_BLOCK_SIZE - 1)) << level) : (real64)((chunk->chunkX << TERRAIN_CHUNK_SHIFT) << level);
+        boxY = i ? (real64)((cellY & ~(TERRAIN_BLOCK_SIZE - 1)) << level) : (real64)((chunk->chunkY << TERRAIN_CHUNK_SHIFT) << level);
+        block = ((cellY & TERRAIN_CHUNK_MASK) / TERRAIN_BLOCK_SIZE) * TERRAIN_BLOCKS + (cellX & TERRAIN_CHUNK_MASK) / TERRAIN_BLOCK_SIZE;
+        exitT = REICH_MIN(REICH_MIN(terrain_pick_exit(topX, dirX, boxX, boxSize), terrain_pick_exit(topY, dirY, boxY, boxSize)), tEnd);
+        /* The ray only descends, so clearing the top where it leaves clears it all the way */
+        if (TERRAIN_MAX_Z + dz * exitT > (i ? chunk->blockMax[block] : chunk->maxHeight)) { break; }
+      }
+      if (i < 2) {
+        t = REICH_MAX(exitT, t + 1e-9);
+        wasAbove = TRUE;
+        continue;
+      }
+    }
+
+    /* Test where the ray enters the cell, crosses its diagonal and leaves.
+     * Only a crossing from above counts: a ray that comes in under the
+     * surface through the edge of the map sees the culled underside. */
+    boxSize = (real64)(1 << chunkLevel);
+    boxX = (real64)(cellX << chunkLevel);
+    boxY = (real64)(cellY << chunkLevel);
+    exitT = REICH_MIN(REICH_MIN(terrain_pick_exit(topX, dirX, boxX, boxSize), terrain_pick_exit(topY, dirY, boxY, boxSize)), tEnd);
+    tDiag = dirX != dirY ? ((boxX - topX) - (boxY - topY)) / (dirX - dirY) : -1.0;
+    h = chunk->height + (cellY & TERRAIN_CHUNK_MASK) * TERRAIN_CHUNK_STRIDE + (cellX & TERRAIN_CHUNK_MASK);
+    hit = FALSE;
+    for (i = 0; i < 3 && !hit; i++) {
+      t0 = i == 0 ? t : (i == 1 ? tDiag : exitT);
+      if (i == 1 && (tDiag <= t || tDiag >= exitT)) { continue; }
+      fx = REICH_CLAMP((topX + dirX * t0 - boxX) / boxSize, 0.0, 1.0);
+      fy = REICH_CLAMP((topY + dirY * t0 - boxY) / boxSize, 0.0, 1.0);
+      z = fx >= fy ? h[0] + (h[1] - h[0]) * fx + (h[TERRAIN_CHUNK_STRIDE + 1] - h[1]) * fy
+                   : h[0] + (h[TERRAIN_CHUNK_STRIDE + 1] - h[TERRAIN_CHUNK_STRIDE]) * fx + (h[TERRAIN_CHUNK_STRIDE] - h[0]) * fy;
+      above = TERRAIN_MAX_Z + dz * t0 > z;
+      hit = wasAbove && !above;
+      wasAbove = above;
+    }
+    if (hit) {
+      *gridX = cellX << chunkLevel;
+      *gridY = cellY << chunkLevel;
+      return TRUE;
+    }
+    t = REICH_MAX(exitT, t + 1e-9);
+  }
+  return FALSE;
+}
+
 void init_textures() {
   int32 texX, texY;
   real64 noiseVal;
@@ -215,231 +552,1397 @@ void init_textures() {
       TILE_TEXTURE[texY * TILE_TEX_WIDTH + texX] = 0xFF000000 | (colorVal << 16) | (colorVal << 8) | colorVal;
     }
   }
+  reich_texture_init(&tileTexture, TILE_TEXTURE, TILE_TEX_WIDTH, TILE_TEX_HEIGHT, TILE_TEXTURE_MIPS);
 }
 
-int32 grid_init(uint32* grid, uint32 width, uint32 height) {
-  uint32 gridX, gridY;
-  real64 noiseValue;
-  real32 rawHeight;
-  init_textures();
-  for (gridY = 0; gridY < height; gridY++) {
-    for (gridX = 0; gridX < width; gridX++) {
-      noiseValue = reich_noise_fbm2((real64)gridX * 0.006, (real64)gridY * 0.006, MAX_FADE_OCTAVES, 1.9f, 0.5f)*0.5f + 0.5f;
-      noiseValue *= (real64)reich_sqrt((double)noiseValue);
-      
-      /* Store un-clamped height for fast water depth calculations during drawing */
-      rawHeight = (real32)(noiseValue * 255.0) - 40.0f;
-      REICH_RAW_HEIGHT_DATA[gridX + gridY * width] = rawHeight;
-      
-      /* Store pre-clamped heights so draw_world and cast_shadow do zero branching */
-      REICH_HEIGHT_DATA[gridX + gridY * width] = rawHeight < WATER_LVL ? WATER_LVL : rawHeight;
-
-      if (rawHeight < 12.0f) {
-        grid[gridX + gridY * width] = 0xFFEEDD99;
-      } else if (rawHeight < 25.0f) {
-        grid[gridX + gridY * width] = 0xFF66AA44;
-      } else if (rawHeight < 45.0f) {
-        grid[gridX + gridY * width] = 0xFF448833;
-      } else if (rawHeight < 70.0f) {
-        grid[gridX + gridY * width] = 0xFF666666;
-      } else {
-        grid[gridX + gridY * width] = 0xFFF0F0F0;
+/* Fills a claimed chunk from the cache or the noise. Sample positions clamp
+ * to the last row and column of the map, so edge quads keep their old shape. */
+static void terrain_chunk_fill(const TerrainStore* store, TerrainChunk* chunk) {
+  real32 noiseX[TERRAIN_CHUNK_STRIDE], noiseY[TERRAIN_CHUNK_STRIDE];
+  int32 cellX[TERRAIN_CHUNK_STRIDE], cellY[TERRAIN_CHUNK_STRIDE];
+  int32 step = 1 << chunk->level, i, x, y, dx, dy, cell;
+  const real32* h;
+  real32 error, rawMax;
+
+  for (i = 0; i < TERRAIN_CHUNK_STRIDE; i++) {
+    cellX[i] = REICH_MIN((chunk->chunkX * TERRAIN_CHUNK_SIZE + i) * step, store->width - 1);
+    cellY[i] = REICH_MIN((chunk->chunkY * TERRAIN_CHUNK_SIZE + i) * step, store->height - 1);
+  }
+  if (store->cache) {
+    for (y = 0; y < TERRAIN_CHUNK_STRIDE; y++) {
+      const real32* row = store->cache + (reichSize)cellY[y] * store->width;
+      for (x = 0; x < TERRAIN_CHUNK_STRIDE; x++) { chunk->rawHeight[y * TERRAIN_CHUNK_STRIDE + x] = row[cellX[x]]; }
+    }
+  } else {
+    for (i = 0; i < TERRAIN_CHUNK_STRIDE; i++) {
+      noiseX[i] = terrain_noise_coord(cellX[i], store->noiseOffsetX);
+      noiseY[i] = terrain_noise_coord(cellY[i], store->noiseOffsetY);
+    }
+    reich_noise_fbm2_grid(chunk->rawHeight, noiseX, TERRAIN_CHUNK_STRIDE, noiseY, TERRAIN_CHUNK_STRIDE,
+        terrainParams.octaves, terrainParams.lacunarity, terrainParams.gain);
+  }
+  for (i = 0; i < TERRAIN_CHUNK_CELLS; i++) {
+    terrain_shape(chunk->rawHeight[i], &chunk->rawHeight[i], &chunk->height[i], &chunk->color[i]);
+  }
+
+  /* Bounds for culling */
+  chunk->minHeight = chunk->maxHeight = chunk->height[0];
+  for (i = 0; i < TERRAIN_CHUNK_CELLS; i++) {
+    chunk->minHeight = REICH_MIN(chunk->minHeight, chunk->height[i]);
+    chunk->maxHeight = REICH_MAX(chunk->maxHeight, chunk->height[i]);
+  }
+
+  /* Per block, counting the edge samples it shares with its neighbours
+   * since the surface inside interpolates them: the highest sample, and the
+   * LOD error, every odd sample against the average of its even neighbours,
+   * i.e. what the next level up drops. The error is on the raw heights, as
+   * finer levels may lift detail under the water above it. The finer levels
+   * add about as much again (gain 0.5: 1/2 + 1/4 + ...), so a block lower
+   * than that under the surface is flat at any level. */
+  for (i = 0; i < TERRAIN_BLOCKS * TERRAIN_BLOCKS; i++) {
+    cell = (i / TERRAIN_BLOCKS) * TERRAIN_BLOCK_SIZE * TERRAIN_CHUNK_STRIDE + (i % TERRAIN_BLOCKS) * TERRAIN_BLOCK_SIZE;
+    chunk->blockMax[i] = chunk->height[cell];
+    rawMax = chunk->rawHeight[cell];
+    error = 0.0f;
+    for (y = 0; y <= TERRAIN_BLOCK_SIZE; y++) {
+      for (x = 0; x <= TERRAIN_BLOCK_SIZE; x++) {
+        h = &chunk->rawHeight[cell + y * TERRAIN_CHUNK_STRIDE + x];
+        chunk->blockMax[i] = REICH_MAX(chunk->blockMax[i], chunk->height[cell + y * TERRAIN_CHUNK_STRIDE + x]);
+        rawMax = REICH_MAX(rawMax, *h);
+        if (!((x | y) & 1)) { continue; }
+        dx = x & 1;
+        dy = (y & 1) * TERRAIN_CHUNK_STRIDE;
+        error = REICH_MAX(error, REICH_ABS(*h - (h[-dx - dy] + h[dx - dy] + h[dy - dx] + h[dx + dy]) * 0.25f));
       }
     }
+    chunk->blockError[i] = rawMax + error < terrainParams.waterLevel ? 0.0f : error;
   }
-  return TRUE;
 }
 
-DWORD WINAPI process_quads_thread(LPVOID lpParam) {
-  ThreadData* td = (ThreadData*)lpParam;
-  int32 idx;
-
-  td->threadHoverX = -1;
-  td->threadHoverY = -1;
-
-  for (idx = td->startIdx; idx < td->endIdx; idx++) {
-    int32 iy = idx / td->numX;
-    int32 ix = idx % td->numX;
-    int32 gridY = td->gStart_Y + iy * td->gStep_Y;
-    int32 gridX = td->gStart_X + ix * td->gStep_X;
-    int32 nextGridX = gridX + td->levelOfDetail;
-    int32 nextGridY = gridY + td->levelOfDetail;
-    
-    real64 rotCenterX, rotCenterY, projectCenterX, screenRadius;
-    real64 projectCenterY, minScreenY, maxScreenY;
-    real32 height00, height10, height11, height01;
-    __m128 v_wX, v_wY, v_wZ, v_dX, v_dY, v_dZ;
-    __m128 v_cY, v_sY, v_cP, v_sP, v_rX, v_rY, v_zoom, v_hw, v_hh, v_oX, v_oY;
-    float oX[4], oY[4];
-    float screenX00, screenY00, screenX10, screenY10, screenX11, screenY11, screenX01, screenY01;
-    float mX1, mX2, boundMinX, pX1, pX2, boundMaxX, mY1, mY2, boundMinY, pY1, pY2, boundMaxY;
-    float cullTri1, cullTri2;
-    uint32 tileColor;
-    int32 isSelectedQuad = 0;
-    float normalXUnnormalized, normalYUnnormalized, normalZUnnormalized, normalLength, normalX, normalY, normalZ;
-    float averageHeight;
-    int32 isWater;
-    float shadowFactor, normalDotLight;
-    uint32 finalColor, quadColor;
-    real32 rawHeight00, rawHeight10, rawHeight11, rawHeight01, rawAverageHeight, waterDepth;
-    QuadDrawCmd* cmd = &td->cmds[idx];
-
-    if (nextGridX >= REICH_MAX_GRID_WIDTH) { nextGridX = REICH_MAX_GRID_WIDTH - 1; }
-    if (nextGridY >= REICH_MAX_GRID_HEIGHT) { nextGridY = REICH_MAX_GRID_HEIGHT - 1; }
-
-    /* Outer Box Frustum Cull Check */
-    rotCenterX = ((real64)gridX + (real64)td->levelOfDetail * 0.5 - (real64)td->cx) * (real64)td->cY - ((real64)gridY + (real64)td->levelOfDetail * 0.5 - (real64)td->cy) * (real64)td->sY;
-    rotCenterY = ((real64)gridX + (real64)td->levelOfDetail * 0.5 - (real64)td->cx) * (real64)td->sY + ((real64)gridY + (real64)td->levelOfDetail * 0.5 - (real64)td->cy) * (real64)td->cY;
-    projectCenterX = (real64)td->hw + rotCenterX * (real64)td->zm;
-    screenRadius = (real64)td->levelOfDetail * 1.5 * (real64)td->zm;
-
-    if (projectCenterX + screenRadius < td->clipRect.x1 || projectCenterX - screenRadius > td->clipRect.x2) {
-      cmd->visible = 0;
+static void terrain_chunks_job(void* data, int32 start, int32 end, int32 thread) {
+  TerrainStreamJob* sj = (TerrainStreamJob*)data;
+  int32 i;
+  (void)thread;
+  for (i = start; i < end; i++) { terrain_chunk_fill(sj->store, &sj->store->chunks[sj->slots[i]]); }
+}
+
+/* Hands out a free slot, or evicts the least recently used chunk that the
+ * current frame has not touched. Returns -1 when every slot is in view. */
+static int32 terrain_claim_slot(TerrainStore* store) {
+  TerrainChunk* victim = NULL;
+  int32 i;
+  if (store->usedSlots < TERRAIN_CHUNK_SLOTS) { return store->usedSlots++; }
+  for (i = 0; i < TERRAIN_CHUNK_SLOTS; i++) {
+    TerrainChunk* c = &store->chunks[i];
+    if (c->lastUse != store->frame && (!victim || c->lastUse < victim->lastUse)) { victim = c; }
+  }
+  if (!victim) { return -1; }
+  store->directory[victim->level][victim->chunkY * store->chunksX[victim->level] + victim->chunkX] = 0;
+  store->evicted++;
+  return (int32)(victim - store->chunks);
+}
+
+/* Same test as the outer quad cull in process_quads_job, for a square of
+ * world cells around a centre whose heights lie in [minZ, maxZ]. */
+static int32 terrain_near_view(
+    const QuadJobData* jd, real64 centerX, real64 centerY, real64 radius, real64 minZ, real64 maxZ) {
+  real64 rotCenterX = (centerX - (real64)jd->cx) * (real64)jd->cY - (centerY - (real64)jd->cy) * (real64)jd->sY;
+  real64 rotCenterY = (centerX - (real64)jd->cx) * (real64)jd->sY + (centerY - (real64)jd->cy) * (real64)jd->cY;
+  real64 projectCenterX = (real64)jd->hw + rotCenterX * (real64)jd->zm;
+  real64 screenRadius = radius * (real64)jd->zm;
+  real64 projectCenterY, minScreenY, maxScreenY;
+
+  if (projectCenterX + screenRadius < jd->clipRect.x1 || projectCenterX - screenRadius > jd->clipRect.x2) {
+    return FALSE;
+  }
+  projectCenterY = (real64)jd->hh + rotCenterY * (real64)jd->sP * (real64)jd->zm;
+  minScreenY = projectCenterY - screenRadius - (maxZ - (real64)jd->cz) * (real64)jd->zm * (real64)jd->cP;
+  maxScreenY = projectCenterY + screenRadius - (minZ - (real64)jd->cz) * (real64)jd->zm * (real64)jd->cP;
+  return !(maxScreenY < jd->clipRect.y1 || minScreenY > jd->clipRect.y2);
+}
+
+/* Makes the listed chunks of one level resident, nearest to the camera
+ * first so those claim slots first. The list keeps its order; missing chunks
+ * are generated on the job pool, and any that find no slot stay absent. */
+static void terrain_stream(
+    reichContext* ctx, TerrainStore* store, const QuadJobData* jd, int32 level, const int32* list, int32 count) {
+  int32 chunkCells = TERRAIN_CHUNK_SIZE << level;
+  int32 chunksX = store->chunksX[level];
+  int32 numMissing = 0, i, j, slot, key;
+  int32* slots = (int32*)reich_arena_alloc(&ctx->frameMem, count * sizeof(int32));
+  int32* sorted = (int32*)reich_arena_alloc(&ctx->frameMem, count * sizeof(int32));
+  real32* dist = (real32*)reich_arena_alloc(&ctx->frameMem, count * sizeof(real32));
+  real64 centerX, centerY;
+  real32 d;
+  TerrainStreamJob sj;
+
+  if (count <= 0 || !slots || !sorted || !dist) { return; }
+  for (i = 0; i < count; i++) {
+    key = list[i];
+    centerX = ((real64)(key % chunksX) + 0.5) * chunkCells;
+    centerY = ((real64)(key / chunksX) + 0.5) * chunkCells;
+    d = (real32)((centerX - jd->cx) * (centerX - jd->cx) + (centerY - jd->cy) * (centerY - jd->cy));
+    for (j = i; j > 0 && dist[j - 1] > d; j--) {
+      sorted[j] = sorted[j - 1];
+      dist[j] = dist[j - 1];
+    }
+    sorted[j] = key;
+    dist[j] = d;
+  }
+
+  for (i = 0; i < count; i++) {
+    int32* entry = &store->directory[level][sorted[i]];
+    TerrainChunk* chunk;
+    if (*entry) {
+      store->chunks[*entry - 1].lastUse = store->frame;
       continue;
     }
+    slot = terrain_claim_slot(store);
+    if (slot < 0) { break; }
+    chunk = &store->chunks[slot];
+    chunk->level = level;
+    chunk->chunkX = sorted[i] % chunksX;
+    chunk->chunkY = sorted[i] / chunksX;
+    chunk->lastUse = store->frame;
+    chunk->litVersion = 0;
+    *entry = slot + 1;
+    slots[numMissing++] = slot;
+  }
+  store->generated += numMissing;
+  sj.store = store;
+  sj.slots = slots;
+  reich_jobs_parallel_for(numMissing, 1, terrain_chunks_job, &sj);
+}
+
+/* Geomipmap test: a block may stay at its level while its quads are at most
+ * TERRAIN_LOD_QUAD_PX tall on screen and the detail the level drops projects
+ * under TERRAIN_LOD_ERROR_PX. A block only knows what the next level would
+ * drop; one level removes about one octave, so its own share is that times
+ * the fbm gain. The camera is orthographic, so both terms depend on zoom and
+ * pitch, not distance: rough blocks stay fine, flat ones and deep water
+ * coarsen. Nodes stay within TERRAIN_BLOCK_SHIFT levels of the finest one,
+ * so a coarser neighbour's quad never spans more than a whole block edge. */
+static int32 terrain_node_fits(const QuadJobData* jd, int32 level, real32 error) {
+  real32 quadSize = (real32)(1 << level) * jd->zm;
+  return useTerrainLod && level <= jd->baseLevel + TERRAIN_BLOCK_SHIFT && quadSize * jd->sP <= TERRAIN_LOD_QUAD_PX &&
+         error * terrainParams.gain * jd->zm * jd->cP <= TERRAIN_LOD_ERROR_PX;
+}
+
+static uint32 terrain_spread_bits(uint32 v) {
+  v &= 0xFFFF;
+  v = (v | (v << 8)) & 0x00FF00FF;
+  v = (v | (v << 4)) & 0x0F0F0F0F;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+/* Quadtree order over full resolution block units, mirrored per axis so the
+ * far side of every split comes first. Disjoint nodes then sort in a valid
+ * painter's order whatever their sizes. */
+static uint32 terrain_node_key(const QuadJobData* jd, const TerrainNode* node) {
+  uint32 unitX = (uint32)(((node->chunk->chunkX << TERRAIN_CHUNK_SHIFT) + node->localX0) >> TERRAIN_BLOCK_SHIFT) << node->level;
+  uint32 unitY = (uint32)(((node->chunk->chunkY << TERRAIN_CHUNK_SHIFT) + node->localY0) >> TERRAIN_BLOCK_SHIFT) << node->level;
+  if (jd->sY <= 0.0f) { unitX = 0xFFFF - unitX; }
+  if (jd->cY <= 0.0f) { unitY = 0xFFFF - unitY; }
+  return (terrain_spread_bits(unitY) << 1) | terrain_spread_bits(unitX);
+}
+
+/* Sorts keys with four byte-wide counting passes, carrying each one's index
+ * in order along. tmpKeys and tmpOrder are scratch of the same length; the
+ * result ends up back in keys and order. */
+static void terrain_sort_keys(uint32* keys, int32* order, uint32* tmpKeys, int32* tmpOrder, int32 count) {
+  int32 counts[256], shift, i, sum, n;
+  uint32* swapKeys;
+  int32* swapOrder;
+
+  for (shift = 0; shift < 32; shift += 8) {
+    reich_memset(counts, 0, sizeof(counts));
+    for (i = 0; i < count; i++) { counts[(keys[i] >> shift) & 0xFF]++; }
+    for (i = 0, sum = 0; i < 256; i++) {
+      n = counts[i];
+      counts[i] = sum;
+      sum += n;
+    }
+    for (i = 0; i < count; i++) {
+      n = counts[(keys[i] >> shift) & 0xFF]++;
+      tmpKeys[n] = keys[i];
+      tmpOrder[n] = order[i];
+    }
+    swapKeys = keys;
+    keys = tmpKeys;
+    tmpKeys = swapKeys;
+    swapOrder = order;
+    order = tmpOrder;
+    tmpOrder = swapOrder;
+  }
+}
+
+/* Picks this frame's quadtree leaves. Walks down from the coarsest level,
+ * streaming each level's chunks as one batch, each with the mask of its
+ * blocks still to place. A block stops where it fits (see terrain_node_fits),
+ * at the finest level the zoom allows, or when refining would overflow the
+ * chunk pool; otherwise its children, a 2x2 group of blocks in one chunk of
+ * the next level, go on. Coarsest chunks around the view stay resident for
+ * shadow rays. Fills in the leaves clipped to the grid range, in painter's
+ * order, with their seams to coarser nodes marked, and the distinct chunks
+ * they draw from. */
+static void terrain_select(
+    reichContext* ctx, TerrainStore* store, QuadJobData* jd,
+    int32 startGridX, int32 startGridY, int32 endGridX, int32 endGridY) {
+  int32 baseLevel = jd->baseLevel, level = TERRAIN_LEVELS - 1, size = TERRAIN_CHUNK_SIZE << level;
+  int32 chunkX0 = REICH_MAX(startGridX / size - 1, 0);
+  int32 chunkY0 = REICH_MAX(startGridY / size - 1, 0);
+  int32 chunkX1 = REICH_MIN((endGridX - 1) / size + 1, store->chunksX[level] - 1);
+  int32 chunkY1 = REICH_MIN((endGridY - 1) / size + 1, store->chunksY[level] - 1);
+  int32 maxList = REICH_MAX((chunkX1 - chunkX0 + 1) * (chunkY1 - chunkY0 + 1), 4 * TERRAIN_CHUNK_SLOTS);
+  int32 maxNodes = TERRAIN_CHUNK_SLOTS * TERRAIN_BLOCKS * TERRAIN_BLOCKS;
+  int32 *list, *next, *swap, *levelMap, *order, *tmpOrder, count = 0, numNext, numLeaves = 0, numChunks = 0, streamed = 0;
+  int32 i, j, c, b, q, room, isLeaf, chunkX, chunkY, lo, hi, shift, mapX0, mapY0, mapW, mapH, unitX, unitY, unitSize, x, y;
+  uint32 *mask, *nextMask, *swapMask, *keys, *tmpKeys, childMask[4];
+  TerrainNode *leaves, *nodes, *node;
+  TerrainChunk *chunk, **chunks;
+  real64 centerX, centerY, blockCells;
+
+  jd->nodes = NULL;
+  jd->numNodes = 0;
+  jd->chunks = NULL;
+  jd->numChunks = 0;
+  if (chunkX1 < chunkX0 || chunkY1 < chunkY0) { return; }
+  list = (int32*)reich_arena_alloc(&ctx->frameMem, maxList * sizeof(int32));
+  next = (int32*)reich_arena_alloc(&ctx->frameMem, maxList * sizeof(int32));
+  mask = (uint32*)reich_arena_alloc(&ctx->frameMem, maxList * sizeof(uint32));
+  nextMask = (uint32*)reich_arena_alloc(&ctx->frameMem, maxList * sizeof(uint32));
+  leaves = (TerrainNode*)reich_arena_alloc(&ctx->frameMem, maxNodes * sizeof(TerrainNode));
+  nodes = (TerrainNode*)reich_arena_alloc(&ctx->frameMem, maxNodes * sizeof(TerrainNode));
+  keys = (uint32*)reich_arena_alloc(&ctx->frameMem, maxNodes * sizeof(uint32));
+  tmpKeys = (uint32*)reich_arena_alloc(&ctx->frameMem, maxNodes * sizeof(uint32));
+  order = (int32*)reich_arena_alloc(&ctx->frameMem, maxNodes * sizeof(int32));
+  tmpOrder = (int32*)reich_arena_alloc(&ctx->frameMem, maxNodes * sizeof(int32));
+  chunks = (TerrainChunk**)reich_arena_alloc(&ctx->frameMem, TERRAIN_CHUNK_SLOTS * sizeof(TerrainChunk*));
+  if (!list || !next || !mask || !nextMask || !leaves || !nodes || !keys || !tmpKeys || !order || !tmpOrder || !chunks) {
+    return;
+  }
+
+  store->frame++;
+  for (chunkY = chunkY0; chunkY <= chunkY1; chunkY++) {
+    for (chunkX = chunkX0; chunkX <= chunkX1; chunkX++) {
+      centerX = ((real64)chunkX + 0.5) * size;
+      centerY = ((real64)chunkY + 0.5) * size;
+      /* Half diagonal plus one chunk, the furthest a shadow ray marches */
+      if (terrain_near_view(jd, centerX, centerY, (real64)size * 1.75, TERRAIN_MIN_Z, TERRAIN_MAX_Z)) {
+        mask[count] = (1u << (TERRAIN_BLOCKS * TERRAIN_BLOCKS)) - 1;
+        list[count++] = chunkY * store->chunksX[level] + chunkX;
+      }
+    }
+  }
+
+  for (;;) {
+    terrain_stream(ctx, store, jd, level, list, count);
+    streamed += count;
+    blockCells = (real64)(TERRAIN_BLOCK_SIZE << level);
+    numNext = 0;
+    for (i = 0; i < count; i++) {
+      c = store->directory[level][list[i]];
+      if (!c) { continue; }
+      chunk = &store->chunks[c - 1];
+      room = level > baseLevel && streamed + numNext + 4 <= TERRAIN_CHUNK_SLOTS;
+      isLeaf = FALSE;
+      childMask[0] = childMask[1] = childMask[2] = childMask[3] = 0;
+      for (b = 0; b < TERRAIN_BLOCKS * TERRAIN_BLOCKS; b++) {
+        if (!((mask[i] >> b) & 1)) { continue; }
+        x = chunk->chunkX * TERRAIN_BLOCKS + b % TERRAIN_BLOCKS;
+        y = chunk->chunkY * TERRAIN_BLOCKS + b / TERRAIN_BLOCKS;
+        centerX = ((real64)x + 0.5) * blockCells;
+        centerY = ((real64)y + 0.5) * blockCells;
+        if (!terrain_near_view(jd, centerX, centerY, blockCells * 0.75, chunk->minHeight, chunk->blockMax[b])) { continue; }
+
+        if (room && !terrain_node_fits(jd, level, chunk->blockError[b])) {
+          /* Children start at twice the block coordinates, one level down */
+          x *= 2;
+          y *= 2;
+          q = ((y / TERRAIN_BLOCKS) & 1) * 2 + ((x / TERRAIN_BLOCKS) & 1);
+          j = (y % TERRAIN_BLOCKS) * TERRAIN_BLOCKS + x % TERRAIN_BLOCKS;
+          childMask[q] |= (3u << j) | (3u << (j + TERRAIN_BLOCKS));
+          continue;
+        }
+        if (numLeaves == maxNodes) { continue; }
+        node = &leaves[numLeaves++];
+        reich_memset(node, 0, sizeof(TerrainNode));
+        node->chunk = chunk;
+        node->level = level;
+        node->localX0 = (b % TERRAIN_BLOCKS) * TERRAIN_BLOCK_SIZE;
+        node->localY0 = (b / TERRAIN_BLOCKS) * TERRAIN_BLOCK_SIZE;
+        isLeaf = TRUE;
+      }
+      if (isLeaf) { chunks[numChunks++] = chunk; }
+
+      for (q = 0; q < 4; q++) {
+        chunkX = chunk->chunkX * 2 + (q & 1);
+        chunkY = chunk->chunkY * 2 + (q >> 1);
+        if (!childMask[q] || chunkX >= store->chunksX[level - 1] || chunkY >= store->chunksY[level - 1]) { continue; }
+        nextMask[numNext] = childMask[q];
+        next[numNext++] = chunkY * store->chunksX[level - 1] + chunkX;
+      }
+    }
+    if (level == baseLevel || !numNext) { break; }
+    level--;
+    swap = list;
+    list = next;
+    next = swap;
+    swapMask = mask;
+    mask = nextMask;
+    nextMask = swapMask;
+    count = numNext;
+  }
+
+  /* Clip to the grid range, then sort into painter's order */
+  for (i = 0, j = 0; i < numLeaves; i++) {
+    node = &leaves[i];
+    shift = node->level;
+    lo = REICH_MAX((node->chunk->chunkX << TERRAIN_CHUNK_SHIFT) + node->localX0, startGridX >> shift);
+    hi = REICH_MIN((node->chunk->chunkX << TERRAIN_CHUNK_SHIFT) + node->localX0 + TERRAIN_BLOCK_SIZE,
+        (endGridX + (1 << shift) - 1) >> shift);
+    node->stepX = jd->sY > 0.0f ? 1 : -1;
+    node->quadX0 = node->stepX > 0 ? lo : hi - 1;
+    node->numX = hi - lo;
+    lo = REICH_MAX((node->chunk->chunkY << TERRAIN_CHUNK_SHIFT) + node->localY0, startGridY >> shift);
+    hi = REICH_MIN((node->chunk->chunkY << TERRAIN_CHUNK_SHIFT) + node->localY0 + TERRAIN_BLOCK_SIZE,
+        (endGridY + (1 << shift) - 1) >> shift);
+    node->stepY = jd->cY > 0.0f ? 1 : -1;
+    node->quadY0 = node->stepY > 0 ? lo : hi - 1;
+    node->numY = hi - lo;
+    if (node->numX <= 0 || node->numY <= 0) { continue; }
+    keys[j] = terrain_node_key(jd, node);
+    order[j++] = i;
+  }
+  numLeaves = j;
+  terrain_sort_keys(keys, order, tmpKeys, tmpOrder, numLeaves);
+  for (i = 0; i < numLeaves; i++) { nodes[i] = leaves[order[i]]; }
+
+  /* Leaf level per finest block unit, to find seams with coarser nodes.
+   * A coarser neighbour is aligned and larger, so it covers the whole edge. */
+  mapX0 = ((startGridX >> baseLevel) >> TERRAIN_BLOCK_SHIFT) - 1;
+  mapY0 = ((startGridY >> baseLevel) >> TERRAIN_BLOCK_SHIFT) - 1;
+  mapW = (((endGridX - 1) >> baseLevel) >> TERRAIN_BLOCK_SHIFT) - mapX0 + 2;
+  mapH = (((endGridY - 1) >> baseLevel) >> TERRAIN_BLOCK_SHIFT) - mapY0 + 2;
+  levelMap = (int32*)reich_arena_alloc(&ctx->frameMem, (reichSize)mapW * mapH * sizeof(int32));
+  if (!levelMap) { return; }
+  reich_memset(levelMap, 0, (reichSize)mapW * mapH * sizeof(int32));
+  for (i = 0; i < numLeaves; i++) {
+    node = &nodes[i];
+    unitSize = 1 << (node->level - baseLevel);
+    unitX = (((node->chunk->chunkX << TERRAIN_CHUNK_SHIFT) + node->localX0) >> TERRAIN_BLOCK_SHIFT) * unitSize - mapX0;
+    unitY = (((node->chunk->chunkY << TERRAIN_CHUNK_SHIFT) + node->localY0) >> TERRAIN_BLOCK_SHIFT) * unitSize - mapY0;
+    for (y = REICH_MAX(unitY, 0); y < REICH_MIN(unitY + unitSize, mapH); y++) {
+      for (x = REICH_MAX(unitX, 0); x < REICH_MIN(unitX + unitSize, mapW); x++) { levelMap[y * mapW + x] = node->level + 1; }
+    }
+  }
+  for (i = 0, c = 0; i < numLeaves; i++) {
+    node = &nodes[i];
+    unitSize = 1 << (node->level - baseLevel);
+    unitX = (((node->chunk->chunkX << TERRAIN_CHUNK_SHIFT) + node->localX0) >> TERRAIN_BLOCK_SHIFT) * unitSize - mapX0;
+    unitY = (((node->chunk->chunkY << TERRAIN_CHUNK_SHIFT) + node->localY0) >> TERRAIN_BLOCK_SHIFT) * unitSize - mapY0;
+    for (j = 0; j < 4; j++) {
+      x = j == 0 ? unitX - 1 : (j == 1 ? unitX + unitSize : unitX);
+      y = j == 2 ? unitY - 1 : (j == 3 ? unitY + unitSize : unitY);
+      if (x >= 0 && x < mapW && y >= 0 && y < mapH && levelMap[y * mapW + x] - 1 > node->level) {
+        node->stitch[j] = levelMap[y * mapW + x] - 1;
+      }
+    }
+    node->firstCmd = c;
+    c += node->numX * node->numY;
+  }
+  jd->nodes = nodes;
+  jd->numNodes = numLeaves;
+  jd->chunks = chunks;
+  jd->numChunks = numChunks;
+}
+
+/* Moves a vertex on a seam with a coarser node back onto that node's
+ * previous vertex. Quads along the seam then fan out from the coarser
+ * vertices and the ones that collapse fail the backface test, so the seam
+ * is drawn with exactly the coarser node's edges and no T-junctions. */
+static void terrain_stitch_corner(
+    const TerrainStore* store, const TerrainNode* node, int32 localX, int32 localY,
+    real32* worldX, real32* worldY, real32* height) {
+  int32 edge, step;
+
+  for (edge = 0; edge < 4; edge++) {
+    if (!node->stitch[edge]) { continue; }
+    if (edge == 0 && localX != node->localX0) { continue; }
+    if (edge == 1 && localX != node->localX0 + TERRAIN_BLOCK_SIZE) { continue; }
+    if (edge == 2 && localY != node->localY0) { continue; }
+    if (edge == 3 && localY != node->localY0 + TERRAIN_BLOCK_SIZE) { continue; }
+    step = 1 << (node->stitch[edge] - node->level);
+    if (edge < 2) { localY &= ~(step - 1); } else { localX &= ~(step - 1); }
+  }
+  *worldX = (real32)REICH_MIN(((node->chunk->chunkX << TERRAIN_CHUNK_SHIFT) + localX) << node->level, store->width - 1);
+  *worldY = (real32)REICH_MIN(((node->chunk->chunkY << TERRAIN_CHUNK_SHIFT) + localY) << node->level, store->height - 1);
+  *height = node->chunk->height[localY * TERRAIN_CHUNK_STRIDE + localX];
+}
+
+static void terrain_cache_rows_job(void* data, int32 startRow, int32 endRow, int32 thread) {
+  TerrainCacheJob* cj = (TerrainCacheJob*)data;
+  (void)thread;
+  reich_noise_fbm2_grid(cj->band + (reichSize)startRow * cj->width, cj->noiseX, cj->width,
+      cj->noiseY + cj->firstRow + startRow, endRow - startRow, terrainParams.octaves, terrainParams.lacunarity, terrainParams.gain);
+}
+
+static void terrain_cache_header(TerrainCacheHeader* hdr, int32 width, int32 height) {
+  const uint8* bytes = (const uint8*)hdr;
+  uint32 i, key = 2166136261u;
+  reich_memset(hdr, 0, sizeof(TerrainCacheHeader));
+  hdr->magic = TERRAIN_CACHE_MAGIC;
+  hdr->version = TERRAIN_CACHE_VERSION;
+  hdr->width = (uint32)width;
+  hdr->height = (uint32)height;
+  reich_memcpy(&hdr->params, &terrainParams, sizeof(TerrainParams));
+  for (i = 0; i < sizeof(TerrainCacheHeader); i++) { key = (key ^ bytes[i]) * 16777619u; }
+  hdr->key = key;
+}
+
+static int32 terrain_cache_map(TerrainStore* store, const char* name, const TerrainCacheHeader* want) {
+  reichSize cells = (reichSize)want->width * want->height, size, i = 0;
+  uint8* view = (uint8*)reich_sys_file_map(name, &size);
+  if (!view) { return FALSE; }
+  if (size == sizeof(TerrainCacheHeader) + cells * sizeof(real32)) {
+    for (i = 0; i < sizeof(TerrainCacheHeader); i++) {
+      if (view[i] != ((const uint8*)want)[i]) { break; }
+    }
+  }
+  if (i != sizeof(TerrainCacheHeader)) {
+    reich_sys_log(REICH_LOG_WARN, "Terrain cache %s is stale, regenerating", name);
+    reich_sys_file_unmap(view, size);
+    return FALSE;
+  }
+  store->cacheView = view;
+  store->cacheSize = size;
+  store->cache = (const real32*)(view + sizeof(TerrainCacheHeader));
+  return TRUE;
+}
 
-    projectCenterY = (real64)td->hh + (rotCenterY * (real64)td->sP - (0.0 - (real64)td->cz) * (real64)td->cP) * (real64)td->zm;
-    minScreenY = projectCenterY - screenRadius - (TERRAIN_MAX_Z - (real64)td->cz) * (real64)td->zm * (real64)td->cP;
-    maxScreenY = projectCenterY + screenRadius - (TERRAIN_MIN_Z - (real64)td->cz) * (real64)td->zm * (real64)td->cP;
+/* Streams the fbm out in bands of rows, so writing the cache never holds
+ * more than one band in memory. */
+static int32 terrain_cache_write(const TerrainStore* store, const char* name, const TerrainCacheHeader* hdr) {
+  reichSize bandBytes, rowBytes = (reichSize)store->width * sizeof(real32);
+  real32* mem = (real32*)reich_sys_alloc(rowBytes * (TERRAIN_BAND_ROWS + 1) + (reichSize)store->height * sizeof(real32));
+  reichHandle file = reich_sys_file_open(name, REICH_FILE_WRITE);
+  TerrainCacheJob cj;
+  int32 i, rows, ok;
+
+  if (!mem || !file) {
+    if (file) { reich_sys_file_close(file); }
+    reich_sys_free(mem);
+    return FALSE;
+  }
+  cj.band = mem;
+  cj.noiseX = mem + (reichSize)store->width * TERRAIN_BAND_ROWS;
+  cj.noiseY = cj.noiseX + store->width;
+  cj.width = store->width;
+  for (i = 0; i < store->width; i++) { ((real32*)cj.noiseX)[i] = terrain_noise_coord(i, store->noiseOffsetX); }
+  for (i = 0; i < store->height; i++) { ((real32*)cj.noiseY)[i] = terrain_noise_coord(i, store->noiseOffsetY); }
+
+  /* A short write leaves a file that fails the size check next time */
+  ok = reich_sys_file_write(file, hdr, sizeof(TerrainCacheHeader)) == sizeof(TerrainCacheHeader);
+  for (cj.firstRow = 0; ok && cj.firstRow < store->height; cj.firstRow += TERRAIN_BAND_ROWS) {
+    rows = REICH_MIN(TERRAIN_BAND_ROWS, store->height - cj.firstRow);
+    reich_jobs_parallel_for(rows, 4, terrain_cache_rows_job, &cj);
+    bandBytes = rowBytes * rows;
+    ok = reich_sys_file_write(file, cj.band, bandBytes) == bandBytes;
+  }
+  reich_sys_file_close(file);
+  reich_sys_free(mem);
+  return ok;
+}
+
+/* Resets the chunk store to an empty width x height world for the current
+ * terrainParams. Worlds up to TERRAIN_CACHE_MAX_CELLS also get their fbm
+ * cached on disk and mapped, so later runs fill chunks from the file. */
+int32 terrain_load(int32 width, int32 height) {
+  TerrainStore* store = &terrainStore;
+  TerrainCacheHeader hdr;
+  char name[64];
+  int32 level, quadsX, quadsY;
+
+  if (store->cacheView) { reich_sys_file_unmap(store->cacheView, store->cacheSize); }
+  store->cacheView = NULL;
+  store->cache = NULL;
+  store->width = width;
+  store->height = height;
+  store->chunks = terrainChunks;
+  store->usedSlots = 0;
+  store->frame = 0;
+  store->generated = 0;
+  store->evicted = 0;
+  store->lightVersion = 0;
+  store->lightDirX = store->lightDirY = store->lightDirZ = 0.0f;
+  store->noiseOffsetX = (real64)(terrainParams.seed % 256) * 17.31;
+  store->noiseOffsetY = (real64)(terrainParams.seed / 256 % 256) * 23.17;
+  for (level = 0; level < TERRAIN_LEVELS; level++) {
+    quadsX = (width + (1 << level) - 1) >> level;
+    quadsY = (height + (1 << level) - 1) >> level;
+    store->chunksX[level] = (quadsX + TERRAIN_CHUNK_MASK) >> TERRAIN_CHUNK_SHIFT;
+    store->chunksY[level] = (quadsY + TERRAIN_CHUNK_MASK) >> TERRAIN_CHUNK_SHIFT;
+    store->invStep[level] = 1.0f / (real32)(1 << level);
+    reich_sys_free(store->directory[level]);
+    store->directory[level] = (int32*)reich_sys_alloc(
+        (reichSize)store->chunksX[level] * store->chunksY[level] * sizeof(int32));
+    if (!store->directory[level]) {
+      reich_sys_log(REICH_LOG_ERROR, "Failed to allocate the terrain directory.");
+      return FALSE;
+    }
+  }
+  init_textures();
+
+  if ((int64)width * height > TERRAIN_CACHE_MAX_CELLS) { return TRUE; }
+  terrain_cache_header(&hdr, width, height);
+  reich_string_format(name, sizeof(name), "terrain_%08x.cache", hdr.key);
+  if (terrain_cache_map(store, name, &hdr)) {
+    reich_sys_log(REICH_LOG_INFO, "Terrain mapped from %s", name);
+  } else if (terrain_cache_write(store, name, &hdr)) {
+    terrain_cache_map(store, name, &hdr);
+  }
+  return TRUE;
+}
+
+/* N.L from a quad's corner heights times the shadow ray from its centre,
+ * for the sun the cached lighting is for */
+static real32 terrain_quad_light(
+    const TerrainStore* store, int32 level, int32 gridX, int32 gridY, int32 levelOfDetail,
+    real32 height00, real32 height10, real32 height11, real32 height01) {
+  real32 normalX = (height00 + height01) - (height10 + height11);
+  real32 normalY = (height00 + height10) - (height11 + height01);
+  real32 normalZ = 2.0f * (float)levelOfDetail;
+  real32 normalLength = (float)reich_sqrt((double)(normalX * normalX + normalY * normalY + normalZ * normalZ));
+  real32 normalDotLight = (normalX / normalLength) * store->lightDirX + (normalY / normalLength) * store->lightDirY +
+                          (normalZ / normalLength) * store->lightDirZ;
+  real32 averageHeight = (height00 + height10 + height11 + height01) * 0.25f;
+  if (normalDotLight < 0.0f) normalDotLight = 0.0f;
+
+  return normalDotLight * cast_shadow_fast(
+      store, level,
+      (float)gridX + levelOfDetail * 0.5f,
+      (float)gridY + levelOfDetail * 0.5f,
+      averageHeight + 0.1f,
+      store->lightDirX, store->lightDirY, store->lightDirZ,
+      levelOfDetail);
+}
 
-    if (maxScreenY < td->clipRect.y1 || minScreenY > td->clipRect.y2) {
-      cmd->visible = 0;
+static void terrain_light_job(void* data, int32 startRow, int32 endRow, int32 thread) {
+  TerrainLightJob* lj = (TerrainLightJob*)data;
+  TerrainChunk* chunk;
+  const real32* h;
+  int32 row, x, y;
+  (void)thread;
+
+  for (row = startRow; row < endRow; row++) {
+    chunk = lj->chunks[row / TERRAIN_CHUNK_SIZE];
+    y = row % TERRAIN_CHUNK_SIZE;
+    for (x = 0; x < TERRAIN_CHUNK_SIZE; x++) {
+      h = &chunk->height[y * TERRAIN_CHUNK_STRIDE + x];
+      chunk->light[y * TERRAIN_CHUNK_STRIDE + x] = terrain_quad_light(
+          lj->store, lj->level,
+          ((chunk->chunkX << TERRAIN_CHUNK_SHIFT) + x) << chunk->level,
+          ((chunk->chunkY << TERRAIN_CHUNK_SHIFT) + y) << chunk->level,
+          1 << chunk->level,
+          h[0], h[1], h[TERRAIN_CHUNK_STRIDE + 1], h[TERRAIN_CHUNK_STRIDE]);
+    }
+  }
+}
+
+/* The sun moves a little every frame and the terrain not at all, so light
+ * values stay cached per chunk until the sun turns past the tolerance.
+ * Chunks new this frame are lit before drawing; stale ones keep their old
+ * values and are relit TERRAIN_RELIGHT_CHUNKS per frame, oldest first. */
+static void terrain_relight(reichContext* ctx, TerrainStore* store, const QuadJobData* jd) {
+  TerrainChunk** list = (TerrainChunk**)reich_arena_alloc(&ctx->frameMem, jd->numChunks * sizeof(TerrainChunk*));
+  TerrainChunk* chunk;
+  int32 i, j, numNew, count = 0;
+  TerrainLightJob lj;
+
+  if (!list) { return; }
+  if (jd->lightDirX * store->lightDirX + jd->lightDirY * store->lightDirY + jd->lightDirZ * store->lightDirZ <
+      TERRAIN_LIGHT_TOLERANCE) {
+    store->lightVersion++;
+    store->lightDirX = jd->lightDirX;
+    store->lightDirY = jd->lightDirY;
+    store->lightDirZ = jd->lightDirZ;
+  }
+
+  /* New chunks first, then stale ones sorted by age */
+  for (i = 0; i < jd->numChunks; i++) {
+    if (!jd->chunks[i]->litVersion) { list[count++] = jd->chunks[i]; }
+  }
+  numNew = count;
+  for (i = 0; i < jd->numChunks; i++) {
+    chunk = jd->chunks[i];
+    if (!chunk->litVersion || (chunk->litVersion == store->lightVersion && chunk->litLevel == jd->baseLevel)) {
       continue;
     }
+    for (j = count++; j > numNew && list[j - 1]->litVersion > chunk->litVersion; j--) { list[j] = list[j - 1]; }
+    list[j] = chunk;
+  }
+  count = REICH_MIN(count, numNew + TERRAIN_RELIGHT_CHUNKS);
+  for (i = 0; i < count; i++) {
+    list[i]->litVersion = store->lightVersion;
+    list[i]->litLevel = jd->baseLevel;
+  }
+
+  lj.store = store;
+  lj.chunks = list;
+  lj.level = jd->baseLevel;
+  reich_jobs_parallel_for(count * TERRAIN_CHUNK_SIZE, 4, terrain_light_job, &lj);
+}
+
+/* Hover and selection highlight and the store, shared by the scalar and
+ * vector paths. sx and sy hold the corners 00, 10, 11, 01. */
+static int32 quad_emit(
+    QuadJobData* td, int32 slot, const float* sx, const float* sy, float cullTri1, float cullTri2,
+    uint32 finalColor, int32 gridX, int32 gridY, int32 nextGridX, int32 nextGridY) {
+  QuadDrawList* out = td->batches;
+  int32 isSelectedQuad = 0;
+  int32 isHovered = td->hoverX >= gridX && td->hoverX < nextGridX && td->hoverY >= gridY && td->hoverY < nextGridY;
+
+  if (td->selBoxMinX != -1 && td->selBoxMaxX != -1) { /* isSelectingBox */
+    if (!(nextGridX < td->selBoxMinX || gridX > td->selBoxMaxX || nextGridY < td->selBoxMinY || gridY > td->selBoxMaxY)) {
+      isSelectedQuad = 1;
+    }
+  } else if (selectionMinX != -1) {
+    if (!(nextGridX < selectionMinX || gridX > selectionMaxX || nextGridY < selectionMinY || gridY > selectionMaxY)) {
+      isSelectedQuad = 2;
+    }
+  }
+
+  out->x00[slot] = sx[0]; out->y00[slot] = sy[0];
+  out->x10[slot] = sx[1]; out->y10[slot] = sy[1];
+  out->x11[slot] = sx[2]; out->y11[slot] = sy[2];
+  out->x01[slot] = sx[3]; out->y01[slot] = sy[3];
+  out->cullTri1[slot] = cullTri1;
+  out->cullTri2[slot] = cullTri2;
+  out->quadColor[slot] = (isSelectedQuad == 2)
+      ? 0xFFFFFFFF
+      : (isSelectedQuad == 1 ? reich_lerp_col(finalColor, 0xFFFFFFFF, 0.4f)
+                   : (isHovered ? reich_lerp_col(finalColor, 0xFFFFFF00, 0.5f)
+                                : finalColor));
+  return 1;
+}
+
+/* Projects, culls and shades one quad of a node. A visible quad is written
+ * to slot of the batch output; returns whether it was. */
+static int32 process_quad(QuadJobData* td, const TerrainNode* node, int32 idx, int32 slot) {
+  int32 local, quadX, quadY, gridX, gridY, nextGridX, nextGridY, levelOfDetail, cell;
+  real64 rotCenterX, rotCenterY, projectCenterX, screenRadius;
+  real64 projectCenterY, minScreenY, maxScreenY;
+  real32 height00, height10, height11, height01;
+  __m128 v_wX, v_wY, v_wZ, v_dX, v_dY, v_dZ;
+  __m128 v_cY, v_sY, v_cP, v_sP, v_rX, v_rY, v_zoom, v_hw, v_hh, v_oX, v_oY;
+  float oX[4], oY[4], worldX[4], worldY[4];
+  float screenX00, screenY00, screenX10, screenY10, screenX11, screenY11, screenX01, screenY01;
+  float mX1, mX2, boundMinX, pX1, pX2, boundMaxX, mY1, mY2, boundMinY, pY1, pY2, boundMaxY;
+  float cullTri1, cullTri2;
+  uint32 tileColor;
+  float averageHeight, light;
+  int32 isWater, isStitched = 0;
+  uint32 finalColor;
+  real32 rawHeight00, rawHeight10, rawHeight11, rawHeight01, rawAverageHeight, waterDepth;
+  TerrainStore* store = td->store;
+  const TerrainChunk* chunk;
+
+  local = idx - node->firstCmd;
+  quadX = node->quadX0 + (local % node->numX) * node->stepX;
+  quadY = node->quadY0 + (local / node->numX) * node->stepY;
+  levelOfDetail = 1 << node->level;
+  chunk = node->chunk;
+  gridX = quadX << node->level;
+  gridY = quadY << node->level;
+  nextGridX = gridX + levelOfDetail;
+  nextGridY = gridY + levelOfDetail;
+
+  if (nextGridX >= store->width) { nextGridX = store->width - 1; }
+  if (nextGridY >= store->height) { nextGridY = store->height - 1; }
+
+  /* Outer Box Frustum Cull Check */
+  rotCenterX = ((real64)gridX + (real64)levelOfDetail * 0.5 - (real64)td->cx) * (real64)td->cY - ((real64)gridY + (real64)levelOfDetail * 0.5 - (real64)td->cy) * (real64)td->sY;
+  rotCenterY = ((real64)gridX + (real64)levelOfDetail * 0.5 - (real64)td->cx) * (real64)td->sY + ((real64)gridY + (real64)levelOfDetail * 0.5 - (real64)td->cy) * (real64)td->cY;
+  projectCenterX = (real64)td->hw + rotCenterX * (real64)td->zm;
+  screenRadius = (real64)levelOfDetail * 1.5 * (real64)td->zm;
+
+  if (projectCenterX + screenRadius < td->clipRect.x1 || projectCenterX - screenRadius > td->clipRect.x2) {
+    return 0;
+  }
+
+  projectCenterY = (real64)td->hh + rotCenterY * (real64)td->sP * (real64)td->zm;
+  minScreenY = projectCenterY - screenRadius - ((real64)chunk->maxHeight - (real64)td->cz) * (real64)td->zm * (real64)td->cP;
+  maxScreenY = projectCenterY + screenRadius - ((real64)chunk->minHeight - (real64)td->cz) * (real64)td->zm * (real64)td->cP;
+
+  if (maxScreenY < td->clipRect.y1 || minScreenY > td->clipRect.y2) {
+    return 0;
+  }
+
+  /* Chunks carry the next row and column, so all four corners come from
+   * one chunk. Height array is pre-clamped, fetch instantly */
+  cell = (quadY & TERRAIN_CHUNK_MASK) * TERRAIN_CHUNK_STRIDE + (quadX & TERRAIN_CHUNK_MASK);
+  height00 = chunk->height[cell];
+  height10 = chunk->height[cell + 1];
+  height11 = chunk->height[cell + TERRAIN_CHUNK_STRIDE + 1];
+  height01 = chunk->height[cell + TERRAIN_CHUNK_STRIDE];
+  worldX[0] = worldX[3] = (float)gridX;
+  worldX[1] = worldX[2] = (float)nextGridX;
+  worldY[0] = worldY[1] = (float)gridY;
+  worldY[2] = worldY[3] = (float)nextGridY;
+  if (node->stitch[0] | node->stitch[1] | node->stitch[2] | node->stitch[3]) {
+    quadX &= TERRAIN_CHUNK_MASK;
+    quadY &= TERRAIN_CHUNK_MASK;
+    terrain_stitch_corner(store, node, quadX, quadY, &worldX[0], &worldY[0], &height00);
+    terrain_stitch_corner(store, node, quadX + 1, quadY, &worldX[1], &worldY[1], &height10);
+    terrain_stitch_corner(store, node, quadX + 1, quadY + 1, &worldX[2], &worldY[2], &height11);
+    terrain_stitch_corner(store, node, quadX, quadY + 1, &worldX[3], &worldY[3], &height01);
+    isStitched = height00 != chunk->height[cell] || height10 != chunk->height[cell + 1] ||
+                 height11 != chunk->height[cell + TERRAIN_CHUNK_STRIDE + 1] || height01 != chunk->height[cell + TERRAIN_CHUNK_STRIDE];
+  }
+
+  /* SSE2 SIMD transform projection replacing 4 function calls */
+  v_wX = _mm_set_ps(worldX[3], worldX[2], worldX[1], worldX[0]);
+  v_wY = _mm_set_ps(worldY[3], worldY[2], worldY[1], worldY[0]);
+  v_wZ = _mm_set_ps(height01, height11, height10, height00);
+
+  v_dX = _mm_sub_ps(v_wX, _mm_set1_ps(td->cx));
+  v_dY = _mm_sub_ps(v_wY, _mm_set1_ps(td->cy));
+  v_dZ = _mm_sub_ps(v_wZ, _mm_set1_ps(td->cz));
+
+  v_cY = _mm_set1_ps(td->cY); v_sY = _mm_set1_ps(td->sY);
+  v_cP = _mm_set1_ps(td->cP); v_sP = _mm_set1_ps(td->sP);
+
+  v_rX = _mm_sub_ps(_mm_mul_ps(v_dX, v_cY), _mm_mul_ps(v_dY, v_sY));
+  v_rY = _mm_add_ps(_mm_mul_ps(v_dX, v_sY), _mm_mul_ps(v_dY, v_cY));
+
+  v_zoom = _mm_set1_ps(td->zm); v_hw = _mm_set1_ps(td->hw); v_hh = _mm_set1_ps(td->hh);
+
+  v_oX = _mm_add_ps(v_hw, _mm_mul_ps(v_rX, v_zoom));
+  v_oY = _mm_add_ps(v_hh, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(v_rY, v_sP), _mm_mul_ps(v_dZ, v_cP)), v_zoom));
+
+  _mm_storeu_ps(oX, v_oX);
+  _mm_storeu_ps(oY, v_oY);
+
+  screenX00 = oX[0]; screenY00 = oY[0];
+  screenX10 = oX[1]; screenY10 = oY[1];
+  screenX11 = oX[2]; screenY11 = oY[2];
+  screenX01 = oX[3]; screenY01 = oY[3];
 
-    /* Height array is pre-clamped, fetch instantly */
-    height00 = REICH_HEIGHT_DATA[gridY * REICH_MAX_GRID_WIDTH + gridX];
-    height10 = REICH_HEIGHT_DATA[gridY * REICH_MAX_GRID_WIDTH + nextGridX];
-    height11 = REICH_HEIGHT_DATA[nextGridY * REICH_MAX_GRID_WIDTH + nextGridX];
-    height01 = REICH_HEIGHT_DATA[nextGridY * REICH_MAX_GRID_WIDTH + gridX];
+  /* Safe Min/Max checks (Branchless style mapping to minss/maxss natively) */
+  mX1 = screenX00 < screenX10 ? screenX00 : screenX10;
+  mX2 = screenX11 < screenX01 ? screenX11 : screenX01;
+  boundMinX = mX1 < mX2 ? mX1 : mX2;
 
-    /* SSE2 SIMD transform projection replacing 4 function calls */
-    v_wX = _mm_set_ps((float)gridX, (float)nextGridX, (float)nextGridX, (float)gridX);
-    v_wY = _mm_set_ps((float)nextGridY, (float)nextGridY, (float)gridY, (float)gridY);
-    v_wZ = _mm_set_ps(height01, height11, height10, height00);
+  pX1 = screenX00 > screenX10 ? screenX00 : screenX10;
+  pX2 = screenX11 > screenX01 ? screenX11 : screenX01;
+  boundMaxX = pX1 > pX2 ? pX1 : pX2;
 
-    v_dX = _mm_sub_ps(v_wX, _mm_set1_ps(td->cx));
-    v_dY = _mm_sub_ps(v_wY, _mm_set1_ps(td->cy));
-    v_dZ = _mm_sub_ps(v_wZ, _mm_set1_ps(td->cz));
+  mY1 = screenY00 < screenY10 ? screenY00 : screenY10;
+  mY2 = screenY11 < screenY01 ? screenY11 : screenY01;
+  boundMinY = mY1 < mY2 ? mY1 : mY2;
 
-    v_cY = _mm_set1_ps(td->cY); v_sY = _mm_set1_ps(td->sY);
-    v_cP = _mm_set1_ps(td->cP); v_sP = _mm_set1_ps(td->sP);
+  pY1 = screenY00 > screenY10 ? screenY00 : screenY10;
+  pY2 = screenY11 > screenY01 ? screenY11 : screenY01;
+  boundMaxY = pY1 > pY2 ? pY1 : pY2;
 
-    v_rX = _mm_sub_ps(_mm_mul_ps(v_dX, v_cY), _mm_mul_ps(v_dY, v_sY));
-    v_rY = _mm_add_ps(_mm_mul_ps(v_dX, v_sY), _mm_mul_ps(v_dY, v_cY));
+  if (boundMaxX < td->clipRect.x1 || boundMinX > td->clipRect.x2 || boundMaxY < td->clipRect.y1 || boundMinY > td->clipRect.y2) {
+    return 0;
+  }
+
+  cullTri1 = (screenX10 - screenX00) * (screenY11 - screenY00) - (screenY10 - screenY00) * (screenX11 - screenX00);
+  cullTri2 = (screenX11 - screenX00) * (screenY01 - screenY00) - (screenY11 - screenY00) * (screenX01 - screenX00);
+
+  tileColor = chunk->color[cell];
+
+  averageHeight = (height00 + height10 + height11 + height01) * 0.25f;
+  isWater = (averageHeight <= terrainParams.waterLevel + 0.1f);
+
+  /* Cached per cell, except where stitching bent the quad */
+  light = isStitched ? terrain_quad_light(store, td->baseLevel, gridX, gridY, levelOfDetail, height00, height10, height11, height01)
+                     : chunk->light[cell];
+  finalColor = reich_apply_lighting(tileColor, light, td->sunColor, td->ambientColor);
+
+  if (isWater) {
+    /* Read precomputed unclamped terrain bounds */
+    rawHeight00 = chunk->rawHeight[cell];
+    rawHeight10 = chunk->rawHeight[cell + 1];
+    rawHeight11 = chunk->rawHeight[cell + TERRAIN_CHUNK_STRIDE + 1];
+    rawHeight01 = chunk->rawHeight[cell + TERRAIN_CHUNK_STRIDE];
+    rawAverageHeight = (rawHeight00 + rawHeight10 + rawHeight11 + rawHeight01) * 0.25f;
+    waterDepth = terrainParams.waterLevel - rawAverageHeight;
+    if (waterDepth < 0.0f) waterDepth = 0.0f;
+    finalColor = reich_blend_water(finalColor, waterDepth, td->skyColor);
+  }
+
+  return quad_emit(td, slot, oX, oY, cullTri1, cullTri2, finalColor, gridX, gridY, nextGridX, nextGridY);
+}
+
+/* Loads four values, repeating the last valid one past the end of a row */
+static __m128 quad_load4(const void* src, int32 valid) {
+  uint32 tmp[4];
+  int32 i;
+  if (valid >= 4) { return _mm_loadu_ps((const float*)src); }
+  reich_memcpy(tmp, src, (reichSize)valid * sizeof(uint32));
+  for (i = valid; i < 4; i++) { tmp[i] = tmp[valid - 1]; }
+  return _mm_loadu_ps((const float*)tmp);
+}
+
+static __m128 quad_channel4(__m128i color, int32 shift) {
+  return _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(color, shift), _mm_set1_epi32(0xFF))), _mm_set1_ps(255.0f));
+}
+
+static __m128i quad_pack4(__m128 r, __m128 g, __m128 b) {
+  __m128 scale = _mm_set1_ps(255.0f);
+  return _mm_or_si128(_mm_set1_epi32((int)0xFF000000),
+      _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(r, scale)), 16),
+                                _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(g, scale)), 8)),
+                   _mm_cvttps_epi32(_mm_mul_ps(b, scale))));
+}
+
+/* reich_apply_lighting, four at a time with the same operations in the same
+ * order, so the result matches the scalar path bit for bit */
+static __m128i quad_light4(__m128i albedo, __m128 light, const float* sun, const float* amb) {
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+  __m128 r = _mm_mul_ps(quad_channel4(albedo, 16), _mm_add_ps(_mm_mul_ps(light, _mm_set1_ps(sun[0])), _mm_mul_ps(_mm_set1_ps(amb[0]), half)));
+  __m128 g = _mm_mul_ps(quad_channel4(albedo, 8), _mm_add_ps(_mm_mul_ps(light, _mm_set1_ps(sun[1])), _mm_mul_ps(_mm_set1_ps(amb[1]), half)));
+  __m128 b = _mm_mul_ps(quad_channel4(albedo, 0), _mm_add_ps(_mm_mul_ps(light, _mm_set1_ps(sun[2])), _mm_mul_ps(_mm_set1_ps(amb[2]), half)));
+  r = _mm_min_ps(_mm_max_ps(r, zero), one);
+  g = _mm_min_ps(_mm_max_ps(g, zero), one);
+  b = _mm_min_ps(_mm_max_ps(b, zero), one);
+  return quad_pack4(r, g, b);
+}
+
+/* reich_blend_water, four at a time */
+static __m128i quad_water4(__m128i land, __m128 depth, const float* sky) {
+  __m128 one = _mm_set1_ps(1.0f), keep = _mm_set1_ps(1.0f - 0.15f), mix = _mm_set1_ps(0.15f);
+  __m128 absorbR = _mm_div_ps(one, _mm_add_ps(one, _mm_mul_ps(depth, _mm_set1_ps(0.8f))));
+  __m128 absorbG = _mm_div_ps(one, _mm_add_ps(one, _mm_mul_ps(depth, _mm_set1_ps(0.3f))));
+  __m128 absorbB = _mm_div_ps(one, _mm_add_ps(one, _mm_mul_ps(depth, _mm_set1_ps(0.1f))));
+  __m128 r = _mm_add_ps(_mm_mul_ps(quad_channel4(land, 16), absorbR), _mm_mul_ps(_mm_set1_ps(0.01f), _mm_sub_ps(one, absorbR)));
+  __m128 g = _mm_add_ps(_mm_mul_ps(quad_channel4(land, 8), absorbG), _mm_mul_ps(_mm_set1_ps(0.05f), _mm_sub_ps(one, absorbG)));
+  __m128 b = _mm_add_ps(_mm_mul_ps(quad_channel4(land, 0), absorbB), _mm_mul_ps(_mm_set1_ps(0.12f), _mm_sub_ps(one, absorbB)));
+  r = _mm_min_ps(_mm_add_ps(_mm_mul_ps(r, keep), _mm_mul_ps(_mm_set1_ps(sky[0]), mix)), one);
+  g = _mm_min_ps(_mm_add_ps(_mm_mul_ps(g, keep), _mm_mul_ps(_mm_set1_ps(sky[1]), mix)), one);
+  b = _mm_min_ps(_mm_add_ps(_mm_mul_ps(b, keep), _mm_mul_ps(_mm_set1_ps(sky[2]), mix)), one);
+  return quad_pack4(r, g, b);
+}
+
+/* Points the run at the vertex rows above and below it, reusing whichever
+ * the previous run left behind. Returns 1 and 2 for the ones to project. */
+static int32 quad_run_rows(QuadRun* run, const TerrainNode* node, int32 quadX, int32 quadY, int32 count) {
+  QuadVertexRow* row;
+  int32 i, top = -1, bot = -1, need = 0;
+
+  for (i = 0; i < 2; i++) {
+    row = &run->rows[i];
+    if (row->node != node || row->quadX != quadX || row->count != count) { continue; }
+    if (row->vertexY == quadY) { top = i; }
+    if (row->vertexY == quadY + 1) { bot = i; }
+  }
+  if (top < 0) {
+    top = bot == 0 ? 1 : 0;
+    need |= 1;
+  }
+  if (bot < 0) {
+    bot = top ^ 1;
+    need |= 2;
+  }
+  run->top = &run->rows[top];
+  run->bot = &run->rows[bot];
+  for (i = 0; i < 2; i++) {
+    if (!(need & (1 << i))) { continue; }
+    row = i == 0 ? run->top : run->bot;
+    row->node = node;
+    row->quadX = quadX;
+    row->vertexY = quadY + i;
+    row->count = count;
+  }
+  return need;
+}
 
-    v_zoom = _mm_set1_ps(td->zm); v_hw = _mm_set1_ps(td->hw); v_hh = _mm_set1_ps(td->hh);
+static void quad_color_floats(uint32 color, float* rgb) {
+  rgb[0] = ((color >> 16) & 0xFF) / 255.0f;
+  rgb[1] = ((color >> 8) & 0xFF) / 255.0f;
+  rgb[2] = (color & 0xFF) / 255.0f;
+}
+
+/* Projects one row of vertices, keeping their heights for the quads on
+ * both sides of it, so a row sweep transforms every vertex once */
+static void quad_row_sse2(const QuadJobData* td, QuadVertexRow* row) {
+  const TerrainNode* node = row->node;
+  const TerrainStore* store = td->store;
+  int32 level = node->level, localY = row->vertexY - (node->chunk->chunkY << TERRAIN_CHUNK_SHIFT), k, n;
+  const real32* height = node->chunk->height + localY * TERRAIN_CHUNK_STRIDE + (row->quadX & TERRAIN_CHUNK_MASK);
+  __m128 cx = _mm_set1_ps(td->cx), cy = _mm_set1_ps(td->cy), cz = _mm_set1_ps(td->cz);
+  __m128 cY = _mm_set1_ps(td->cY), sY = _mm_set1_ps(td->sY), cP = _mm_set1_ps(td->cP), sP = _mm_set1_ps(td->sP);
+  __m128 zm = _mm_set1_ps(td->zm), hw = _mm_set1_ps(td->hw), hh = _mm_set1_ps(td->hh);
+  __m128 laneX = _mm_set_ps((float)(3 << level), (float)(2 << level), (float)(1 << level), 0.0f);
+  __m128 maxX = _mm_set1_ps((float)(store->width - 1));
+  __m128 dY = _mm_sub_ps(_mm_set1_ps((float)REICH_MIN(row->vertexY << level, store->height - 1)), cy);
+  __m128 dX, h, rX, rY;
+
+  for (k = 0; k <= row->count; k += 4) {
+    n = row->count + 1 - k;
+    dX = _mm_sub_ps(_mm_min_ps(_mm_add_ps(_mm_set1_ps((float)((row->quadX + k) << level)), laneX), maxX), cx);
+    h = quad_load4(height + k, n);
+    rX = _mm_sub_ps(_mm_mul_ps(dX, cY), _mm_mul_ps(dY, sY));
+    rY = _mm_add_ps(_mm_mul_ps(dX, sY), _mm_mul_ps(dY, cY));
+    _mm_storeu_ps(row->x + k, _mm_add_ps(hw, _mm_mul_ps(rX, zm)));
+    _mm_storeu_ps(row->y + k, _mm_add_ps(hh, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(rY, sP), _mm_mul_ps(_mm_sub_ps(h, cz), cP)), zm)));
+    _mm_storeu_ps(row->h + k, h);
+  }
+}
 
-    v_oX = _mm_add_ps(v_hw, _mm_mul_ps(v_rX, v_zoom));
-    v_oY = _mm_add_ps(v_hh, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(v_rY, v_sP), _mm_mul_ps(v_dZ, v_cP)), v_zoom));
+/* Culls and shades four quads of a run per step, projecting only the vertex
+ * rows the previous run did not leave behind. Matches process_quad exactly
+ * for quads off the stitched edges. */
+static void quad_run_sse2(
+    const QuadJobData* td, const TerrainNode* node, int32 quadX, int32 quadY, int32 count, QuadRun* run) {
+  const TerrainChunk* chunk = node->chunk;
+  const QuadVertexRow *top, *bot;
+  int32 cell, k, n, mask, i, need;
+  float sun[3], amb[3], sky[3];
+  __m128 clipX1 = _mm_set1_ps((float)td->clipRect.x1), clipX2 = _mm_set1_ps((float)td->clipRect.x2);
+  __m128 clipY1 = _mm_set1_ps((float)td->clipRect.y1), clipY2 = _mm_set1_ps((float)td->clipRect.y2);
+  __m128 waterLevel = _mm_set1_ps(terrainParams.waterLevel), quarter = _mm_set1_ps(0.25f);
+  __m128 waterTop = _mm_add_ps(waterLevel, _mm_set1_ps(0.1f));
+  __m128 x00, y00, x10, y10, x11, y11, x01, y01;
+  __m128 lo, hi, loY, hiY, vis, avg, water, raw, depth;
+  __m128i lit;
+
+  need = quad_run_rows(run, node, quadX, quadY, count);
+  if (need & 1) { quad_row_sse2(td, run->top); }
+  if (need & 2) { quad_row_sse2(td, run->bot); }
+  top = run->top;
+  bot = run->bot;
+  cell = (quadY & TERRAIN_CHUNK_MASK) * TERRAIN_CHUNK_STRIDE + (quadX & TERRAIN_CHUNK_MASK);
+  quad_color_floats(td->sunColor, sun);
+  quad_color_floats(td->ambientColor, amb);
+  quad_color_floats(td->skyColor, sky);
+
+  for (k = 0; k < count; k += 4) {
+    n = count - k;
+    x00 = _mm_loadu_ps(top->x + k); y00 = _mm_loadu_ps(top->y + k);
+    x10 = _mm_loadu_ps(top->x + k + 1); y10 = _mm_loadu_ps(top->y + k + 1);
+    x11 = _mm_loadu_ps(bot->x + k + 1); y11 = _mm_loadu_ps(bot->y + k + 1);
+    x01 = _mm_loadu_ps(bot->x + k); y01 = _mm_loadu_ps(bot->y + k);
+
+    lo = _mm_min_ps(_mm_min_ps(x00, x10), _mm_min_ps(x11, x01));
+    hi = _mm_max_ps(_mm_max_ps(x00, x10), _mm_max_ps(x11, x01));
+    loY = _mm_min_ps(_mm_min_ps(y00, y10), _mm_min_ps(y11, y01));
+    hiY = _mm_max_ps(_mm_max_ps(y00, y10), _mm_max_ps(y11, y01));
+    vis = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(hi, clipX1), _mm_cmple_ps(lo, clipX2)),
+        _mm_and_ps(_mm_cmpge_ps(hiY, clipY1), _mm_cmple_ps(loY, clipY2)));
+    mask = _mm_movemask_ps(vis);
+    for (i = 0; i < 4 && i < n; i++) { run->visible[k + i] = (uint8)((mask >> i) & 1); }
+    if (!mask) { continue; }
+
+    _mm_storeu_ps(run->cullTri1 + k, _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(x10, x00), _mm_sub_ps(y11, y00)),
+        _mm_mul_ps(_mm_sub_ps(y10, y00), _mm_sub_ps(x11, x00))));
+    _mm_storeu_ps(run->cullTri2 + k, _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(x11, x00), _mm_sub_ps(y01, y00)),
+        _mm_mul_ps(_mm_sub_ps(y11, y00), _mm_sub_ps(x01, x00))));
+
+    avg = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_loadu_ps(top->h + k), _mm_loadu_ps(top->h + k + 1)), _mm_loadu_ps(bot->h + k + 1)),
+        _mm_loadu_ps(bot->h + k));
+    avg = _mm_mul_ps(avg, quarter);
+    lit = quad_light4(_mm_castps_si128(quad_load4(chunk->color + cell + k, n)), quad_load4(chunk->light + cell + k, n), sun, amb);
+    water = _mm_cmple_ps(avg, waterTop);
+    if (_mm_movemask_ps(water)) {
+      raw = _mm_add_ps(_mm_add_ps(_mm_add_ps(quad_load4(chunk->rawHeight + cell + k, n), quad_load4(chunk->rawHeight + cell + k + 1, n)),
+          quad_load4(chunk->rawHeight + cell + TERRAIN_CHUNK_STRIDE + k + 1, n)), quad_load4(chunk->rawHeight + cell + TERRAIN_CHUNK_STRIDE + k, n));
+      depth = _mm_max_ps(_mm_sub_ps(waterLevel, _mm_mul_ps(raw, quarter)), _mm_setzero_ps());
+      lit = _mm_or_si128(_mm_and_si128(_mm_castps_si128(water), quad_water4(lit, depth, sky)),
+                         _mm_andnot_si128(_mm_castps_si128(water), lit));
+    }
+    _mm_storeu_si128((__m128i*)(run->color + k), lit);
+  }
+}
+
+#if defined(REICH_SIMD_X86)
+REICH_TARGET_AVX2 static __m256 quad_load8(const void* src, int32 valid) {
+  uint32 tmp[8];
+  int32 i;
+  if (valid >= 8) { return _mm256_loadu_ps((const float*)src); }
+  reich_memcpy(tmp, src, (reichSize)valid * sizeof(uint32));
+  for (i = valid; i < 8; i++) { tmp[i] = tmp[valid - 1]; }
+  return _mm256_loadu_ps((const float*)tmp);
+}
+
+REICH_TARGET_AVX2 static __m256 quad_channel8(__m256i color, int32 shift) {
+  return _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(color, shift), _mm256_set1_epi32(0xFF))), _mm256_set1_ps(255.0f));
+}
 
-    _mm_storeu_ps(oX, v_oX);
-    _mm_storeu_ps(oY, v_oY);
+REICH_TARGET_AVX2 static __m256i quad_pack8(__m256 r, __m256 g, __m256 b) {
+  __m256 scale = _mm256_set1_ps(255.0f);
+  return _mm256_or_si256(_mm256_set1_epi32((int)0xFF000000),
+      _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(r, scale)), 16),
+                                      _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(g, scale)), 8)),
+                      _mm256_cvttps_epi32(_mm256_mul_ps(b, scale))));
+}
 
-    screenX00 = oX[0]; screenY00 = oY[0];
-    screenX10 = oX[1]; screenY10 = oY[1];
-    screenX11 = oX[2]; screenY11 = oY[2];
-    screenX01 = oX[3]; screenY01 = oY[3];
+REICH_TARGET_AVX2 static __m256i quad_light8(__m256i albedo, __m256 light, const float* sun, const float* amb) {
+  __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+  __m256 r = _mm256_mul_ps(quad_channel8(albedo, 16), _mm256_add_ps(_mm256_mul_ps(light, _mm256_set1_ps(sun[0])), _mm256_mul_ps(_mm256_set1_ps(amb[0]), half)));
+  __m256 g = _mm256_mul_ps(quad_channel8(albedo, 8), _mm256_add_ps(_mm256_mul_ps(light, _mm256_set1_ps(sun[1])), _mm256_mul_ps(_mm256_set1_ps(amb[1]), half)));
+  __m256 b = _mm256_mul_ps(quad_channel8(albedo, 0), _mm256_add_ps(_mm256_mul_ps(light, _mm256_set1_ps(sun[2])), _mm256_mul_ps(_mm256_set1_ps(amb[2]), half)));
+  r = _mm256_min_ps(_mm256_max_ps(r, zero), one);
+  g = _mm256_min_ps(_mm256_max_ps(g, zero), one);
+  b = _mm256_min_ps(_mm256_max_ps(b, zero), one);
+  return quad_pack8(r, g, b);
+}
 
-    /* Safe Min/Max checks (Branchless style mapping to minss/maxss natively) */
-    mX1 = screenX00 < screenX10 ? screenX00 : screenX10;
-    mX2 = screenX11 < screenX01 ? screenX11 : screenX01;
-    boundMinX = mX1 < mX2 ? mX1 : mX2;
+REICH_TARGET_AVX2 static __m256i quad_water8(__m256i land, __m256 depth, const float* sky) {
+  __m256 one = _mm256_set1_ps(1.0f), keep = _mm256_set1_ps(1.0f - 0.15f), mix = _mm256_set1_ps(0.15f);
+  __m256 absorbR = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_mul_ps(depth, _mm256_set1_ps(0.8f))));
+  __m256 absorbG = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_mul_ps(depth, _mm256_set1_ps(0.3f))));
+  __m256 absorbB = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_mul_ps(depth, _mm256_set1_ps(0.1f))));
+  __m256 r = _mm256_add_ps(_mm256_mul_ps(quad_channel8(land, 16), absorbR), _mm256_mul_ps(_mm256_set1_ps(0.01f), _mm256_sub_ps(one, absorbR)));
+  __m256 g = _mm256_add_ps(_mm256_mul_ps(quad_channel8(land, 8), absorbG), _mm256_mul_ps(_mm256_set1_ps(0.05f), _mm256_sub_ps(one, absorbG)));
+  __m256 b = _mm256_add_ps(_mm256_mul_ps(quad_channel8(land, 0), absorbB), _mm256_mul_ps(_mm256_set1_ps(0.12f), _mm256_sub_ps(one, absorbB)));
+  r = _mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(r, keep), _mm256_mul_ps(_mm256_set1_ps(sky[0]), mix)), one);
+  g = _mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(g, keep), _mm256_mul_ps(_mm256_set1_ps(sky[1]), mix)), one);
+  b = _mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(b, keep), _mm256_mul_ps(_mm256_set1_ps(sky[2]), mix)), one);
+  return quad_pack8(r, g, b);
+}
 
-    pX1 = screenX00 > screenX10 ? screenX00 : screenX10;
-    pX2 = screenX11 > screenX01 ? screenX11 : screenX01;
-    boundMaxX = pX1 > pX2 ? pX1 : pX2;
+/* Projects one row of vertices, keeping their heights for the quads on
+ * both sides of it, so a row sweep transforms every vertex once */
+REICH_TARGET_AVX2 static void quad_row_avx2(const QuadJobData* td, QuadVertexRow* row) {
+  const TerrainNode* node = row->node;
+  const TerrainStore* store = td->store;
+  int32 level = node->level, localY = row->vertexY - (node->chunk->chunkY << TERRAIN_CHUNK_SHIFT), k, n;
+  const real32* height = node->chunk->height + localY * TERRAIN_CHUNK_STRIDE + (row->quadX & TERRAIN_CHUNK_MASK);
+  __m256 cx = _mm256_set1_ps(td->cx), cy = _mm256_set1_ps(td->cy), cz = _mm256_set1_ps(td->cz);
+  __m256 cY = _mm256_set1_ps(td->cY), sY = _mm256_set1_ps(td->sY), cP = _mm256_set1_ps(td->cP), sP = _mm256_set1_ps(td->sP);
+  __m256 zm = _mm256_set1_ps(td->zm), hw = _mm256_set1_ps(td->hw), hh = _mm256_set1_ps(td->hh);
+  __m256 laneX = _mm256_set_ps((float)(7 << level), (float)(6 << level), (float)(5 << level), (float)(4 << level),
+                              (float)(3 << level), (float)(2 << level), (float)(1 << level), 0.0f);
+  __m256 maxX = _mm256_set1_ps((float)(store->width - 1));
+  __m256 dY = _mm256_sub_ps(_mm256_set1_ps((float)REICH_MIN(row->vertexY << level, store->height - 1)), cy);
+  __m256 dX, h, rX, rY;
+
+  for (k = 0; k <= row->count; k += 8) {
+    n = row->count + 1 - k;
+    dX = _mm256_sub_ps(_mm256_min_ps(_mm256_add_ps(_mm256_set1_ps((float)((row->quadX + k) << level)), laneX), maxX), cx);
+    h = quad_load8(height + k, n);
+    rX = _mm256_sub_ps(_mm256_mul_ps(dX, cY), _mm256_mul_ps(dY, sY));
+    rY = _mm256_add_ps(_mm256_mul_ps(dX, sY), _mm256_mul_ps(dY, cY));
+    _mm256_storeu_ps(row->x + k, _mm256_add_ps(hw, _mm256_mul_ps(rX, zm)));
+    _mm256_storeu_ps(row->y + k, _mm256_add_ps(hh, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(rY, sP), _mm256_mul_ps(_mm256_sub_ps(h, cz), cP)), zm)));
+    _mm256_storeu_ps(row->h + k, h);
+  }
+}
 
-    mY1 = screenY00 < screenY10 ? screenY00 : screenY10;
-    mY2 = screenY11 < screenY01 ? screenY11 : screenY01;
-    boundMinY = mY1 < mY2 ? mY1 : mY2;
+/* The same run eight quads at a time, for CPUs with AVX2 */
+REICH_TARGET_AVX2 static void quad_run_avx2(
+    const QuadJobData* td, const TerrainNode* node, int32 quadX, int32 quadY, int32 count, QuadRun* run) {
+  const TerrainChunk* chunk = node->chunk;
+  const QuadVertexRow *top, *bot;
+  int32 cell, k, n, mask, i, need;
+  float sun[3], amb[3], sky[3];
+  __m256 clipX1 = _mm256_set1_ps((float)td->clipRect.x1), clipX2 = _mm256_set1_ps((float)td->clipRect.x2);
+  __m256 clipY1 = _mm256_set1_ps((float)td->clipRect.y1), clipY2 = _mm256_set1_ps((float)td->clipRect.y2);
+  __m256 waterLevel = _mm256_set1_ps(terrainParams.waterLevel), quarter = _mm256_set1_ps(0.25f);
+  __m256 waterTop = _mm256_add_ps(waterLevel, _mm256_set1_ps(0.1f));
+  __m256 x00, y00, x10, y10, x11, y11, x01, y01;
+  __m256 lo, hi, loY, hiY, vis, avg, water, raw, depth;
+  __m256i lit;
+
+  need = quad_run_rows(run, node, quadX, quadY, count);
+  if (need & 1) { quad_row_avx2(td, run->top); }
+  if (need & 2) { quad_row_avx2(td, run->bot); }
+  top = run->top;
+  bot = run->bot;
+  cell = (quadY & TERRAIN_CHUNK_MASK) * TERRAIN_CHUNK_STRIDE + (quadX & TERRAIN_CHUNK_MASK);
+  quad_color_floats(td->sunColor, sun);
+  quad_color_floats(td->ambientColor, amb);
+  quad_color_floats(td->skyColor, sky);
+
+  for (k = 0; k < count; k += 8) {
+    n = count - k;
+    x00 = _mm256_loadu_ps(top->x + k); y00 = _mm256_loadu_ps(top->y + k);
+    x10 = _mm256_loadu_ps(top->x + k + 1); y10 = _mm256_loadu_ps(top->y + k + 1);
+    x11 = _mm256_loadu_ps(bot->x + k + 1); y11 = _mm256_loadu_ps(bot->y + k + 1);
+    x01 = _mm256_loadu_ps(bot->x + k); y01 = _mm256_loadu_ps(bot->y + k);
+
+    lo = _mm256_min_ps(_mm256_min_ps(x00, x10), _mm256_min_ps(x11, x01));
+    hi = _mm256_max_ps(_mm256_max_ps(x00, x10), _mm256_max_ps(x11, x01));
+    loY = _mm256_min_ps(_mm256_min_ps(y00, y10), _mm256_min_ps(y11, y01));
+    hiY = _mm256_max_ps(_mm256_max_ps(y00, y10), _mm256_max_ps(y11, y01));
+    vis = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(hi, clipX1, _CMP_GE_OQ), _mm256_cmp_ps(lo, clipX2, _CMP_LE_OQ)),
+        _mm256_and_ps(_mm256_cmp_ps(hiY, clipY1, _CMP_GE_OQ), _mm256_cmp_ps(loY, clipY2, _CMP_LE_OQ)));
+    mask = _mm256_movemask_ps(vis);
+    for (i = 0; i < 8 && i < n; i++) { run->visible[k + i] = (uint8)((mask >> i) & 1); }
+    if (!mask) { continue; }
+
+    _mm256_storeu_ps(run->cullTri1 + k, _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(x10, x00), _mm256_sub_ps(y11, y00)),
+        _mm256_mul_ps(_mm256_sub_ps(y10, y00), _mm256_sub_ps(x11, x00))));
+    _mm256_storeu_ps(run->cullTri2 + k, _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(x11, x00), _mm256_sub_ps(y01, y00)),
+        _mm256_mul_ps(_mm256_sub_ps(y11, y00), _mm256_sub_ps(x01, x00))));
+
+    avg = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(top->h + k), _mm256_loadu_ps(top->h + k + 1)), _mm256_loadu_ps(bot->h + k + 1)),
+        _mm256_loadu_ps(bot->h + k));
+    avg = _mm256_mul_ps(avg, quarter);
+    lit = quad_light8(_mm256_castps_si256(quad_load8(chunk->color + cell + k, n)), quad_load8(chunk->light + cell + k, n), sun, amb);
+    water = _mm256_cmp_ps(avg, waterTop, _CMP_LE_OQ);
+    if (_mm256_movemask_ps(water)) {
+      raw = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(quad_load8(chunk->rawHeight + cell + k, n), quad_load8(chunk->rawHeight + cell + k + 1, n)),
+          quad_load8(chunk->rawHeight + cell + TERRAIN_CHUNK_STRIDE + k + 1, n)), quad_load8(chunk->rawHeight + cell + TERRAIN_CHUNK_STRIDE + k, n));
+      depth = _mm256_max_ps(_mm256_sub_ps(waterLevel, _mm256_mul_ps(raw, quarter)), _mm256_setzero_ps());
+      lit = _mm256_blendv_epi8(lit, quad_water8(lit, depth, sky), _mm256_castps_si256(water));
+    }
+    _mm256_storeu_si256((__m256i*)(run->color + k), lit);
+  }
+}
+#endif
+
+/* Runs one node row through the vector kernel and compacts what survives in
+ * painter's order. Quads on a stitched edge take the scalar path, which
+ * moves their corners onto the coarser neighbour. */
+static int32 process_quad_run(
+    QuadJobData* td, QuadRun* run, const TerrainNode* node, int32 idx, int32 count, int32 slot) {
+  const TerrainStore* store = td->store;
+  int32 local = idx - node->firstCmd, first = slot, level = node->level, j, k, localX;
+  int32 quadY = node->quadY0 + (local / node->numX) * node->stepY;
+  int32 quadX = node->quadX0 + (local % node->numX) * node->stepX;
+  int32 gridX, gridY, nextGridX, nextGridY, localY = quadY & TERRAIN_CHUNK_MASK;
+  float sx[4], sy[4];
+
+  if ((node->stitch[2] && localY == node->localY0) || (node->stitch[3] && localY == node->localY0 + TERRAIN_BLOCK_SIZE - 1)) {
+    for (j = 0; j < count; j++) { slot += process_quad(td, node, idx + j, slot); }
+    return slot - first;
+  }
 
-    pY1 = screenY00 > screenY10 ? screenY00 : screenY10;
-    pY2 = screenY11 > screenY01 ? screenY11 : screenY01;
-    boundMaxY = pY1 > pY2 ? pY1 : pY2;
+  if (node->stepX < 0) { quadX -= count - 1; }
+  td->runKernel(td, node, quadX, quadY, count, run);
 
-    if (boundMaxX < td->clipRect.x1 || boundMinX > td->clipRect.x2 || boundMaxY < td->clipRect.y1 || boundMinY > td->clipRect.y2) {
-      cmd->visible = 0;
+  gridY = quadY << level;
+  nextGridY = REICH_MIN(gridY + (1 << level), store->height - 1);
+  for (j = 0; j < count; j++, idx++) {
+    k = node->stepX > 0 ? j : count - 1 - j;
+    localX = (quadX + k) & TERRAIN_CHUNK_MASK;
+    if ((node->stitch[0] && localX == node->localX0) || (node->stitch[1] && localX == node->localX0 + TERRAIN_BLOCK_SIZE - 1)) {
+      slot += process_quad(td, node, idx, slot);
       continue;
     }
+    if (!run->visible[k]) { continue; }
+    gridX = (quadX + k) << level;
+    nextGridX = REICH_MIN(gridX + (1 << level), store->width - 1);
+    sx[0] = run->top->x[k]; sy[0] = run->top->y[k];
+    sx[1] = run->top->x[k + 1]; sy[1] = run->top->y[k + 1];
+    sx[2] = run->bot->x[k + 1]; sy[2] = run->bot->y[k + 1];
+    sx[3] = run->bot->x[k]; sy[3] = run->bot->y[k];
+    slot += quad_emit(td, slot, sx, sy, run->cullTri1[k], run->cullTri2[k], run->color[k], gridX, gridY, nextGridX, nextGridY);
+  }
+  return slot - first;
+}
+
+/* Each batch compacts its visible quads to the front of its own run of the
+ * output, so threads never write next to each other and order is kept. */
+static void process_quads_job(void* data, int32 startBatch, int32 endBatch, int32 thread) {
+  QuadJobData* td = (QuadJobData*)data;
+  const TerrainNode* node = td->nodes;
+  int32 batch, first, last, idx, count, slot, lo = 0, hi = td->numNodes - 1, mid;
+  QuadRun run;
+
+  /* Last node starting at or before this range */
+  first = startBatch * QUAD_BATCH_SIZE;
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (td->nodes[mid].firstCmd <= first) { lo = mid; } else { hi = mid - 1; }
+  }
+  node += lo;
+  run.rows[0].node = run.rows[1].node = NULL;
+
+  reich_prof_begin_thread(thread, "quads");
+  for (batch = startBatch; batch < endBatch; batch++) {
+    first = batch * QUAD_BATCH_SIZE;
+    last = REICH_MIN(first + QUAD_BATCH_SIZE, td->numQuads);
+    slot = first;
+    for (idx = first; idx < last; idx += count) {
+      while (idx >= node->firstCmd + node->numX * node->numY) { node++; }
+      count = REICH_MIN(node->numX - (idx - node->firstCmd) % node->numX, last - idx);
+      slot += process_quad_run(td, &run, node, idx, count, slot);
+    }
+    td->batchCounts[batch] = slot - first;
+  }
+  reich_prof_end_thread(thread);
+}
+
+static void set_tex_vertex(reichTexVertex* v, float x, float y, float u, float t) {
+  v->x = x;
+  v->y = y;
+  v->w = 1.0f; /* Orthographic camera, mapping is affine */
+  v->u = u;
+  v->v = t;
+}
 
-    cullTri1 = (screenX10 - screenX00) * (screenY11 - screenY00) - (screenY10 - screenY00) * (screenX11 - screenX00);
-    cullTri2 = (screenX11 - screenX00) * (screenY01 - screenY00) - (screenY11 - screenY00) * (screenX01 - screenX00);
+static void draw_quad_cmd(reichContext* ctx, const QuadDrawList* q, int32 i, int32 drawBounds) {
+  reichTexVertex v00, v10, v11, v01;
+  if (q->isTextured) {
+    set_tex_vertex(&v00, q->x00[i], q->y00[i], 0.0f, 0.0f);
+    set_tex_vertex(&v10, q->x10[i], q->y10[i], 1.0f, 0.0f);
+    set_tex_vertex(&v11, q->x11[i], q->y11[i], 1.0f, 1.0f);
+    set_tex_vertex(&v01, q->x01[i], q->y01[i], 0.0f, 1.0f);
+    if (q->cullTri1[i] > 0.0f) {
+      reich_draw_triangle_tex(ctx, &tileTexture, &v00, &v10, &v11, q->quadColor[i] | 0xFF000000, tileTextureFlags);
+    }
+    if (q->cullTri2[i] > 0.0f) {
+      reich_draw_triangle_tex(ctx, &tileTexture, &v00, &v11, &v01, q->quadColor[i] | 0xFF000000, tileTextureFlags);
+    }
+  } else {
+    reich_draw_quad_fill(ctx, q->x00[i], q->y00[i], q->x10[i], q->y10[i], q->x11[i], q->y11[i], q->x01[i], q->y01[i], q->quadColor[i]);
+  }
 
-    if (cullTri1 > 0.0f && reich_point_in_tri(td->mouseX, td->mouseY, screenX00, screenY00, screenX10, screenY10, screenX11, screenY11)) {
-      td->threadHoverX = gridX;
-      td->threadHoverY = gridY;
+  if (drawBounds) {
+    if (q->cullTri1[i] > 0.0f) {
+      reich_draw_line(ctx, q->x00[i], q->y00[i], q->x10[i], q->y10[i], 0x44000000);
+      reich_draw_line(ctx, q->x10[i], q->y10[i], q->x11[i], q->y11[i], 0x44000000);
     }
-    if (cullTri2 > 0.0f && reich_point_in_tri(td->mouseX, td->mouseY, screenX00, screenY00, screenX11, screenY11, screenX01, screenY01)) {
-      td->threadHoverX = gridX;
-      td->threadHoverY = gridY;
+    if (q->cullTri2[i] > 0.0f) {
+      reich_draw_line(ctx, q->x11[i], q->y11[i], q->x01[i], q->y01[i], 0x44000000);
+      reich_draw_line(ctx, q->x01[i], q->y01[i], q->x00[i], q->y00[i], 0x44000000);
     }
+  }
+}
 
-    tileColor = td->grid[gridY * REICH_MAX_GRID_WIDTH + gridX];
+/* Tile range touched by a command. Bounds are padded by a pixel to cover
+ * the rounding in the line rasterizer. */
+static int32 quad_cmd_tiles(
+    const QuadDrawList* q, int32 i, reichRect clipRect, int32 tilesX, int32 tilesY,
+    int32* tx0, int32* ty0, int32* tx1, int32* ty1) {
+  float minX = REICH_MIN(REICH_MIN(q->x00[i], q->x10[i]), REICH_MIN(q->x11[i], q->x01[i]));
+  float maxX = REICH_MAX(REICH_MAX(q->x00[i], q->x10[i]), REICH_MAX(q->x11[i], q->x01[i]));
+  float minY = REICH_MIN(REICH_MIN(q->y00[i], q->y10[i]), REICH_MIN(q->y11[i], q->y01[i]));
+  float maxY = REICH_MAX(REICH_MAX(q->y00[i], q->y10[i]), REICH_MAX(q->y11[i], q->y01[i]));
+  float x0 = minX - (float)clipRect.x1 - 1.0f;
+  float y0 = minY - (float)clipRect.y1 - 1.0f;
+  float x1 = maxX - (float)clipRect.x1 + 2.0f;
+  float y1 = maxY - (float)clipRect.y1 + 2.0f;
+  float limitX = (float)(tilesX * RASTER_TILE_SIZE);
+  float limitY = (float)(tilesY * RASTER_TILE_SIZE);
+  if (x1 < 0.0f || y1 < 0.0f || x0 >= limitX || y0 >= limitY) { return 0; }
+  *tx0 = x0 < 0.0f ? 0 : (int32)x0 / RASTER_TILE_SIZE;
+  *ty0 = y0 < 0.0f ? 0 : (int32)y0 / RASTER_TILE_SIZE;
+  *tx1 = x1 >= limitX ? tilesX - 1 : (int32)x1 / RASTER_TILE_SIZE;
+  *ty1 = y1 >= limitY ? tilesY - 1 : (int32)y1 / RASTER_TILE_SIZE;
+  return 1;
+}
 
-    if (td->selBoxMinX != -1 && td->selBoxMaxX != -1) { /* isSelectingBox */
-      if (!(nextGridX < td->selBoxMinX || gridX > td->selBoxMaxX || nextGridY < td->selBoxMinY || gridY > td->selBoxMaxY)) {
-        isSelectedQuad = 1;
-      }
-    } else if (selectionMinX != -1) {
-      if (!(nextGridX < selectionMinX || gridX > selectionMaxX || nextGridY < selectionMinY || gridY > selectionMaxY)) {
-        isSelectedQuad = 2;
-      }
+static void raster_tiles_job(void* data, int32 startTile, int32 endTile, int32 thread) {
+  RasterJobData* rd = (RasterJobData*)data;
+  reichContext* tileCtx = &rd->threadCtx[thread];
+  int32 tile, i;
+
+  reich_prof_begin_thread(thread, "tiles");
+  for (tile = startTile; tile < endTile; tile++) {
+    tileCtx->clip.x1 = rd->clipRect.x1 + (tile % rd->tilesX) * RASTER_TILE_SIZE;
+    tileCtx->clip.y1 = rd->clipRect.y1 + (tile / rd->tilesX) * RASTER_TILE_SIZE;
+    tileCtx->clip.x2 = REICH_MIN(tileCtx->clip.x1 + RASTER_TILE_SIZE, rd->clipRect.x2);
+    tileCtx->clip.y2 = REICH_MIN(tileCtx->clip.y1 + RASTER_TILE_SIZE, rd->clipRect.y2);
+
+    /* Bins hold command indices in submission order, so each tile sees
+     * exactly the painter's order of the sequential path. */
+    for (i = rd->binStart[tile]; i < rd->binStart[tile + 1]; i++) {
+      draw_quad_cmd(tileCtx, rd->quads, rd->binItems[i], rd->drawBounds);
     }
+  }
+  reich_prof_end_thread(thread);
+}
 
-    normalXUnnormalized = (height00 + height01) - (height10 + height11);
-    normalYUnnormalized = (height00 + height10) - (height11 + height01);
-    normalZUnnormalized = 2.0f * (float)td->levelOfDetail;
-    normalLength = (float)reich_sqrt((double)(normalXUnnormalized * normalXUnnormalized + normalYUnnormalized * normalYUnnormalized + normalZUnnormalized * normalZUnnormalized));
-    normalX = normalXUnnormalized / normalLength;
-    normalY = normalYUnnormalized / normalLength;
-    normalZ = normalZUnnormalized / normalLength;
-
-    averageHeight = (height00 + height10 + height11 + height01) * 0.25f;
-    isWater = (averageHeight <= WATER_LVL + 0.1f);
-
-    shadowFactor = cast_shadow_fast(
-        (float)gridX + td->levelOfDetail * 0.5f,
-        (float)gridY + td->levelOfDetail * 0.5f,
-        averageHeight + 0.1f,
-        td->lightDirX, td->lightDirY, td->lightDirZ,
-        td->levelOfDetail);
-
-    normalDotLight = normalX * td->lightDirX + normalY * td->lightDirY + normalZ * td->lightDirZ;
-    if (normalDotLight < 0.0f) normalDotLight = 0.0f;
-
-    finalColor = reich_apply_lighting(tileColor, normalDotLight * shadowFactor, td->sunColor, td->ambientColor);
-
-    if (isWater) {
-      /* Read precomputed unclamped terrain bounds */
-      rawHeight00 = REICH_RAW_HEIGHT_DATA[gridY * REICH_MAX_GRID_WIDTH + gridX];
-      rawHeight10 = REICH_RAW_HEIGHT_DATA[gridY * REICH_MAX_GRID_WIDTH + nextGridX];
-      rawHeight11 = REICH_RAW_HEIGHT_DATA[nextGridY * REICH_MAX_GRID_WIDTH + nextGridX];
-      rawHeight01 = REICH_RAW_HEIGHT_DATA[nextGridY * REICH_MAX_GRID_WIDTH + gridX];
-      rawAverageHeight = (rawHeight00 + rawHeight10 + rawHeight11 + rawHeight01) * 0.25f;
-      waterDepth = WATER_LVL - rawAverageHeight;
-      if (waterDepth < 0.0f) waterDepth = 0.0f;
-      finalColor = reich_blend_water(finalColor, waterDepth, td->skyColor);
-    }
-
-    quadColor = (isSelectedQuad == 2)
-        ? 0xFFFFFFFF
-        : (isSelectedQuad == 1 ? reich_lerp_col(finalColor, 0xFFFFFFFF, 0.4f)
-                     : ((td->threadHoverX != -1 && td->threadHoverX >= gridX && td->threadHoverX < nextGridX && td->threadHoverY >= gridY && td->threadHoverY < nextGridY)
-                            ? reich_lerp_col(finalColor, 0xFFFFFF00, 0.5f)
-                            : finalColor));
-
-    cmd->visible = 1;
-    cmd->x00 = screenX00; cmd->y00 = screenY00;
-    cmd->x10 = screenX10; cmd->y10 = screenY10;
-    cmd->x11 = screenX11; cmd->y11 = screenY11;
-    cmd->x01 = screenX01; cmd->y01 = screenY01;
-    cmd->cullTri1 = cullTri1;
-    cmd->cullTri2 = cullTri2;
-    cmd->quadColor = quadColor;
-    cmd->isTextured = (td->levelOfDetail == 1 && td->zm >= 8.0f);
+static void raster_tiles(
+    reichContext* ctx, reichRect clipRect, const QuadDrawList* quads, int32 drawBounds) {
+  int32 tilesX, tilesY, numTiles, idx, t, tx, ty, tx0, ty0, tx1, ty1, total;
+  int32 numThreads = reich_jobs_thread_count();
+  int32 *binStart, *binCursor, *binItems;
+  RasterJobData rd;
+
+  tilesX = (clipRect.x2 - clipRect.x1 + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  tilesY = (clipRect.y2 - clipRect.y1 + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  numTiles = tilesX * tilesY;
+  if (numTiles <= 0) { return; }
+
+  binStart = (int32*)reich_arena_alloc(&ctx->frameMem, (numTiles + 1) * sizeof(int32));
+  binCursor = (int32*)reich_arena_alloc(&ctx->frameMem, numTiles * sizeof(int32));
+  rd.threadCtx = (reichContext*)reich_arena_alloc(&ctx->frameMem, numThreads * sizeof(reichContext));
+  if (!binStart || !binCursor || !rd.threadCtx) { return; }
+  reich_memset(binStart, 0, (numTiles + 1) * sizeof(int32));
+
+  /* Count, prefix-sum, then scatter command indices into their tiles */
+  for (idx = 0; idx < quads->count; idx++) {
+    if (!quad_cmd_tiles(quads, idx, clipRect, tilesX, tilesY, &tx0, &ty0, &tx1, &ty1)) { continue; }
+    for (ty = ty0; ty <= ty1; ty++) {
+      for (tx = tx0; tx <= tx1; tx++) { binStart[ty * tilesX + tx + 1]++; }
+    }
+  }
+  for (t = 0; t < numTiles; t++) {
+    binStart[t + 1] += binStart[t];
+    binCursor[t] = binStart[t];
+  }
+  total = binStart[numTiles];
+  if (total <= 0) { return; }
+  binItems = (int32*)reich_arena_alloc(&ctx->frameMem, total * sizeof(int32));
+  if (!binItems) { return; }
+  for (idx = 0; idx < quads->count; idx++) {
+    if (!quad_cmd_tiles(quads, idx, clipRect, tilesX, tilesY, &tx0, &ty0, &tx1, &ty1)) { continue; }
+    for (ty = ty0; ty <= ty1; ty++) {
+      for (tx = tx0; tx <= tx1; tx++) { binItems[binCursor[ty * tilesX + tx]++] = idx; }
+    }
+  }
+
+  for (t = 0; t < numThreads; t++) { reich_context_fork(&rd.threadCtx[t], ctx); }
+  rd.clipRect = clipRect;
+  rd.quads = quads;
+  rd.binStart = binStart;
+  rd.binItems = binItems;
+  rd.tilesX = tilesX;
+  rd.drawBounds = drawBounds;
+  reich_jobs_parallel_for(numTiles, 1, raster_tiles_job, &rd);
+
+  for (t = 0; t < numThreads; t++) { reich_context_join(ctx, &rd.threadCtx[t]); }
+}
+
+/* Carves the arrays for count quads out of one arena block */
+static int32 quad_list_alloc(reichArena* arena, QuadDrawList* q, int32 count) {
+  float* f = (float*)reich_arena_alloc(arena, (reichSize)count * 11 * sizeof(float));
+  if (!f) { return FALSE; }
+  q->x00 = f; q->y00 = f + count;
+  q->x10 = f + count * 2; q->y10 = f + count * 3;
+  q->x11 = f + count * 4; q->y11 = f + count * 5;
+  q->x01 = f + count * 6; q->y01 = f + count * 7;
+  q->cullTri1 = f + count * 8;
+  q->cullTri2 = f + count * 9;
+  q->quadColor = (uint32*)(f + count * 10);
+  return TRUE;
+}
+
+/* Moves each batch's run of visible quads to its prefix-sum offset */
+static void quad_merge_job(void* data, int32 startBatch, int32 endBatch, int32 thread) {
+  QuadMergeJob* mj = (QuadMergeJob*)data;
+  const QuadDrawList* src = mj->src;
+  QuadDrawList* dst = mj->dst;
+  int32 batch, from, to;
+  reichSize bytes;
+  (void)thread;
+
+  for (batch = startBatch; batch < endBatch; batch++) {
+    from = batch * QUAD_BATCH_SIZE;
+    to = mj->batchStarts[batch];
+    bytes = (reichSize)mj->batchCounts[batch] * sizeof(float);
+    reich_memcpy(dst->x00 + to, src->x00 + from, bytes);
+    reich_memcpy(dst->y00 + to, src->y00 + from, bytes);
+    reich_memcpy(dst->x10 + to, src->x10 + from, bytes);
+    reich_memcpy(dst->y10 + to, src->y10 + from, bytes);
+    reich_memcpy(dst->x11 + to, src->x11 + from, bytes);
+    reich_memcpy(dst->y11 + to, src->y11 + from, bytes);
+    reich_memcpy(dst->x01 + to, src->x01 + from, bytes);
+    reich_memcpy(dst->y01 + to, src->y01 + from, bytes);
+    reich_memcpy(dst->cullTri1 + to, src->cullTri1 + from, bytes);
+    reich_memcpy(dst->cullTri2 + to, src->cullTri2 + from, bytes);
+    reich_memcpy(dst->quadColor + to, src->quadColor + from, bytes);
   }
-  return 0;
 }
 
 int32 draw_world(
@@ -453,19 +1956,19 @@ int32 draw_world(
     real32 lightDirY,
     real32 lightDirZ) {
 
-  int32 k, levelOfDetail = 1, drawBounds, startGridX, endGridX, startGridY, endGridY;
+  int32 k, levelOfDetail = 1, level = 0, drawBounds, startGridX, endGridX, startGridY, endGridY;
   int32 selBoxMinX = -1, selBoxMaxX = -1, selBoxMinY = -1, selBoxMaxY = -1;
-  uint32 *grid = (uint32*)data;
+  TerrainStore* store = (TerrainStore*)data;
   reichRect originalClip;
 
   real64 mouseX, mouseY, minWorldX = 1e9, maxWorldX = -1e9, minWorldY = 1e9, maxWorldY = -1e9;
   real64 worldX, worldY, cosYaw, sinYaw, cosPitch, sinPitch;
   
-  int32 gStart_Y, gStep_Y, numY, gStart_X, gStep_X, numX, totalQuads, idx, t;
-  QuadDrawCmd* quadCmds;
-  ThreadData tData[NUM_THREADS];
-  HANDLE hThreads[NUM_THREADS];
-  int32 itemsPerThread, remainder, startIdx = 0;
+  int32 totalQuads, numBatches, idx, t;
+  int32* batchStarts;
+  QuadDrawList batches, quads;
+  QuadJobData jd;
+  QuadMergeJob mj;
 
   mouseX = (real64)reich_mouse_x(ctx);
   mouseY = (real64)reich_mouse_y(ctx);
@@ -475,6 +1978,7 @@ int32 draw_world(
   if (mainCamera.zoom < 1.0) { levelOfDetail = 8; }
   if (mainCamera.zoom < 0.5) { levelOfDetail = 16; }
   if (mainCamera.zoom < 0.25) { levelOfDetail = 32; }
+  while ((1 << level) < levelOfDetail) { level++; }
 
   drawBounds = mainCamera.zoom >= 15.0;
   originalClip = ctx->clip;
@@ -499,8 +2003,8 @@ int32 draw_world(
 
   if (startGridX < 0) { startGridX = 0; }
   if (startGridY < 0) { startGridY = 0; }
-  if (endGridX > REICH_MAX_GRID_WIDTH) { endGridX = REICH_MAX_GRID_WIDTH; }
-  if (endGridY > REICH_MAX_GRID_HEIGHT) { endGridY = REICH_MAX_GRID_HEIGHT; }
+  if (endGridX > store->width) { endGridX = store->width; }
+  if (endGridY > store->height) { endGridY = store->height; }
 
   startGridX = (startGridX / levelOfDetail) * levelOfDetail;
   startGridY = (startGridY / levelOfDetail) * levelOfDetail;
@@ -519,15 +2023,54 @@ int32 draw_world(
   cosPitch = reich_cos((float)mainCamera.pitch);
   sinPitch = reich_sin((float)mainCamera.pitch);
 
-  gStart_Y = (cosYaw > 0 ? startGridY : endGridY - levelOfDetail);
-  gStep_Y  = (cosYaw > 0 ? levelOfDetail : -levelOfDetail);
-  numY     = REICH_ABS(endGridY - startGridY) / levelOfDetail;
-
-  gStart_X = (sinYaw > 0 ? startGridX : endGridX - levelOfDetail);
-  gStep_X  = (sinYaw > 0 ? levelOfDetail : -levelOfDetail);
-  numX     = REICH_ABS(endGridX - startGridX) / levelOfDetail;
+  jd.selBoxMinX = selBoxMinX;
+  jd.selBoxMaxX = selBoxMaxX;
+  jd.selBoxMinY = selBoxMinY;
+  jd.selBoxMaxY = selBoxMaxY;
+  jd.hw = (float)ctx->canvas.width * 0.5f;
+  jd.hh = (float)ctx->canvas.height * 0.5f;
+  jd.cx = (float)mainCamera.x;
+  jd.cy = (float)mainCamera.y;
+  jd.cz = (float)mainCamera.z;
+  jd.zm = (float)mainCamera.zoom;
+  jd.cY = (float)cosYaw;
+  jd.sY = (float)sinYaw;
+  jd.cP = (float)cosPitch;
+  jd.sP = (float)sinPitch;
+  jd.lightDirX = lightDirX;
+  jd.lightDirY = lightDirY;
+  jd.lightDirZ = lightDirZ;
+  jd.sunColor = sunColor;
+  jd.ambientColor = ambientColor;
+  jd.skyColor = skyColor;
+  jd.store = store;
+  jd.clipRect = clipRect;
+
+  /* -- PHASE 0: Pick quadtree leaves, streaming in the chunks they need -- */
+  reich_prof_begin("terrain");
+  jd.baseLevel = level;
+  terrain_select(ctx, store, &jd, startGridX, startGridY, endGridX, endGridY);
+  reich_prof_end();
+
+  reich_prof_begin("lighting");
+  terrain_relight(ctx, store, &jd);
+  reich_prof_end();
+
+  /* Hovered cell from one ray through the cursor, so the quads below only
+   * compare their cell against it */
+  jd.hoverX = jd.hoverY = -1;
+  if (mouseX >= clipRect.x1 && mouseX < clipRect.x2 && mouseY >= clipRect.y1 && mouseY < clipRect.y2) {
+    terrain_pick(ctx, &mainCamera, store, level, mouseX, mouseY, &jd.hoverX, &jd.hoverY);
+  }
+  nextHoverGridX = jd.hoverX;
+  nextHoverGridY = jd.hoverY;
 
-  totalQuads = numX * numY;
+  totalQuads = 0;
+  if (jd.numNodes > 0) {
+    totalQuads = jd.nodes[jd.numNodes - 1].firstCmd + jd.nodes[jd.numNodes - 1].numX * jd.nodes[jd.numNodes - 1].numY;
+  }
+  store->frameNodes = jd.numNodes;
+  store->frameQuads = totalQuads;
   if (totalQuads <= 0) {
       ctx->clip = originalClip;
       reich_draw_rect(ctx, (float)clipRect.x1, (float)clipRect.y1, (float)(clipRect.x2 - clipRect.x1), (float)(clipRect.y2 - clipRect.y1), 0xFF00FF00);
@@ -535,93 +2078,53 @@ int32 draw_world(
   }
 
   /* Safe frame allocation utilizing engine bounds memory constraints */
-  quadCmds = (QuadDrawCmd*)reich_arena_alloc(&ctx->frameMem, totalQuads * sizeof(QuadDrawCmd));
-  if (!quadCmds) {
+  numBatches = (totalQuads + QUAD_BATCH_SIZE - 1) / QUAD_BATCH_SIZE;
+  jd.batchCounts = (int32*)reich_arena_alloc(&ctx->frameMem, numBatches * sizeof(int32));
+  batchStarts = (int32*)reich_arena_alloc(&ctx->frameMem, numBatches * sizeof(int32));
+  if (!jd.batchCounts || !batchStarts || !quad_list_alloc(&ctx->frameMem, &batches, totalQuads)) {
       ctx->clip = originalClip;
       return TRUE;
   }
 
-  itemsPerThread = totalQuads / NUM_THREADS;
-  remainder = totalQuads % NUM_THREADS;
-
-  /* -- PHASE 1: Process vertices, math & lighting via native Win32 Threads & SSE2 -- */
-  for (t = 0; t < NUM_THREADS; t++) {
-    tData[t].startIdx = startIdx;
-    tData[t].endIdx = startIdx + itemsPerThread + (t < remainder ? 1 : 0);
-    startIdx = tData[t].endIdx;
-
-    tData[t].numX = numX;
-    tData[t].gStart_Y = gStart_Y;
-    tData[t].gStep_Y = gStep_Y;
-    tData[t].gStart_X = gStart_X;
-    tData[t].gStep_X = gStep_X;
-    tData[t].levelOfDetail = levelOfDetail;
-    tData[t].selBoxMinX = selBoxMinX;
-    tData[t].selBoxMaxX = selBoxMaxX;
-    tData[t].selBoxMinY = selBoxMinY;
-    tData[t].selBoxMaxY = selBoxMaxY;
-    tData[t].hw = (float)ctx->canvas.width * 0.5f;
-    tData[t].hh = (float)ctx->canvas.height * 0.5f;
-    tData[t].cx = (float)mainCamera.x;
-    tData[t].cy = (float)mainCamera.y;
-    tData[t].cz = (float)mainCamera.z;
-    tData[t].zm = (float)mainCamera.zoom;
-    tData[t].cY = (float)cosYaw;
-    tData[t].sY = (float)sinYaw;
-    tData[t].cP = (float)cosPitch;
-    tData[t].sP = (float)sinPitch;
-    tData[t].lightDirX = lightDirX;
-    tData[t].lightDirY = lightDirY;
-    tData[t].lightDirZ = lightDirZ;
-    tData[t].sunColor = sunColor;
-    tData[t].ambientColor = ambientColor;
-    tData[t].skyColor = skyColor;
-    tData[t].grid = grid;
-    tData[t].clipRect = clipRect;
-    tData[t].mouseX = mouseX;
-    tData[t].mouseY = mouseY;
-    tData[t].cmds = quadCmds;
-
-    hThreads[t] = CreateThread(NULL, 0, process_quads_thread, &tData[t], 0, NULL);
-  }
-
-  WaitForMultipleObjects(NUM_THREADS, hThreads, TRUE, INFINITE);
-
-  for (t = 0; t < NUM_THREADS; t++) {
-    CloseHandle(hThreads[t]);
-    if (tData[t].threadHoverX != -1) {
-      nextHoverGridX = tData[t].threadHoverX;
-      nextHoverGridY = tData[t].threadHoverY;
-    }
-  }
-
-  /* -- PHASE 2: Standard Sequential drawing guarantees pure painter's algorithm behavior -- */
-  for (idx = 0; idx < totalQuads; idx++) {
-      QuadDrawCmd* c = &quadCmds[idx];
-      if (!c->visible) continue;
-
-      if (c->isTextured) {
-          if (c->cullTri1 > 0.0f) {
-              reich_draw_triangle_textured(ctx, c->x00, c->y00, 0.0f, 0.0f, c->x10, c->y10, 1.0f, 0.0f, c->x11, c->y11, 1.0f, 1.0f, TILE_TEXTURE, TILE_TEX_WIDTH, TILE_TEX_HEIGHT, c->quadColor);
-          }
-          if (c->cullTri2 > 0.0f) {
-              reich_draw_triangle_textured(ctx, c->x00, c->y00, 0.0f, 0.0f, c->x11, c->y11, 1.0f, 1.0f, c->x01, c->y01, 0.0f, 1.0f, TILE_TEXTURE, TILE_TEX_WIDTH, TILE_TEX_HEIGHT, c->quadColor);
-          }
-      } else {
-          reich_draw_quad_fill(ctx, c->x00, c->y00, c->x10, c->y10, c->x11, c->y11, c->x01, c->y01, c->quadColor);
-      }
-
-      if (drawBounds) {
-          if (c->cullTri1 > 0.0f) {
-              reich_draw_line(ctx, c->x00, c->y00, c->x10, c->y10, 0x44000000);
-              reich_draw_line(ctx, c->x10, c->y10, c->x11, c->y11, 0x44000000);
-          }
-          if (c->cullTri2 > 0.0f) {
-              reich_draw_line(ctx, c->x11, c->y11, c->x01, c->y01, 0x44000000);
-              reich_draw_line(ctx, c->x01, c->y01, c->x00, c->y00, 0x44000000);
-          }
-      }
+  jd.numQuads = totalQuads;
+  jd.batches = &batches;
+  jd.runKernel = quad_run_sse2;
+#if defined(REICH_SIMD_X86)
+  if (reich_simd_level() >= REICH_SIMD_AVX2) { jd.runKernel = quad_run_avx2; }
+#endif
+
+  /* -- PHASE 1: Process vertices, math & lighting on the job system & SSE2 -- */
+  reich_prof_begin("geometry");
+  reich_jobs_parallel_for(numBatches, 0, process_quads_job, &jd);
+
+  /* Prefix sum of the batch counts gives every run its place in one
+   * compacted list, in the same order the quads were walked */
+  quads.count = 0;
+  for (t = 0; t < numBatches; t++) {
+    batchStarts[t] = quads.count;
+    quads.count += jd.batchCounts[t];
+  }
+  quads.isTextured = (jd.baseLevel == 0 && jd.zm >= TILE_TEX_MIN_ZOOM);
+  if (!quad_list_alloc(&ctx->frameMem, &quads, quads.count)) {
+      reich_prof_end();
+      ctx->clip = originalClip;
+      return TRUE;
+  }
+  mj.src = &batches;
+  mj.dst = &quads;
+  mj.batchCounts = jd.batchCounts;
+  mj.batchStarts = batchStarts;
+  reich_jobs_parallel_for(numBatches, 0, quad_merge_job, &mj);
+  reich_prof_end();
+
+  /* -- PHASE 2: Tile-binned parallel raster, identical to the sequential painter's order -- */
+  reich_prof_begin("raster");
+  if (useTileRaster) {
+    raster_tiles(ctx, clipRect, &quads, drawBounds);
+  } else {
+    for (idx = 0; idx < quads.count; idx++) { draw_quad_cmd(ctx, &quads, idx, drawBounds); }
   }
+  reich_prof_end();
 
   ctx->clip = originalClip;
   reich_draw_rect(
@@ -682,6 +2185,13 @@ int32 my_input(reichContext* ctx) {
     apply_pan_delta(&mainCamera, (real64)ctx->input.deltaX, (real64)ctx->input.deltaY);
   }
 
+  /* F2 toggles the profiler overlay, F3 writes the recorded frames out, F4
+   * toggles terrain LOD to compare against drawing everything at the finest
+   * level */
+  if (reich_key_pressed(ctx, 0x71)) { showProfiler = !showProfiler; }
+  if (reich_key_pressed(ctx, 0x72)) { reich_prof_dump_trace("reich_trace.json"); }
+  if (reich_key_pressed(ctx, 0x73)) { useTerrainLod = !useTerrainLod; }
+
   if (reich_key_down(ctx, 0x25)) { apply_pan_delta(&mainCamera, 15.0, 0); }
   if (reich_key_down(ctx, 0x27)) { apply_pan_delta(&mainCamera, -15.0, 0); }
   if (reich_key_down(ctx, 0x26)) { apply_pan_delta(&mainCamera, 0, 15.0); }
@@ -705,8 +2215,8 @@ int32 my_input(reichContext* ctx) {
 
   if (mainCamera.x < 0) { mainCamera.x = 0; }
   if (mainCamera.y < 0) { mainCamera.y = 0; }
-  if (mainCamera.x > REICH_MAX_GRID_WIDTH) { mainCamera.x = REICH_MAX_GRID_WIDTH; }
-  if (mainCamera.y > REICH_MAX_GRID_HEIGHT) { mainCamera.y = REICH_MAX_GRID_HEIGHT; }
+  if (mainCamera.x > terrainStore.width) { mainCamera.x = terrainStore.width; }
+  if (mainCamera.y > terrainStore.height) { mainCamera.y = terrainStore.height; }
 
   if (isLeftMouseDown && isSelectingBox) {
     selectionEndWorldX = mouseWorldX;
@@ -740,31 +2250,49 @@ int32 my_render(reichContext* ctx, real64 alpha) {
   draw_world(
       ctx,
       reich_rect(50, 40, ctx->canvas.width - 50, ctx->canvas.height - 40),
-      REICH_GRID_DATA,
+      &terrainStore,
       sunColor,
       ambientColor,
       skyColor,
       lightDirX,
       lightDirY,
       lightDirZ);
+  if (showProfiler) { reich_prof_draw_overlay(ctx, 56, 46); }
   return 1;
 }
 
-int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR cmdLine, int cmdShow) {
-  (void)hInst;
-	(void)hPrev;
-	(void)cmdLine;
-	(void)cmdShow;
-	grid_init(REICH_GRID_DATA, REICH_MAX_GRID_WIDTH, REICH_MAX_GRID_HEIGHT);
+/* Define REICH_NO_MAIN to pull the demo into another program (bench.c)
+ * without its entry points. */
+#ifndef REICH_NO_MAIN
+static int32 run_demo(void) {
   if (!reich_init(&mainContext, "REICH Production Shading", 800, 600, 60.0)) {
     return -1;
   }
+  reich_jobs_init(0);
+  terrain_load(TERRAIN_WORLD_WIDTH, TERRAIN_WORLD_HEIGHT);
+  reich_prof_enable(&mainContext, 1);
   reich_set_callbacks(&mainContext, my_update, my_render, my_input);
   reich_run(&mainContext);
+  reich_jobs_shutdown();
   return 0;
 }
 
+#if defined(REICH_PLATFORM_WIN32)
+int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR cmdLine, int cmdShow) {
+  (void)hInst;
+	(void)hPrev;
+	(void)cmdLine;
+	(void)cmdShow;
+  return run_demo();
+}
+
 void mainCRTStartup(void) {
   ExitProcess(WinMain(
       GetModuleHandleA(NULL), NULL, GetCommandLineA(), SW_SHOWDEFAULT));
 }
+#else
+int main(void) {
+  return run_demo();
+}
+#endif
+#endif
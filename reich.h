@@ -2,6 +2,10 @@
 #ifndef REICH_H
 #define REICH_H
 
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <math.h>
 #include <stdint.h>
 #include <stdarg.h>
@@ -74,12 +78,38 @@ typedef struct reichArena {
   reichSize used;
 } reichArena;
 
+#define REICH_FORMAT_STRAIGHT 0
+#define REICH_FORMAT_PREMUL   1
+
 typedef struct reichCanvas {
   int32 width;
   int32 height;
   uint32* pixels;
+  int32 format;
 } reichCanvas;
 
+#define REICH_TEX_MAX_LEVELS 16
+#define REICH_TEX_NEAREST    0
+#define REICH_TEX_BILINEAR   1
+#define REICH_TEX_MIPMAP     2
+
+/* Texture with an optional box-filtered mip chain. Power-of-two sizes wrap
+ * with a mask, any other size with a modulo. */
+typedef struct reichTexture {
+  int32 width;
+  int32 height;
+  int32 levels;
+  uint32* mips[REICH_TEX_MAX_LEVELS];
+} reichTexture;
+
+/* Screen position, w (view depth, 1 for affine mapping) and texture
+ * coordinates where 1.0 spans the texture once. */
+typedef struct reichTexVertex {
+  real32 x, y;
+  real32 w;
+  real32 u, v;
+} reichTexVertex;
+
 typedef struct reichInput {
   int32 mouseX, mouseY;
   int32 lastMouseX, lastMouseY;
@@ -97,6 +127,73 @@ typedef struct reichInput {
   int32 activeId, hotId;
 } reichInput;
 
+/* Draw calls mark the 32x32 tiles they touch. The present path turns the
+ * marked tiles into coalesced rectangles and pushes only those. */
+#define REICH_DIRTY_TILE_SHIFT  5
+#define REICH_DIRTY_TILE        (1 << REICH_DIRTY_TILE_SHIFT)
+#define REICH_DIRTY_TILES_X     128
+#define REICH_DIRTY_TILES_Y     128
+#define REICH_DIRTY_WORDS       (REICH_DIRTY_TILES_X / 32)
+#define REICH_MAX_PRESENT_RECTS 64
+
+#define REICH_PRESENT_FULL           0
+#define REICH_PRESENT_PARTIAL        1
+#define REICH_PRESENT_SKIP_UNCHANGED 2
+
+typedef struct reichPresentStats {
+  int64 framesPresented;
+  int64 framesSkipped;
+  int64 totalPixelsPushed;
+  int32 rectsPushed; /* Last frame */
+  int32 pixelsPushed;
+} reichPresentStats;
+
+/* Primitive classes for the per-frame draw counters. */
+#define REICH_PRIM_PIXEL    0
+#define REICH_PRIM_CLEAR    1
+#define REICH_PRIM_LINE     2
+#define REICH_PRIM_RECT     3
+#define REICH_PRIM_ELLIPSE  4
+#define REICH_PRIM_TRIANGLE 5
+#define REICH_PRIM_TEXTURED 6
+#define REICH_PRIM_QUAD     7
+#define REICH_PRIM_CURVE    8
+#define REICH_PRIM_TEXT     9
+#define REICH_PRIM_CANVAS   10
+#define REICH_PRIM_GLASS    11
+#define REICH_PRIM_COUNT    12
+
+#define REICH_PROF_FRAMES    64
+#define REICH_PROF_MAX_ZONES 512
+#define REICH_PROF_MAX_DEPTH 16
+
+typedef struct reichPrimStats {
+  uint32 calls;
+  uint32 opaque;  /* Pixels stored */
+  uint32 blended; /* Pixels read, blended and stored */
+} reichPrimStats;
+
+typedef struct reichProfCounters {
+  int32 prim; /* Primitive the next pixels are charged to */
+  reichPrimStats prims[REICH_PRIM_COUNT];
+} reichProfCounters;
+
+typedef struct reichProfZone {
+  const char* name;
+  int64 start;
+  int64 end;
+  int32 thread;
+  int32 depth;
+} reichProfZone;
+
+typedef struct reichProfFrame {
+  int64 start;
+  int64 end;
+  volatile int32 zoneCount;
+  reichPrimStats prims[REICH_PRIM_COUNT];
+  reichProfZone zones[REICH_PROF_MAX_ZONES];
+} reichProfFrame;
+
 typedef struct reichContext reichContext;
 
 typedef int32 (*PFUSERUPDATE)(reichContext* ctx);
@@ -122,6 +219,15 @@ struct reichContext {
   reichCanvas canvas;
   reichRect clip;
   reichRect activeDirty;
+  uint32 dirtyTiles[REICH_DIRTY_TILES_Y][REICH_DIRTY_WORDS];
+
+  int32 presentMode;
+  int32 presentRectCount; /* -1 pushes the whole canvas */
+  reichRect presentRects[REICH_MAX_PRESENT_RECTS];
+  uint32* presentHashes;
+  int32 presentHashW, presentHashH;
+  reichPresentStats presentStats;
+  reichProfCounters prof;
 
   reichInput input;
   const char* windowTitle;
@@ -164,6 +270,8 @@ REICH_API int32 reich_sys_file_close(reichHandle file);
 REICH_API int32 reich_sys_file_tell(reichHandle file);
 REICH_API int32 reich_sys_find_close(reichHandle handle);
 REICH_API reichSize reich_sys_file_size(reichHandle file);
+REICH_API void* reich_sys_file_map(const char* filename, reichSize* size);
+REICH_API int32 reich_sys_file_unmap(void* view, reichSize size);
 REICH_API int32 reich_sys_log(int32 level, const char* format, ...);
 REICH_API reichHandle reich_sys_file_open(const char* filename, int32 mode);
 REICH_API int32
@@ -190,11 +298,35 @@ REICH_API int64 reich_sys_get_ticks(void);
 REICH_API int64 reich_sys_get_freq(void);
 REICH_API int32 reich_sys_free(void* ptr);
 
+typedef int32 (*PFREICHTHREAD)(void* arg);
+
+REICH_API reichHandle reich_sys_thread_create(PFREICHTHREAD proc, void* arg);
+REICH_API int32 reich_sys_thread_join(reichHandle thread);
+REICH_API int32 reich_sys_cpu_count(void);
+REICH_API reichHandle reich_sys_mutex_create(void);
+REICH_API int32 reich_sys_mutex_lock(reichHandle mutex);
+REICH_API int32 reich_sys_mutex_unlock(reichHandle mutex);
+REICH_API int32 reich_sys_mutex_destroy(reichHandle mutex);
+REICH_API reichHandle reich_sys_cond_create(void);
+REICH_API int32 reich_sys_cond_wait(reichHandle cond, reichHandle mutex);
+REICH_API int32 reich_sys_cond_broadcast(reichHandle cond);
+REICH_API int32 reich_sys_cond_destroy(reichHandle cond);
+
 REICH_API int32
 reich_sys_resize_canvas(reichContext* ctx, int32 width, int32 height);
 REICH_API int32 reich_sys_window_init(
     reichContext* ctx, const char* title, int32 width, int32 height);
 
+#if defined(REICH_PLATFORM_LINUX)
+typedef int32 (*PFPRESENT)(reichContext* ctx, reichCanvas* canvas, void* user);
+
+REICH_API int32 reich_sys_set_present_callback(
+    reichContext* ctx, PFPRESENT present, void* user);
+REICH_API int32 reich_sys_set_frame_dump(
+    reichContext* ctx, const char* prefix, int32 interval);
+REICH_API int32 reich_sys_set_frame_limit(reichContext* ctx, int32 frames);
+#endif
+
 REICH_API int32 reich_init(
     reichContext* ctx,
     const char* title,
@@ -209,6 +341,8 @@ REICH_API int32 reich_set_callbacks(
 REICH_API int32 reich_run(reichContext* ctx);
 REICH_API int32 reich_begin_frame(reichContext* ctx);
 REICH_API int32 reich_end_frame(reichContext* ctx);
+REICH_API int32 reich_set_present_mode(reichContext* ctx, int32 mode);
+REICH_API int32 reich_dirty_merge(reichContext* ctx, const reichContext* src);
 
 REICH_API int32 reich_timer_tick(reichContext* ctx);
 REICH_API int32 reich_timer_step(reichContext* ctx);
@@ -230,6 +364,30 @@ REICH_API void* reich_arena_alloc(reichArena* a, reichSize size);
 REICH_API int32 reich_arena_init(reichArena* a, void* mem, reichSize size);
 REICH_API int32 reich_arena_reset(reichArena* a);
 
+#define REICH_MAX_THREADS 64
+
+typedef void (*PFREICHJOB)(void* data, int32 start, int32 end, int32 thread);
+
+REICH_API int32 reich_jobs_init(int32 threadCount);
+REICH_API int32 reich_jobs_shutdown(void);
+REICH_API int32 reich_jobs_thread_count(void);
+REICH_API int32 reich_jobs_parallel_for(
+    int32 count, int32 chunk, PFREICHJOB job, void* data);
+
+REICH_API int32 reich_prof_enable(reichContext* ctx, int32 enable);
+REICH_API int32 reich_prof_begin(const char* name);
+REICH_API int32 reich_prof_end(void);
+REICH_API int32 reich_prof_begin_thread(int32 thread, const char* name);
+REICH_API int32 reich_prof_end_thread(int32 thread);
+REICH_API int32 reich_prof_frame_begin(reichContext* ctx);
+REICH_API int32 reich_prof_frame_end(reichContext* ctx);
+REICH_API const reichProfFrame* reich_prof_frame(int32 ago);
+REICH_API const char* reich_prof_prim_name(int32 prim);
+REICH_API int32 reich_prof_draw_overlay(reichContext* ctx, int32 x, int32 y);
+REICH_API int32 reich_prof_dump_trace(const char* filename);
+REICH_API int32 reich_context_fork(reichContext* dst, const reichContext* src);
+REICH_API int32 reich_context_join(reichContext* ctx, reichContext* src);
+
 REICH_API int32 reich_set_scale(reichContext* ctx, int32 scale);
 REICH_API int32 reich_draw_decorations(reichContext* ctx);
 REICH_API int32 reich_default_render_titlebar(
@@ -248,6 +406,8 @@ REICH_API int32 reich_default_render_btn_min(
     reichContext* ctx, int32 x, int32 y, int32 w, int32 h, int32 isHovered);
 
 REICH_API reichCanvas reich_load_bmp(const char* filename);
+REICH_API reichCanvas reich_load_bmp_ex(const char* filename, int32 format);
+REICH_API int32 reich_save_bmp(const char* filename, reichCanvas* canvas);
 REICH_API int32 reich_init_default_font(reichContext* ctx);
 REICH_API uint8* reich_font_import(
     reichArena* a,
@@ -346,6 +506,17 @@ REICH_API int32 reich_draw_triangle_fill(
     float x3,
     float y3,
     uint32 color);
+REICH_API int32 reich_texture_mip_pixels(int32 w, int32 h);
+REICH_API int32 reich_texture_init(
+    reichTexture* tex, uint32* pixels, int32 w, int32 h, uint32* mipPixels);
+REICH_API int32 reich_draw_triangle_tex(
+    reichContext* ctx,
+    const reichTexture* tex,
+    const reichTexVertex* p0,
+    const reichTexVertex* p1,
+    const reichTexVertex* p2,
+    uint32 tint,
+    int32 flags);
 REICH_API int32 reich_draw_ellipse(
     reichContext* ctx,
     float cx,
@@ -389,6 +560,47 @@ REICH_API int32 reich_draw_canvas_scaled(
 
 REICH_API uint32 reich_color_lerp(uint32 c1, uint32 c2, float t);
 
+#define REICH_SIMD_SCALAR 0
+#define REICH_SIMD_SSE2   1
+#define REICH_SIMD_AVX2   2
+
+REICH_API int32 reich_simd_detect(void);
+REICH_API int32 reich_simd_set_level(int32 level);
+REICH_API int32 reich_simd_level(void);
+REICH_API int32 reich_span_fill(uint32* dst, int32 count, uint32 color);
+REICH_API int32 reich_span_blend(uint32* dst, int32 count, uint32 color);
+REICH_API int32
+reich_span_blend_premul(uint32* dst, int32 count, uint32 color);
+
+REICH_API int32
+reich_noise2_n(const real32* xs, const real32* ys, real32* out, int32 count);
+REICH_API int32 reich_noise3_n(
+    const real32* xs, const real32* ys, const real32* zs, real32* out,
+    int32 count);
+REICH_API int32 reich_noise_fbm2_n(
+    const real32* xs,
+    const real32* ys,
+    real32* out,
+    int32 count,
+    int32 octaves,
+    real32 lacunarity,
+    real32 gain);
+REICH_API int32 reich_noise_fbm2_grid(
+    real32* out,
+    const real32* xs,
+    int32 w,
+    const real32* ys,
+    int32 h,
+    int32 octaves,
+    real32 lacunarity,
+    real32 gain);
+
+REICH_API uint32 reich_color_premultiply(uint32 color);
+REICH_API uint32 reich_color_unpremultiply(uint32 color);
+REICH_API int32 reich_canvas_premultiply(reichCanvas* canvas);
+REICH_API int32 reich_canvas_unpremultiply(reichCanvas* canvas);
+REICH_API int32 reich_set_canvas_format(reichContext* ctx, int32 format);
+
 #ifdef REICH_IMPLEMENTATION
 
 #define REICH_DIV255(x) (((x) + ((x) >> 8) + 1) >> 8)
@@ -525,15 +737,182 @@ static int32 reich_dirty_reset(reichContext* ctx) {
   ctx->activeDirty.y1 = 999999;
   ctx->activeDirty.x2 = -999999;
   ctx->activeDirty.y2 = -999999;
+  reich_memset(ctx->dirtyTiles, 0, sizeof(ctx->dirtyTiles));
   return 1;
 }
 
 static int32 reich_dirty_add(
     reichContext* ctx, int32 x1, int32 y1, int32 x2, int32 y2) {
+  int32 tx1, ty1, tx2, ty2, w1, w2, w;
+  uint32 bits;
   if (x1 < ctx->activeDirty.x1) { ctx->activeDirty.x1 = x1; }
   if (y1 < ctx->activeDirty.y1) { ctx->activeDirty.y1 = y1; }
   if (x2 > ctx->activeDirty.x2) { ctx->activeDirty.x2 = x2; }
   if (y2 > ctx->activeDirty.y2) { ctx->activeDirty.y2 = y2; }
+
+  /* Pixels past the last tile row or column fold into it. */
+  if (x1 < 0) { x1 = 0; }
+  if (y1 < 0) { y1 = 0; }
+  if (x1 >= x2 || y1 >= y2) { return 1; }
+  tx1 = x1 >> REICH_DIRTY_TILE_SHIFT;
+  ty1 = y1 >> REICH_DIRTY_TILE_SHIFT;
+  tx2 = (x2 - 1) >> REICH_DIRTY_TILE_SHIFT;
+  ty2 = (y2 - 1) >> REICH_DIRTY_TILE_SHIFT;
+  if (tx1 >= REICH_DIRTY_TILES_X) { tx1 = REICH_DIRTY_TILES_X - 1; }
+  if (ty1 >= REICH_DIRTY_TILES_Y) { ty1 = REICH_DIRTY_TILES_Y - 1; }
+  if (tx2 >= REICH_DIRTY_TILES_X) { tx2 = REICH_DIRTY_TILES_X - 1; }
+  if (ty2 >= REICH_DIRTY_TILES_Y) { ty2 = REICH_DIRTY_TILES_Y - 1; }
+  w1 = tx1 >> 5;
+  w2 = tx2 >> 5;
+  for (; ty1 <= ty2; ++ty1) {
+    for (w = w1; w <= w2; ++w) {
+      bits = 0xFFFFFFFFu;
+      if (w == w1) { bits &= 0xFFFFFFFFu << (tx1 & 31); }
+      if (w == w2) { bits &= 0xFFFFFFFFu >> (31 - (tx2 & 31)); }
+      ctx->dirtyTiles[ty1][w] |= bits;
+    }
+  }
+  return 1;
+}
+
+REICH_API int32 reich_dirty_merge(reichContext* ctx, const reichContext* src) {
+  int32 y, w;
+  const reichRect* d = &src->activeDirty;
+  if (d->x1 < ctx->activeDirty.x1) { ctx->activeDirty.x1 = d->x1; }
+  if (d->y1 < ctx->activeDirty.y1) { ctx->activeDirty.y1 = d->y1; }
+  if (d->x2 > ctx->activeDirty.x2) { ctx->activeDirty.x2 = d->x2; }
+  if (d->y2 > ctx->activeDirty.y2) { ctx->activeDirty.y2 = d->y2; }
+  for (y = 0; y < REICH_DIRTY_TILES_Y; ++y) {
+    for (w = 0; w < REICH_DIRTY_WORDS; ++w) {
+      ctx->dirtyTiles[y][w] |= src->dirtyTiles[y][w];
+    }
+  }
+  return 1;
+}
+
+REICH_API int32 reich_set_present_mode(reichContext* ctx, int32 mode) {
+  reichSize size;
+  if (!ctx) { return 0; }
+  if ((mode & REICH_PRESENT_SKIP_UNCHANGED) && !ctx->presentHashes) {
+    size = (reichSize)REICH_DIRTY_TILES_X * REICH_DIRTY_TILES_Y *
+           sizeof(uint32);
+    ctx->presentHashes = (uint32*)reich_arena_alloc(&ctx->permMem, size);
+    if (!ctx->presentHashes) { return 0; }
+    ctx->presentHashW = 0;
+    ctx->presentHashH = 0;
+  }
+  ctx->presentMode = mode;
+  return 1;
+}
+
+static int32 reich_dirty_tile_rect(
+    reichContext* ctx, int32 tx, int32 ty, int32 tilesX, int32 tilesY,
+    reichRect* r) {
+  r->x1 = tx << REICH_DIRTY_TILE_SHIFT;
+  r->y1 = ty << REICH_DIRTY_TILE_SHIFT;
+  r->x2 = tx == tilesX - 1 ? ctx->canvas.width
+                           : r->x1 + REICH_DIRTY_TILE;
+  r->y2 = ty == tilesY - 1 ? ctx->canvas.height
+                           : r->y1 + REICH_DIRTY_TILE;
+  return 1;
+}
+
+/* Drops dirty tiles whose pixels hash the same as when last presented, so
+ * an app that redraws everything each frame still pushes only changes. */
+static int32 reich_dirty_drop_unchanged(
+    reichContext* ctx, int32 tilesX, int32 tilesY) {
+  int32 tx, ty, x, y, valid;
+  uint32 hash, *hashSlot;
+  const uint32* row;
+  reichRect r;
+  valid = ctx->presentHashW == ctx->canvas.width &&
+          ctx->presentHashH == ctx->canvas.height;
+  if (!valid) {
+    /* The canvas changed size: push everything once to reseed. */
+    for (ty = 0; ty < tilesY; ++ty) {
+      for (tx = 0; tx < tilesX; ++tx) {
+        ctx->dirtyTiles[ty][tx >> 5] |= 1u << (tx & 31);
+      }
+    }
+    ctx->presentHashW = ctx->canvas.width;
+    ctx->presentHashH = ctx->canvas.height;
+  }
+  for (ty = 0; ty < tilesY; ++ty) {
+    for (tx = 0; tx < tilesX; ++tx) {
+      if (!(ctx->dirtyTiles[ty][tx >> 5] & (1u << (tx & 31)))) { continue; }
+      reich_dirty_tile_rect(ctx, tx, ty, tilesX, tilesY, &r);
+      hash = 2166136261u;
+      for (y = r.y1; y < r.y2; ++y) {
+        row = ctx->canvas.pixels + y * ctx->canvas.width;
+        for (x = r.x1; x < r.x2; ++x) { hash = (hash ^ row[x]) * 16777619u; }
+      }
+      hashSlot = &ctx->presentHashes[ty * REICH_DIRTY_TILES_X + tx];
+      if (valid && *hashSlot == hash) {
+        ctx->dirtyTiles[ty][tx >> 5] &= ~(1u << (tx & 31));
+      }
+      *hashSlot = hash;
+    }
+  }
+  return 1;
+}
+
+/* Builds ctx->presentRects from the tile mask: runs of tiles along a row
+ * become one rectangle, which grows downward while the next row has the
+ * same run. Overflow is folded into the last rectangle. */
+static int32 reich_dirty_collect(reichContext* ctx) {
+  int32 tilesX, tilesY, tx, ty, run, i, count, rowStart, merged;
+  reichRect r, end, *last;
+
+  if (ctx->presentMode == REICH_PRESENT_FULL || !ctx->canvas.pixels) {
+    ctx->presentRectCount = -1;
+    return 1;
+  }
+  tilesX = (ctx->canvas.width + REICH_DIRTY_TILE - 1) >> REICH_DIRTY_TILE_SHIFT;
+  tilesY = (ctx->canvas.height + REICH_DIRTY_TILE - 1) >> REICH_DIRTY_TILE_SHIFT;
+  if (tilesX > REICH_DIRTY_TILES_X) { tilesX = REICH_DIRTY_TILES_X; }
+  if (tilesY > REICH_DIRTY_TILES_Y) { tilesY = REICH_DIRTY_TILES_Y; }
+  if ((ctx->presentMode & REICH_PRESENT_SKIP_UNCHANGED) &&
+      ctx->presentHashes) {
+    reich_dirty_drop_unchanged(ctx, tilesX, tilesY);
+  }
+
+  count = 0;
+  for (ty = 0; ty < tilesY; ++ty) {
+    rowStart = count;
+    for (tx = 0; tx < tilesX; tx = run) {
+      if (!(ctx->dirtyTiles[ty][tx >> 5] & (1u << (tx & 31)))) {
+        run = tx + 1;
+        continue;
+      }
+      for (run = tx + 1; run < tilesX; ++run) {
+        if (!(ctx->dirtyTiles[ty][run >> 5] & (1u << (run & 31)))) { break; }
+      }
+      reich_dirty_tile_rect(ctx, tx, ty, tilesX, tilesY, &r);
+      reich_dirty_tile_rect(ctx, run - 1, ty, tilesX, tilesY, &end);
+      r.x2 = end.x2;
+
+      merged = 0;
+      for (i = 0; i < rowStart; ++i) {
+        last = &ctx->presentRects[i];
+        if (last->x1 == r.x1 && last->x2 == r.x2 && last->y2 == r.y1) {
+          last->y2 = r.y2;
+          merged = 1;
+          break;
+        }
+      }
+      if (merged) { continue; }
+      if (count < REICH_MAX_PRESENT_RECTS) {
+        ctx->presentRects[count++] = r;
+      } else {
+        last = &ctx->presentRects[count - 1];
+        if (r.x1 < last->x1) { last->x1 = r.x1; }
+        if (r.y1 < last->y1) { last->y1 = r.y1; }
+        if (r.x2 > last->x2) { last->x2 = r.x2; }
+        if (r.y2 > last->y2) { last->y2 = r.y2; }
+      }
+    }
+  }
+  ctx->presentRectCount = count;
   return 1;
 }
 
@@ -665,8 +1044,27 @@ int32 reich_string_format(char* buffer, int32 size, const char* format, ...) {
 	return 0;
 }
 
+static int32 reich_internal_resize_canvas(
+    reichCanvas* canvas, int32 w, int32 h) {
+  if (canvas->width != w || canvas->height != h) {
+    if (canvas->pixels) { reich_sys_free(canvas->pixels); }
+    canvas->width = w;
+    canvas->height = h;
+    canvas->pixels =
+        (uint32*)reich_sys_alloc((reichSize)w * h * sizeof(uint32));
+    if (canvas->pixels) {
+      reich_memset(canvas->pixels, 0, (reichSize)w * h * sizeof(uint32));
+    }
+  }
+  return 1;
+}
+
 #if defined(REICH_PLATFORM_WIN32)
 #define WIN32_LEAN_AND_MEAN
+#if !defined(_WIN32_WINNT) || _WIN32_WINNT < 0x0600
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
 #include <windows.h>
 #include <windowsx.h>
 
@@ -684,6 +1082,12 @@ typedef struct reichSearchState {
   WIN32_FIND_DATAA findData;
 } reichSearchState;
 
+typedef struct reichThread {
+  PFREICHTHREAD proc;
+  void* arg;
+  HANDLE handle;
+} reichThread;
+
 REICH_API reichHandle reich_sys_file_open(const char* filename, int32 mode) {
   HANDLE file;
   DWORD access = 0;
@@ -741,6 +1145,43 @@ REICH_API reichSize reich_sys_file_size(reichHandle file) {
   return (reichSize)size.QuadPart;
 }
 
+/* Copy-on-write view of a whole file. Missing files fail quietly so the
+ * call can double as an existence check. */
+REICH_API void* reich_sys_file_map(const char* filename, reichSize* size) {
+  HANDLE file, mapping;
+  LARGE_INTEGER fileSize;
+  void* view = NULL;
+  if (size) { *size = 0; }
+  file = CreateFileA(
+      filename,
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+  if (file == INVALID_HANDLE_VALUE) { return NULL; }
+  if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (mapping) {
+      view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+      CloseHandle(mapping);
+    }
+  }
+  CloseHandle(file);
+  if (!view) {
+    reich_sys_log(REICH_LOG_ERROR, "Failed to map file: %s", filename);
+    return NULL;
+  }
+  if (size) { *size = (reichSize)fileSize.QuadPart; }
+  return view;
+}
+
+REICH_API int32 reich_sys_file_unmap(void* view, reichSize size) {
+  (void)size;
+  return view && UnmapViewOfFile(view) ? 1 : 0;
+}
+
 REICH_API int32
 reich_sys_file_seek(reichHandle file, int32 offset, int32 origin) {
   DWORD method = FILE_BEGIN;
@@ -1118,97 +1559,692 @@ REICH_API int32 reich_sys_window_init(
   return 1;
 }
 
-static int32 reich_internal_resize_canvas(
-    reichCanvas* canvas, int32 w, int32 h) {
-  if (canvas->width != w || canvas->height != h) {
-    if (canvas->pixels) { reich_sys_free(canvas->pixels); }
-    canvas->width = w;
-    canvas->height = h;
-    canvas->pixels =
-        (uint32*)reich_sys_alloc((reichSize)w * h * sizeof(uint32));
-    if (canvas->pixels) {
-      reich_memset(canvas->pixels, 0, (reichSize)w * h * sizeof(uint32));
+REICH_API int32
+reich_sys_resize_canvas(reichContext* ctx, int32 width, int32 height) {
+  reichPlatformContext* pctx = (reichPlatformContext*)ctx->platform;
+  int32 cw = ctx->scale > 0 ? width / ctx->scale : width;
+  int32 ch = ctx->scale > 0 ? height / ctx->scale : height;
+  if (cw < 1) { cw = 1; }
+  if (ch < 1) { ch = 1; }
+
+  reich_internal_resize_canvas(&ctx->canvas, cw, ch);
+  pctx->bitmapInfo.bmiHeader.biWidth = cw;
+  pctx->bitmapInfo.bmiHeader.biHeight = -ch;
+
+  ctx->canvas = ctx->canvas;
+  ctx->clip = reich_rect(0, 0, cw, ch);
+  return 1;
+}
+
+REICH_API int32 reich_sys_poll_events(reichContext* ctx) {
+  MSG msg;
+  while (PeekMessageA(&msg, (HWND)0, 0, 0, PM_REMOVE)) {
+    if (msg.message == WM_QUIT) { ctx->running = 0; }
+    TranslateMessage(&msg);
+    DispatchMessageA(&msg);
+  }
+  return 1;
+}
+
+/* Each rectangle is blitted as its own top-down bitmap starting at its
+ * first row, so the source origin never depends on DIB orientation. */
+static int32 reich_win32_blit(
+    reichContext* ctx, reichPlatformContext* plat, const reichRect* r) {
+  BITMAPINFO info = plat->bitmapInfo;
+  int32 dx1 = r->x1 * ctx->windowWidth / ctx->canvas.width;
+  int32 dy1 = r->y1 * ctx->windowHeight / ctx->canvas.height;
+  int32 dx2 = r->x2 * ctx->windowWidth / ctx->canvas.width;
+  int32 dy2 = r->y2 * ctx->windowHeight / ctx->canvas.height;
+  info.bmiHeader.biHeight = -(r->y2 - r->y1);
+  StretchDIBits(
+      plat->renderDC,
+      dx1,
+      dy1,
+      dx2 - dx1,
+      dy2 - dy1,
+      r->x1,
+      0,
+      r->x2 - r->x1,
+      r->y2 - r->y1,
+      ctx->canvas.pixels + r->y1 * ctx->canvas.width,
+      &info,
+      DIB_RGB_COLORS,
+      SRCCOPY);
+  return 1;
+}
+
+REICH_API int32 reich_sys_present(reichContext* ctx) {
+  reichPlatformContext* plat = (reichPlatformContext*)ctx->platform;
+  reichRect full;
+  int32 i;
+  if (ctx->canvas.pixels) {
+    if (ctx->presentRectCount < 0) {
+      full = reich_rect(0, 0, ctx->canvas.width, ctx->canvas.height);
+      reich_win32_blit(ctx, plat, &full);
+    } else {
+      for (i = 0; i < ctx->presentRectCount; ++i) {
+        reich_win32_blit(ctx, plat, &ctx->presentRects[i]);
+      }
+    }
+  }
+  ctx->presentRectCount = -1;
+  return 1;
+}
+
+REICH_API int64 reich_sys_get_ticks(void) {
+  LARGE_INTEGER count;
+  QueryPerformanceCounter(&count);
+  return (int64)count.QuadPart;
+}
+
+REICH_API int64 reich_sys_get_freq(void) {
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  return (int64)freq.QuadPart;
+}
+
+REICH_API void* reich_sys_alloc(reichSize size) {
+  return VirtualAlloc(
+      (LPVOID)0, (SIZE_T)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+REICH_API int32 reich_sys_free(void* ptr) {
+  if (ptr) { VirtualFree(ptr, 0, MEM_RELEASE); }
+  return 1;
+}
+
+REICH_API int32 reich_sys_show_cursor(void) {
+  ShowCursor(TRUE);
+  return 1;
+}
+REICH_API int32 reich_sys_hide_cursor(void) {
+  ShowCursor(FALSE);
+  return 1;
+}
+
+static DWORD WINAPI reich_thread_entry(LPVOID param) {
+  reichThread* thread = (reichThread*)param;
+  return (DWORD)thread->proc(thread->arg);
+}
+
+REICH_API reichHandle reich_sys_thread_create(PFREICHTHREAD proc, void* arg) {
+  reichThread* thread = (reichThread*)reich_sys_alloc(sizeof(reichThread));
+  if (!thread) { return NULL; }
+  thread->proc = proc;
+  thread->arg = arg;
+  thread->handle =
+      CreateThread(NULL, 0, reich_thread_entry, thread, 0, (LPDWORD)0);
+  if (!thread->handle) {
+    reich_sys_free(thread);
+    return NULL;
+  }
+  return (reichHandle)thread;
+}
+
+REICH_API int32 reich_sys_thread_join(reichHandle handle) {
+  reichThread* thread = (reichThread*)handle;
+  if (!thread) { return 0; }
+  WaitForSingleObject(thread->handle, INFINITE);
+  CloseHandle(thread->handle);
+  reich_sys_free(thread);
+  return 1;
+}
+
+REICH_API int32 reich_sys_cpu_count(void) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int32)info.dwNumberOfProcessors
+                                       : 1;
+}
+
+REICH_API reichHandle reich_sys_mutex_create(void) {
+  CRITICAL_SECTION* cs =
+      (CRITICAL_SECTION*)reich_sys_alloc(sizeof(CRITICAL_SECTION));
+  if (cs) { InitializeCriticalSection(cs); }
+  return (reichHandle)cs;
+}
+
+REICH_API int32 reich_sys_mutex_lock(reichHandle mutex) {
+  EnterCriticalSection((CRITICAL_SECTION*)mutex);
+  return 1;
+}
+
+REICH_API int32 reich_sys_mutex_unlock(reichHandle mutex) {
+  LeaveCriticalSection((CRITICAL_SECTION*)mutex);
+  return 1;
+}
+
+REICH_API int32 reich_sys_mutex_destroy(reichHandle mutex) {
+  if (!mutex) { return 0; }
+  DeleteCriticalSection((CRITICAL_SECTION*)mutex);
+  reich_sys_free(mutex);
+  return 1;
+}
+
+REICH_API reichHandle reich_sys_cond_create(void) {
+  CONDITION_VARIABLE* cv =
+      (CONDITION_VARIABLE*)reich_sys_alloc(sizeof(CONDITION_VARIABLE));
+  if (cv) { InitializeConditionVariable(cv); }
+  return (reichHandle)cv;
+}
+
+REICH_API int32 reich_sys_cond_wait(reichHandle cond, reichHandle mutex) {
+  return SleepConditionVariableCS(
+             (CONDITION_VARIABLE*)cond, (CRITICAL_SECTION*)mutex, INFINITE)
+      ? 1
+      : 0;
+}
+
+REICH_API int32 reich_sys_cond_broadcast(reichHandle cond) {
+  WakeAllConditionVariable((CONDITION_VARIABLE*)cond);
+  return 1;
+}
+
+REICH_API int32 reich_sys_cond_destroy(reichHandle cond) {
+  reich_sys_free(cond);
+  return 1;
+}
+
+#elif defined(REICH_PLATFORM_LINUX)
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Headless backend: no window, the canvas is handed to a present callback
+ * and/or dumped to numbered BMP files. */
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define REICH_ALLOC_HEADER  64
+#define REICH_FD(h)         ((int)(intptr_t)(h) - 1)
+#define REICH_FD_HANDLE(fd) ((reichHandle)(intptr_t)((fd) + 1))
+#define REICH_TO_LOWER(c)   (((c) >= 'A' && (c) <= 'Z') ? (c) + 32 : (c))
+
+typedef struct reichPlatformContext {
+  PFPRESENT presentCallback;
+  void* presentUser;
+  char dumpPrefix[256];
+  int32 dumpInterval;
+  int32 frameLimit;
+  int32 frameIndex;
+} reichPlatformContext;
+
+typedef struct reichSearchState {
+  DIR* dir;
+  char pattern[256];
+} reichSearchState;
+
+typedef struct reichThread {
+  PFREICHTHREAD proc;
+  void* arg;
+  pthread_t handle;
+} reichThread;
+
+REICH_API reichHandle reich_sys_file_open(const char* filename, int32 mode) {
+  int fd = -1;
+  if (mode == REICH_FILE_READ) {
+    fd = open(filename, O_RDONLY);
+  } else if (mode == REICH_FILE_WRITE) {
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if (fd < 0) {
+    reich_sys_log(REICH_LOG_ERROR, "Failed to open file: %s", filename);
+    return NULL;
+  }
+  return REICH_FD_HANDLE(fd);
+}
+
+REICH_API int32 reich_sys_file_close(reichHandle file) {
+  if (file) { close(REICH_FD(file)); }
+  return 1;
+}
+
+REICH_API reichSize
+reich_sys_file_read(reichHandle file, void* buffer, reichSize bytes) {
+  reichSize total = 0;
+  if (!file || !buffer) { return 0; }
+  while (total < bytes) {
+    ssize_t n = read(REICH_FD(file), (uint8*)buffer + total, bytes - total);
+    if (n < 0) {
+      reich_sys_log(REICH_LOG_ERROR, "Failed to read from file.");
+      return total;
+    }
+    if (n == 0) { break; }
+    total += (reichSize)n;
+  }
+  return total;
+}
+
+REICH_API reichSize
+reich_sys_file_write(reichHandle file, const void* buffer, reichSize bytes) {
+  reichSize total = 0;
+  if (!file || !buffer) { return 0; }
+  while (total < bytes) {
+    ssize_t n =
+        write(REICH_FD(file), (const uint8*)buffer + total, bytes - total);
+    if (n <= 0) {
+      reich_sys_log(REICH_LOG_ERROR, "Failed to write to file.");
+      return total;
+    }
+    total += (reichSize)n;
+  }
+  return total;
+}
+
+REICH_API reichSize reich_sys_file_size(reichHandle file) {
+  struct stat st;
+  if (!file) { return 0; }
+  if (fstat(REICH_FD(file), &st) != 0) { return 0; }
+  return (reichSize)st.st_size;
+}
+
+REICH_API void* reich_sys_file_map(const char* filename, reichSize* size) {
+  struct stat st;
+  void* view = MAP_FAILED;
+  int fd;
+  if (size) { *size = 0; }
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) { return NULL; }
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    view = mmap(
+        NULL,
+        (size_t)st.st_size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE,
+        fd,
+        0);
+  }
+  close(fd);
+  if (view == MAP_FAILED) {
+    reich_sys_log(REICH_LOG_ERROR, "Failed to map file: %s", filename);
+    return NULL;
+  }
+  if (size) { *size = (reichSize)st.st_size; }
+  return view;
+}
+
+REICH_API int32 reich_sys_file_unmap(void* view, reichSize size) {
+  return view && munmap(view, (size_t)size) == 0 ? 1 : 0;
+}
+
+REICH_API int32
+reich_sys_file_seek(reichHandle file, int32 offset, int32 origin) {
+  int whence = SEEK_SET;
+  if (!file) { return 0; }
+  if (origin == REICH_SEEK_CUR) {
+    whence = SEEK_CUR;
+  } else if (origin == REICH_SEEK_END) {
+    whence = SEEK_END;
+  }
+  return (int32)lseek(REICH_FD(file), (off_t)offset, whence);
+}
+
+REICH_API int32 reich_sys_file_tell(reichHandle file) {
+  return reich_sys_file_seek(file, 0, REICH_SEEK_CUR);
+}
+
+/* Case-insensitive '*' / '?' matcher, mirroring FindFirstFileA semantics. */
+static int32 reich_wildcard_match(const char* pattern, const char* str) {
+  const char* star = NULL;
+  const char* back = NULL;
+  while (*str) {
+    if (*pattern == '*') {
+      star = pattern++;
+      back = str;
+    } else if (
+        *pattern == '?' || REICH_TO_LOWER(*pattern) == REICH_TO_LOWER(*str)) {
+      pattern++;
+      str++;
+    } else if (star) {
+      pattern = star + 1;
+      str = ++back;
+    } else {
+      return 0;
+    }
+  }
+  while (*pattern == '*') { pattern++; }
+  return *pattern == 0;
+}
+
+static int32 reich_sys_find_advance(
+    reichSearchState* state, char* filenameBuffer, int32 bufferSize) {
+  struct dirent* entry;
+  while ((entry = readdir(state->dir)) != NULL) {
+    if (entry->d_name[0] == '.' &&
+        (entry->d_name[1] == 0 ||
+         (entry->d_name[1] == '.' && entry->d_name[2] == 0))) {
+      continue;
+    }
+    if (reich_wildcard_match(state->pattern, entry->d_name)) {
+      if (filenameBuffer && bufferSize > 0) {
+        reich_strncpy(filenameBuffer, entry->d_name, bufferSize);
+      }
+      return 1;
     }
   }
+  return 0;
+}
+
+REICH_API reichHandle reich_sys_find_first(
+    const char* pattern, char* filenameBuffer, int32 bufferSize) {
+  char dirPath[256];
+  const char* slash = NULL;
+  const char* p;
+  reichSearchState* state =
+      (reichSearchState*)reich_sys_alloc(sizeof(reichSearchState));
+  if (!state) {
+    reich_sys_log(
+        REICH_LOG_ERROR, "Failed to allocate memory for search state.");
+    return NULL;
+  }
+  for (p = pattern; *p; ++p) {
+    if (*p == '/') { slash = p; }
+  }
+  if (slash) {
+    int32 len = (int32)(slash - pattern) + 1;
+    reich_strncpy(dirPath, pattern, len < 256 ? len + 1 : 256);
+    reich_strncpy(state->pattern, slash + 1, 256);
+  } else {
+    reich_strncpy(dirPath, ".", 256);
+    reich_strncpy(state->pattern, pattern, 256);
+  }
+  state->dir = opendir(dirPath);
+  if (!state->dir) {
+    reich_sys_free(state);
+    return NULL;
+  }
+  if (!reich_sys_find_advance(state, filenameBuffer, bufferSize)) {
+    closedir(state->dir);
+    reich_sys_free(state);
+    return NULL;
+  }
+  return (reichHandle)state;
+}
+
+REICH_API int32 reich_sys_find_next(
+    reichHandle handle, char* filenameBuffer, int32 bufferSize) {
+  reichSearchState* state = (reichSearchState*)handle;
+  if (!state) { return 0; }
+  return reich_sys_find_advance(state, filenameBuffer, bufferSize);
+}
+
+REICH_API int32 reich_sys_find_close(reichHandle handle) {
+  reichSearchState* state = (reichSearchState*)handle;
+  if (state) {
+    closedir(state->dir);
+    reich_sys_free(state);
+  }
+  return 1;
+}
+
+REICH_API int32 reich_sys_log(int32 level, const char* format, ...) {
+  char buffer[2048];
+  char prefix[16];
+  va_list args;
+  if (level == REICH_LOG_DEBUG) {
+    reich_strncpy(prefix, "[DEBUG] ", 16);
+  } else if (level == REICH_LOG_INFO) {
+    reich_strncpy(prefix, "[INFO]  ", 16);
+  } else if (level == REICH_LOG_WARN) {
+    reich_strncpy(prefix, "[WARN]  ", 16);
+  } else if (level == REICH_LOG_ERROR) {
+    reich_strncpy(prefix, "[ERROR] ", 16);
+  } else {
+    reich_strncpy(prefix, "[LOG]   ", 16);
+  }
+
+  va_start(args, format);
+  reich_vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+
+  /* Logs go to stderr so stdout stays clean for headless tool output. */
+  if (write(STDERR_FILENO, prefix, reich_strlen(prefix)) < 0 ||
+      write(STDERR_FILENO, buffer, reich_strlen(buffer)) < 0 ||
+      write(STDERR_FILENO, "\n", 1) < 0) {
+    return 0;
+  }
+  return 1;
+}
+
+REICH_API int32 reich_sys_toggle_maximize(reichContext* ctx) {
+  (void)ctx;
+  return 1;
+}
+
+REICH_API int32 reich_sys_minimize(reichContext* ctx) {
+  (void)ctx;
+  return 1;
+}
+
+REICH_API int32 reich_sys_close(reichContext* ctx) {
+  ctx->running = 0;
+  return 1;
+}
+
+REICH_API reichSize reich_sys_get_platform_data_size(void) {
+  return (reichSize)sizeof(reichPlatformContext);
+}
+
+REICH_API int32 reich_sys_window_init(
+    reichContext* ctx, const char* title, int32 width, int32 height) {
+  reichPlatformContext* plat = (reichPlatformContext*)ctx->platform;
+  if (!plat) {
+    reich_sys_log(REICH_LOG_ERROR, "Platform context is NULL.");
+    return 0;
+  }
+  reich_memset(plat, 0, sizeof(reichPlatformContext));
+  ctx->windowWidth = width;
+  ctx->windowHeight = height;
+  reich_sys_resize_canvas(ctx, width, height);
+  reich_sys_log(
+      REICH_LOG_INFO,
+      "Headless context initialized: %s (%dx%d)",
+      title,
+      width,
+      height);
   return 1;
 }
 
 REICH_API int32
 reich_sys_resize_canvas(reichContext* ctx, int32 width, int32 height) {
-  reichPlatformContext* pctx = (reichPlatformContext*)ctx->platform;
   int32 cw = ctx->scale > 0 ? width / ctx->scale : width;
   int32 ch = ctx->scale > 0 ? height / ctx->scale : height;
   if (cw < 1) { cw = 1; }
   if (ch < 1) { ch = 1; }
 
   reich_internal_resize_canvas(&ctx->canvas, cw, ch);
-  pctx->bitmapInfo.bmiHeader.biWidth = cw;
-  pctx->bitmapInfo.bmiHeader.biHeight = -ch;
-
-  ctx->canvas = ctx->canvas;
   ctx->clip = reich_rect(0, 0, cw, ch);
   return 1;
 }
 
 REICH_API int32 reich_sys_poll_events(reichContext* ctx) {
-  MSG msg;
-  while (PeekMessageA(&msg, (HWND)0, 0, 0, PM_REMOVE)) {
-    if (msg.message == WM_QUIT) { ctx->running = 0; }
-    TranslateMessage(&msg);
-    DispatchMessageA(&msg);
+  (void)ctx;
+  return 1;
+}
+
+REICH_API int32 reich_sys_set_present_callback(
+    reichContext* ctx, PFPRESENT present, void* user) {
+  reichPlatformContext* plat = (reichPlatformContext*)ctx->platform;
+  if (!plat) { return 0; }
+  plat->presentCallback = present;
+  plat->presentUser = user;
+  return 1;
+}
+
+REICH_API int32 reich_sys_set_frame_dump(
+    reichContext* ctx, const char* prefix, int32 interval) {
+  reichPlatformContext* plat = (reichPlatformContext*)ctx->platform;
+  if (!plat) { return 0; }
+  if (prefix) {
+    reich_strncpy(plat->dumpPrefix, prefix, sizeof(plat->dumpPrefix));
+  } else {
+    plat->dumpPrefix[0] = 0;
   }
+  plat->dumpInterval = interval > 0 ? interval : 1;
+  return 1;
+}
+
+REICH_API int32 reich_sys_set_frame_limit(reichContext* ctx, int32 frames) {
+  reichPlatformContext* plat = (reichPlatformContext*)ctx->platform;
+  if (!plat) { return 0; }
+  plat->frameLimit = frames;
   return 1;
 }
 
 REICH_API int32 reich_sys_present(reichContext* ctx) {
   reichPlatformContext* plat = (reichPlatformContext*)ctx->platform;
-  if (ctx->canvas.pixels) {
-    StretchDIBits(
-        plat->renderDC,
-        0,
-        0,
-        ctx->windowWidth,
-        ctx->windowHeight,
-        0,
-        0,
-        ctx->canvas.width,
-        ctx->canvas.height,
-        ctx->canvas.pixels,
-        &plat->bitmapInfo,
-        DIB_RGB_COLORS,
-        SRCCOPY);
+  int32 skip;
+  if (!plat || !ctx->canvas.pixels) { return 0; }
+  /* Callbacks can read ctx->presentRects; unchanged frames still count
+   * toward the frame limit. */
+  skip = ctx->presentRectCount == 0;
+  if (!skip && plat->presentCallback &&
+      !plat->presentCallback(ctx, &ctx->canvas, plat->presentUser)) {
+    ctx->running = 0;
+  }
+  if (!skip && plat->dumpPrefix[0] &&
+      plat->frameIndex % plat->dumpInterval == 0) {
+    char filename[300];
+    reich_string_format(
+        filename,
+        (int32)sizeof(filename),
+        "%s%05d.bmp",
+        plat->dumpPrefix,
+        plat->frameIndex);
+    reich_save_bmp(filename, &ctx->canvas);
+  }
+  ctx->presentRectCount = -1;
+  plat->frameIndex++;
+  if (plat->frameLimit > 0 && plat->frameIndex >= plat->frameLimit) {
+    ctx->running = 0;
   }
   return 1;
 }
 
 REICH_API int64 reich_sys_get_ticks(void) {
-  LARGE_INTEGER count;
-  QueryPerformanceCounter(&count);
-  return (int64)count.QuadPart;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64)ts.tv_sec * 1000000000LL + (int64)ts.tv_nsec;
 }
 
 REICH_API int64 reich_sys_get_freq(void) {
-  LARGE_INTEGER freq;
-  QueryPerformanceFrequency(&freq);
-  return (int64)freq.QuadPart;
+  return 1000000000LL;
 }
 
 REICH_API void* reich_sys_alloc(reichSize size) {
-  return VirtualAlloc(
-      (LPVOID)0, (SIZE_T)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  reichSize total = size + REICH_ALLOC_HEADER;
+  uint8* base = (uint8*)mmap(
+      NULL,
+      total,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+      -1,
+      0);
+  if ((void*)base == MAP_FAILED) { return NULL; }
+  *(reichSize*)base = total;
+  return base + REICH_ALLOC_HEADER;
 }
 
 REICH_API int32 reich_sys_free(void* ptr) {
-  if (ptr) { VirtualFree(ptr, 0, MEM_RELEASE); }
+  if (ptr) {
+    uint8* base = (uint8*)ptr - REICH_ALLOC_HEADER;
+    munmap(base, *(reichSize*)base);
+  }
   return 1;
 }
 
 REICH_API int32 reich_sys_show_cursor(void) {
-  ShowCursor(TRUE);
   return 1;
 }
 REICH_API int32 reich_sys_hide_cursor(void) {
-  ShowCursor(FALSE);
+  return 1;
+}
+
+static void* reich_thread_entry(void* param) {
+  reichThread* thread = (reichThread*)param;
+  thread->proc(thread->arg);
+  return NULL;
+}
+
+REICH_API reichHandle reich_sys_thread_create(PFREICHTHREAD proc, void* arg) {
+  reichThread* thread = (reichThread*)reich_sys_alloc(sizeof(reichThread));
+  if (!thread) { return NULL; }
+  thread->proc = proc;
+  thread->arg = arg;
+  if (pthread_create(&thread->handle, NULL, reich_thread_entry, thread)) {
+    reich_sys_free(thread);
+    return NULL;
+  }
+  return (reichHandle)thread;
+}
+
+REICH_API int32 reich_sys_thread_join(reichHandle handle) {
+  reichThread* thread = (reichThread*)handle;
+  if (!thread) { return 0; }
+  pthread_join(thread->handle, NULL);
+  reich_sys_free(thread);
+  return 1;
+}
+
+REICH_API int32 reich_sys_cpu_count(void) {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int32)count : 1;
+}
+
+REICH_API reichHandle reich_sys_mutex_create(void) {
+  pthread_mutex_t* m =
+      (pthread_mutex_t*)reich_sys_alloc(sizeof(pthread_mutex_t));
+  if (m && pthread_mutex_init(m, NULL)) {
+    reich_sys_free(m);
+    return NULL;
+  }
+  return (reichHandle)m;
+}
+
+REICH_API int32 reich_sys_mutex_lock(reichHandle mutex) {
+  return pthread_mutex_lock((pthread_mutex_t*)mutex) == 0;
+}
+
+REICH_API int32 reich_sys_mutex_unlock(reichHandle mutex) {
+  return pthread_mutex_unlock((pthread_mutex_t*)mutex) == 0;
+}
+
+REICH_API int32 reich_sys_mutex_destroy(reichHandle mutex) {
+  if (!mutex) { return 0; }
+  pthread_mutex_destroy((pthread_mutex_t*)mutex);
+  reich_sys_free(mutex);
+  return 1;
+}
+
+REICH_API reichHandle reich_sys_cond_create(void) {
+  pthread_cond_t* c = (pthread_cond_t*)reich_sys_alloc(sizeof(pthread_cond_t));
+  if (c && pthread_cond_init(c, NULL)) {
+    reich_sys_free(c);
+    return NULL;
+  }
+  return (reichHandle)c;
+}
+
+REICH_API int32 reich_sys_cond_wait(reichHandle cond, reichHandle mutex) {
+  return pthread_cond_wait(
+             (pthread_cond_t*)cond, (pthread_mutex_t*)mutex) == 0;
+}
+
+REICH_API int32 reich_sys_cond_broadcast(reichHandle cond) {
+  return pthread_cond_broadcast((pthread_cond_t*)cond) == 0;
+}
+
+REICH_API int32 reich_sys_cond_destroy(reichHandle cond) {
+  if (!cond) { return 0; }
+  pthread_cond_destroy((pthread_cond_t*)cond);
+  reich_sys_free(cond);
   return 1;
 }
 
@@ -2231,6 +3267,637 @@ int32 reich_rand_bit(void) {
     return result;
 }
 
+/* JOBS **********************************************************************/
+
+/* Persistent workers park on a condition variable between batches. A batch
+ * is split into chunks and every thread starts with a contiguous share in
+ * its own deque. Owners pop from the front, idle threads steal half of a
+ * victim's remaining chunks from the back. A deque is a single 64 bit word
+ * (16 bit batch tag, 24 bit begin, 24 bit end) so both ends move with one
+ * compare-and-swap and a stale thief can never hit the next batch. */
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static int32 reich_atomic_add32(volatile int32* p, int32 v) {
+  return (int32)_InterlockedExchangeAdd((volatile long*)p, (long)v) + v;
+}
+static int32 reich_atomic_load32(volatile int32* p) {
+  return (int32)_InterlockedCompareExchange((volatile long*)p, 0, 0);
+}
+static int64 reich_atomic_load64(volatile int64* p) {
+  return _InterlockedCompareExchange64((volatile __int64*)p, 0, 0);
+}
+static void reich_atomic_store64(volatile int64* p, int64 v) {
+  _InterlockedExchange64((volatile __int64*)p, v);
+}
+static int32 reich_atomic_cas64(volatile int64* p, int64 expect, int64 v) {
+  return _InterlockedCompareExchange64((volatile __int64*)p, v, expect) ==
+      expect;
+}
+#else
+static int32 reich_atomic_add32(volatile int32* p, int32 v) {
+  return __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL);
+}
+static int32 reich_atomic_load32(volatile int32* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static int64 reich_atomic_load64(volatile int64* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static void reich_atomic_store64(volatile int64* p, int64 v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+static int32 reich_atomic_cas64(volatile int64* p, int64 expect, int64 v) {
+  return __atomic_compare_exchange_n(
+      p, &expect, v, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+#define REICH_JOB_MAX_CHUNKS 0xFFFFFF
+#define REICH_JOB_RANGE(tag, b, e)                                   \
+  ((int64)(((uint64)((tag) & 0xFFFF) << 48) |                        \
+           ((uint64)((b) & 0xFFFFFF) << 24) | (uint64)((e) & 0xFFFFFF)))
+#define REICH_JOB_TAG(r)   ((int32)(((uint64)(r) >> 48) & 0xFFFF))
+#define REICH_JOB_BEGIN(r) ((int32)(((uint64)(r) >> 24) & 0xFFFFFF))
+#define REICH_JOB_END(r)   ((int32)((uint64)(r) & 0xFFFFFF))
+
+typedef struct reichJobQueue {
+  volatile int64 range;
+  uint8 pad[56];
+} reichJobQueue;
+
+typedef struct reichJobSystem {
+  reichJobQueue queues[REICH_MAX_THREADS];
+  reichHandle threads[REICH_MAX_THREADS];
+  int32 indices[REICH_MAX_THREADS];
+  int32 threadCount;
+  reichHandle lock;
+  reichHandle wake;
+  reichHandle done;
+  int32 generation;
+  int32 running;
+  volatile int32 pending;
+  PFREICHJOB job;
+  void* data;
+  int32 count;
+  int32 chunk;
+} reichJobSystem;
+
+static reichJobSystem REICH_JOBS;
+
+static int32 reich_jobs_pop(int32 self, int32* chunk) {
+  volatile int64* q = &REICH_JOBS.queues[self].range;
+  int64 r = reich_atomic_load64(q);
+  while (REICH_JOB_BEGIN(r) < REICH_JOB_END(r)) {
+    int64 next = REICH_JOB_RANGE(
+        REICH_JOB_TAG(r), REICH_JOB_BEGIN(r) + 1, REICH_JOB_END(r));
+    if (reich_atomic_cas64(q, r, next)) {
+      *chunk = REICH_JOB_BEGIN(r);
+      return 1;
+    }
+    r = reich_atomic_load64(q);
+  }
+  return 0;
+}
+
+static int32 reich_jobs_steal(int32 self) {
+  int32 i, n = REICH_JOBS.threadCount;
+  volatile int64* own = &REICH_JOBS.queues[self].range;
+  int64 mine = reich_atomic_load64(own);
+  if (REICH_JOB_BEGIN(mine) < REICH_JOB_END(mine)) { return 1; }
+  for (i = 1; i < n; ++i) {
+    volatile int64* q = &REICH_JOBS.queues[(self + i) % n].range;
+    int64 r = reich_atomic_load64(q);
+    /* Only steal within our own batch: a thread still leaving the previous
+     * batch would otherwise clobber the deque it was just handed. */
+    while (REICH_JOB_TAG(r) == REICH_JOB_TAG(mine) &&
+           REICH_JOB_BEGIN(r) < REICH_JOB_END(r)) {
+      int32 tag = REICH_JOB_TAG(r);
+      int32 b = REICH_JOB_BEGIN(r);
+      int32 e = REICH_JOB_END(r);
+      int32 take = (e - b + 1) / 2;
+      if (reich_atomic_cas64(q, r, REICH_JOB_RANGE(tag, b, e - take))) {
+        /* Our deque is empty and the batch cannot finish while we hold
+         * these chunks, so nobody else writes it concurrently. */
+        reich_atomic_store64(own, REICH_JOB_RANGE(tag, e - take, e));
+        return 1;
+      }
+      r = reich_atomic_load64(q);
+    }
+  }
+  return 0;
+}
+
+static void reich_jobs_work(int32 self) {
+  int32 chunk;
+  do {
+    while (reich_jobs_pop(self, &chunk)) {
+      int32 start = chunk * REICH_JOBS.chunk;
+      int32 end = start + REICH_JOBS.chunk;
+      if (end > REICH_JOBS.count) { end = REICH_JOBS.count; }
+      REICH_JOBS.job(REICH_JOBS.data, start, end, self);
+      if (reich_atomic_add32(&REICH_JOBS.pending, -1) == 0) {
+        reich_sys_mutex_lock(REICH_JOBS.lock);
+        reich_sys_cond_broadcast(REICH_JOBS.done);
+        reich_sys_mutex_unlock(REICH_JOBS.lock);
+      }
+    }
+  } while (reich_jobs_steal(self));
+}
+
+static int32 reich_jobs_worker(void* arg) {
+  int32 self = *(int32*)arg;
+  int32 seen = 0, running;
+  for (;;) {
+    reich_sys_mutex_lock(REICH_JOBS.lock);
+    while (REICH_JOBS.running && REICH_JOBS.generation == seen) {
+      reich_sys_cond_wait(REICH_JOBS.wake, REICH_JOBS.lock);
+    }
+    seen = REICH_JOBS.generation;
+    running = REICH_JOBS.running;
+    reich_sys_mutex_unlock(REICH_JOBS.lock);
+    if (!running) { break; }
+    reich_jobs_work(self);
+  }
+  return 0;
+}
+
+REICH_API int32 reich_jobs_init(int32 threadCount) {
+  int32 t;
+  if (REICH_JOBS.threadCount > 0) { reich_jobs_shutdown(); }
+  if (threadCount <= 0) { threadCount = reich_sys_cpu_count(); }
+  if (threadCount > REICH_MAX_THREADS) { threadCount = REICH_MAX_THREADS; }
+  if (threadCount < 1) { threadCount = 1; }
+  reich_memset(&REICH_JOBS, 0, sizeof(REICH_JOBS));
+  REICH_JOBS.threadCount = 1;
+  if (threadCount == 1) { return 1; }
+
+  REICH_JOBS.lock = reich_sys_mutex_create();
+  REICH_JOBS.wake = reich_sys_cond_create();
+  REICH_JOBS.done = reich_sys_cond_create();
+  if (!REICH_JOBS.lock || !REICH_JOBS.wake || !REICH_JOBS.done) {
+    reich_sys_log(REICH_LOG_ERROR, "Jobs: Failed to create sync objects");
+    reich_jobs_shutdown();
+    return 0;
+  }
+  REICH_JOBS.running = 1;
+  REICH_JOBS.threadCount = threadCount;
+  for (t = 1; t < threadCount; ++t) {
+    REICH_JOBS.indices[t] = t;
+    REICH_JOBS.threads[t] =
+        reich_sys_thread_create(reich_jobs_worker, &REICH_JOBS.indices[t]);
+    if (!REICH_JOBS.threads[t]) {
+      reich_sys_log(REICH_LOG_ERROR, "Jobs: Failed to start worker %d", t);
+      REICH_JOBS.threadCount = t;
+      break;
+    }
+  }
+  return 1;
+}
+
+REICH_API int32 reich_jobs_shutdown(void) {
+  int32 t;
+  if (REICH_JOBS.lock) {
+    reich_sys_mutex_lock(REICH_JOBS.lock);
+    REICH_JOBS.running = 0;
+    reich_sys_mutex_unlock(REICH_JOBS.lock);
+    reich_sys_cond_broadcast(REICH_JOBS.wake);
+  }
+  for (t = 1; t < REICH_MAX_THREADS; ++t) {
+    if (REICH_JOBS.threads[t]) {
+      reich_sys_thread_join(REICH_JOBS.threads[t]);
+    }
+  }
+  if (REICH_JOBS.lock) { reich_sys_mutex_destroy(REICH_JOBS.lock); }
+  if (REICH_JOBS.wake) { reich_sys_cond_destroy(REICH_JOBS.wake); }
+  if (REICH_JOBS.done) { reich_sys_cond_destroy(REICH_JOBS.done); }
+  reich_memset(&REICH_JOBS, 0, sizeof(REICH_JOBS));
+  return 1;
+}
+
+REICH_API int32 reich_jobs_thread_count(void) {
+  return REICH_JOBS.threadCount > 0 ? REICH_JOBS.threadCount : 1;
+}
+
+/* Runs job over [0, count) in chunks and returns when every chunk is done.
+ * The calling thread works too and is passed as thread 0. A chunk of zero
+ * picks roughly eight chunks per thread. Not reentrant: call it from one
+ * thread at a time and never from inside a job. */
+REICH_API int32 reich_jobs_parallel_for(
+    int32 count, int32 chunk, PFREICHJOB job, void* data) {
+  int32 t, n, chunks, per, rem, begin, tag;
+  if (count <= 0 || !job) { return 0; }
+  n = reich_jobs_thread_count();
+  if (chunk <= 0) { chunk = count / (n * 8); }
+  if (chunk < 1) { chunk = 1; }
+  if (count / chunk >= REICH_JOB_MAX_CHUNKS) {
+    chunk = count / (REICH_JOB_MAX_CHUNKS - 1) + 1;
+  }
+  chunks = (count + chunk - 1) / chunk;
+  if (n <= 1 || chunks <= 1) {
+    job(data, 0, count, 0);
+    return 1;
+  }
+
+  REICH_JOBS.job = job;
+  REICH_JOBS.data = data;
+  REICH_JOBS.count = count;
+  REICH_JOBS.chunk = chunk;
+  reich_atomic_add32(&REICH_JOBS.pending, chunks);
+
+  reich_sys_mutex_lock(REICH_JOBS.lock);
+  tag = ++REICH_JOBS.generation;
+  per = chunks / n;
+  rem = chunks % n;
+  begin = 0;
+  for (t = 0; t < n; ++t) {
+    int32 end = begin + per + (t < rem ? 1 : 0);
+    reich_atomic_store64(
+        &REICH_JOBS.queues[t].range, REICH_JOB_RANGE(tag, begin, end));
+    begin = end;
+  }
+  reich_sys_mutex_unlock(REICH_JOBS.lock);
+  reich_sys_cond_broadcast(REICH_JOBS.wake);
+
+  reich_jobs_work(0);
+
+  reich_sys_mutex_lock(REICH_JOBS.lock);
+  while (reich_atomic_load32(&REICH_JOBS.pending) > 0) {
+    reich_sys_cond_wait(REICH_JOBS.done, REICH_JOBS.lock);
+  }
+  reich_sys_mutex_unlock(REICH_JOBS.lock);
+  return 1;
+}
+
+/* PROFILER ******************************************************************/
+
+/* Zones are recorded into a ring of frame records. Each thread has its own
+ * zone stack (thread 0 is the caller of reich_run, workers use their job
+ * thread index) and claims slots in the current frame atomically. Draw
+ * calls charge calls and pixels to ctx->prof, which is folded into the
+ * frame record when the frame ends. Define REICH_NO_PROFILE to compile
+ * the draw counters out. */
+
+#ifndef REICH_NO_PROFILE
+#define REICH_PROF_PRIM(ctx, id)         \
+  do {                                   \
+    (ctx)->prof.prim = (id);             \
+    (ctx)->prof.prims[(id)].calls++;     \
+  } while (0)
+#define REICH_PROF_PIXELS(ctx, n, alpha)                          \
+  do {                                                            \
+    if ((alpha) == 255) {                                         \
+      (ctx)->prof.prims[(ctx)->prof.prim].opaque += (uint32)(n);  \
+    } else {                                                      \
+      (ctx)->prof.prims[(ctx)->prof.prim].blended += (uint32)(n); \
+    }                                                             \
+  } while (0)
+#else
+#define REICH_PROF_PRIM(ctx, id)         ((void)0)
+#define REICH_PROF_PIXELS(ctx, n, alpha) ((void)0)
+#endif
+
+typedef struct reichProfStackEntry {
+  const char* name;
+  int64 start;
+} reichProfStackEntry;
+
+typedef struct reichProfiler {
+  int32 enabled;
+  int64 freq;
+  reichProfFrame* frames;
+  int32 head;     /* Frame being recorded */
+  int32 recorded; /* Completed frames in the ring */
+  int32 depth[REICH_MAX_THREADS];
+  reichProfStackEntry stack[REICH_MAX_THREADS][REICH_PROF_MAX_DEPTH];
+} reichProfiler;
+
+static reichProfiler REICH_PROF;
+
+static const char* REICH_PRIM_NAMES[REICH_PRIM_COUNT] = {
+    "pixel",
+    "clear",
+    "line",
+    "rect",
+    "ellipse",
+    "triangle",
+    "textured",
+    "quad",
+    "curve",
+    "text",
+    "canvas",
+    "glass"};
+
+REICH_API const char* reich_prof_prim_name(int32 prim) {
+  if (prim < 0 || prim >= REICH_PRIM_COUNT) { return "?"; }
+  return REICH_PRIM_NAMES[prim];
+}
+
+REICH_API int32 reich_prof_enable(reichContext* ctx, int32 enable) {
+  if (!ctx) { return 0; }
+  if (enable && !REICH_PROF.frames) {
+    REICH_PROF.frames = (reichProfFrame*)reich_arena_alloc(
+        &ctx->permMem, sizeof(reichProfFrame) * REICH_PROF_FRAMES);
+    if (!REICH_PROF.frames) {
+      reich_sys_log(REICH_LOG_ERROR, "Profiler: out of memory");
+      return 0;
+    }
+    REICH_PROF.head = 0;
+    REICH_PROF.recorded = 0;
+    REICH_PROF.frames[0].start = reich_sys_get_ticks();
+    REICH_PROF.frames[0].zoneCount = 0;
+  }
+  REICH_PROF.freq = ctx->perfFreq ? ctx->perfFreq : reich_sys_get_freq();
+  REICH_PROF.enabled = enable ? 1 : 0;
+  return 1;
+}
+
+REICH_API int32 reich_prof_begin_thread(int32 thread, const char* name) {
+  int32 d;
+  if (!REICH_PROF.enabled || thread < 0 || thread >= REICH_MAX_THREADS) {
+    return 0;
+  }
+  d = REICH_PROF.depth[thread]++;
+  if (d < REICH_PROF_MAX_DEPTH) {
+    REICH_PROF.stack[thread][d].name = name;
+    REICH_PROF.stack[thread][d].start = reich_sys_get_ticks();
+  }
+  return 1;
+}
+
+REICH_API int32 reich_prof_end_thread(int32 thread) {
+  reichProfFrame* frame;
+  reichProfZone* zone;
+  int32 d, slot;
+  int64 end;
+  if (!REICH_PROF.enabled || thread < 0 || thread >= REICH_MAX_THREADS ||
+      REICH_PROF.depth[thread] <= 0) {
+    return 0;
+  }
+  end = reich_sys_get_ticks();
+  d = --REICH_PROF.depth[thread];
+  if (d >= REICH_PROF_MAX_DEPTH) { return 1; }
+  frame = &REICH_PROF.frames[REICH_PROF.head];
+  slot = reich_atomic_add32(&frame->zoneCount, 1) - 1;
+  if (slot >= REICH_PROF_MAX_ZONES) { return 1; }
+  zone = &frame->zones[slot];
+  zone->name = REICH_PROF.stack[thread][d].name;
+  zone->start = REICH_PROF.stack[thread][d].start;
+  zone->end = end;
+  zone->thread = thread;
+  zone->depth = d;
+  return 1;
+}
+
+REICH_API int32 reich_prof_begin(const char* name) {
+  return reich_prof_begin_thread(0, name);
+}
+
+REICH_API int32 reich_prof_end(void) {
+  return reich_prof_end_thread(0);
+}
+
+REICH_API int32 reich_prof_frame_begin(reichContext* ctx) {
+  reichProfFrame* frame;
+  int32 i;
+  if (!REICH_PROF.enabled) { return 0; }
+  frame = &REICH_PROF.frames[REICH_PROF.head];
+  frame->start = reich_sys_get_ticks();
+  frame->zoneCount = 0;
+  for (i = 0; i < REICH_MAX_THREADS; ++i) { REICH_PROF.depth[i] = 0; }
+  (void)ctx;
+  return 1;
+}
+
+REICH_API int32 reich_prof_frame_end(reichContext* ctx) {
+  reichProfFrame* frame;
+  if (REICH_PROF.enabled) {
+    frame = &REICH_PROF.frames[REICH_PROF.head];
+    frame->end = reich_sys_get_ticks();
+    if (frame->zoneCount > REICH_PROF_MAX_ZONES) {
+      frame->zoneCount = REICH_PROF_MAX_ZONES;
+    }
+    reich_memcpy(frame->prims, ctx->prof.prims, sizeof(frame->prims));
+    REICH_PROF.head = (REICH_PROF.head + 1) % REICH_PROF_FRAMES;
+    if (REICH_PROF.recorded < REICH_PROF_FRAMES - 1) { REICH_PROF.recorded++; }
+  }
+  reich_memset(ctx->prof.prims, 0, sizeof(ctx->prof.prims));
+  return 1;
+}
+
+REICH_API const reichProfFrame* reich_prof_frame(int32 ago) {
+  if (!REICH_PROF.frames || ago < 0 || ago >= REICH_PROF.recorded) {
+    return NULL;
+  }
+  return &REICH_PROF.frames[
+      (REICH_PROF.head - 1 - ago + 2 * REICH_PROF_FRAMES) % REICH_PROF_FRAMES];
+}
+
+/* Worker contexts start from a copy of the frame context with empty
+ * counters and dirty tiles; joining folds both back into the parent. */
+REICH_API int32
+reich_context_fork(reichContext* dst, const reichContext* src) {
+  reich_memcpy(dst, src, sizeof(reichContext));
+  reich_memset(&dst->prof.prims, 0, sizeof(dst->prof.prims));
+  reich_dirty_reset(dst);
+  return 1;
+}
+
+REICH_API int32 reich_context_join(reichContext* ctx, reichContext* src) {
+  int32 i;
+  reich_dirty_merge(ctx, src);
+  for (i = 0; i < REICH_PRIM_COUNT; ++i) {
+    ctx->prof.prims[i].calls += src->prof.prims[i].calls;
+    ctx->prof.prims[i].opaque += src->prof.prims[i].opaque;
+    ctx->prof.prims[i].blended += src->prof.prims[i].blended;
+  }
+  reich_memset(&src->prof.prims, 0, sizeof(src->prof.prims));
+  return 1;
+}
+
+static real64 reich_prof_ms(int64 ticks) {
+  return REICH_PROF.freq ? (real64)ticks * 1000.0 / (real64)REICH_PROF.freq
+                         : 0.0;
+}
+
+/* Frame time graph of the ring, the last frame's thread 0 top-level zones
+ * and per-thread busy time, then the draw counters. */
+REICH_API int32 reich_prof_draw_overlay(reichContext* ctx, int32 x, int32 y) {
+  const reichProfFrame* last = reich_prof_frame(0);
+  const reichProfFrame* f;
+  const reichProfZone* z;
+  real64 ms, sum, peak, busy[REICH_MAX_THREADS];
+  char line[128];
+  int32 i, j, n, lineH, rows, w, h, barH, threads;
+  uint32 pixels;
+
+  if (!ctx || !last) { return 0; }
+  lineH = 10;
+  if (ctx->activeFont < ctx->fontCount) {
+    lineH = ctx->fonts[ctx->activeFont][1] + 2;
+  }
+  n = REICH_PROF.recorded;
+  sum = 0.0;
+  peak = 0.0;
+  for (i = 0; i < n; ++i) {
+    f = reich_prof_frame(i);
+    ms = reich_prof_ms(f->end - f->start);
+    sum += ms;
+    if (ms > peak) { peak = ms; }
+  }
+
+  threads = 0;
+  for (i = 0; i < REICH_MAX_THREADS; ++i) { busy[i] = 0.0; }
+  rows = 1;
+  for (i = 0; i < last->zoneCount; ++i) {
+    z = &last->zones[i];
+    if (z->depth != 0) { continue; }
+    if (z->thread == 0) { rows++; }
+    busy[z->thread] += reich_prof_ms(z->end - z->start);
+    if (z->thread + 1 > threads) { threads = z->thread + 1; }
+  }
+  rows += threads > 1 ? threads : 0;
+  for (i = 0; i < REICH_PRIM_COUNT; ++i) {
+    if (last->prims[i].calls) { rows++; }
+  }
+
+  w = 260;
+  barH = 32;
+  h = barH + 8 + rows * lineH + 4;
+  reich_draw_rect_fill(
+      ctx, (float)x, (float)y, (float)w, (float)h, 0xC0101010);
+
+  /* Bars scale so 33 ms fills the graph. */
+  for (i = 0; i < n && i < w - 8; ++i) {
+    f = reich_prof_frame(i);
+    ms = reich_prof_ms(f->end - f->start);
+    j = (int32)(ms * (real64)barH / 33.3);
+    if (j > barH) { j = barH; }
+    reich_draw_rect_fill(
+        ctx,
+        (float)(x + w - 4 - (i + 1) * 3),
+        (float)(y + 4 + barH - j),
+        2.0f,
+        (float)j,
+        ms > 16.7 ? 0xFFE04040 : 0xFF40C040);
+  }
+  y += barH + 8;
+
+  reich_string_format(
+      line,
+      (int32)sizeof(line),
+      "frame %.2f ms  avg %.2f  max %.2f",
+      reich_prof_ms(last->end - last->start),
+      n ? sum / (real64)n : 0.0,
+      peak);
+  reich_draw_text(ctx, x + 4, y, line, 0xFFFFFFFF);
+  y += lineH;
+  for (i = 0; i < last->zoneCount; ++i) {
+    z = &last->zones[i];
+    if (z->depth != 0 || z->thread != 0) { continue; }
+    reich_string_format(
+        line,
+        (int32)sizeof(line),
+        "  %s %.2f ms",
+        z->name,
+        reich_prof_ms(z->end - z->start));
+    reich_draw_text(ctx, x + 4, y, line, 0xFFC0C0C0);
+    y += lineH;
+  }
+  for (i = 0; threads > 1 && i < threads; ++i) {
+    reich_string_format(
+        line, (int32)sizeof(line), "  thread %d busy %.2f ms", i, busy[i]);
+    reich_draw_text(ctx, x + 4, y, line, 0xFF80C0FF);
+    y += lineH;
+  }
+  for (i = 0; i < REICH_PRIM_COUNT; ++i) {
+    if (!last->prims[i].calls) { continue; }
+    pixels = last->prims[i].opaque + last->prims[i].blended;
+    reich_string_format(
+        line,
+        (int32)sizeof(line),
+        "  %s %d calls %dk px (%d%% blended)",
+        REICH_PRIM_NAMES[i],
+        (int32)last->prims[i].calls,
+        (int32)(pixels / 1000),
+        pixels ? (int32)((real64)last->prims[i].blended * 100.0 /
+                         (real64)pixels)
+               : 0);
+    reich_draw_text(ctx, x + 4, y, line, 0xFFFFE080);
+    y += lineH;
+  }
+  return 1;
+}
+
+static int32 reich_prof_write(reichHandle f, const char* str) {
+  reichSize len = reich_strlen(str);
+  return reich_sys_file_write(f, str, len) == len;
+}
+
+/* Writes the recorded frames as Chrome trace events (chrome://tracing or
+ * Perfetto): one complete event per frame and zone, and a counter track
+ * with the pixels each frame pushed through the draw calls. */
+REICH_API int32 reich_prof_dump_trace(const char* filename) {
+  const reichProfFrame* f;
+  const reichProfZone* z;
+  reichHandle file;
+  char line[256];
+  int64 base;
+  int32 i, j, ok;
+  uint32 opaque, blended;
+
+  if (!REICH_PROF.recorded) { return 0; }
+  file = reich_sys_file_open(filename, REICH_FILE_WRITE);
+  if (!file) {
+    reich_sys_log(REICH_LOG_ERROR, "Profiler: failed to open %s", filename);
+    return 0;
+  }
+  base = reich_prof_frame(REICH_PROF.recorded - 1)->start;
+  ok = reich_prof_write(file, "{\"traceEvents\":[\n");
+  for (i = REICH_PROF.recorded - 1; i >= 0 && ok; --i) {
+    f = reich_prof_frame(i);
+    opaque = 0;
+    blended = 0;
+    for (j = 0; j < REICH_PRIM_COUNT; ++j) {
+      opaque += f->prims[j].opaque;
+      blended += f->prims[j].blended;
+    }
+    reich_string_format(
+        line,
+        (int32)sizeof(line),
+        "{\"name\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,"
+        "\"ts\":%.3f,\"dur\":%.3f},\n"
+        "{\"name\":\"pixels\",\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,"
+        "\"args\":{\"opaque\":%d,\"blended\":%d}}",
+        reich_prof_ms(f->start - base) * 1000.0,
+        reich_prof_ms(f->end - f->start) * 1000.0,
+        reich_prof_ms(f->start - base) * 1000.0,
+        (int32)opaque,
+        (int32)blended);
+    ok = reich_prof_write(file, line);
+    for (j = 0; j < f->zoneCount && ok; ++j) {
+      z = &f->zones[j];
+      reich_string_format(
+          line,
+          (int32)sizeof(line),
+          ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+          "\"ts\":%.3f,\"dur\":%.3f}",
+          z->name,
+          z->thread,
+          reich_prof_ms(z->start - base) * 1000.0,
+          reich_prof_ms(z->end - z->start) * 1000.0);
+      ok = reich_prof_write(file, line);
+    }
+    if (ok) { ok = reich_prof_write(file, i > 0 ? ",\n" : "\n"); }
+  }
+  if (ok) { ok = reich_prof_write(file, "]}\n"); }
+  reich_sys_file_close(file);
+  if (!ok) {
+    reich_sys_log(REICH_LOG_ERROR, "Profiler: failed to write %s", filename);
+  }
+  return ok;
+}
+
 /* TIMING ********************************************************************/
 
 REICH_API int32 reich_timer_tick(reichContext* ctx) {
@@ -2281,12 +3948,37 @@ REICH_API int32 reich_begin_frame(reichContext* ctx) {
   ctx->clip = reich_rect(0, 0, ctx->canvas.width, ctx->canvas.height);
   reich_arena_reset(&ctx->frameMem);
   reich_dirty_reset(ctx);
+  reich_prof_frame_begin(ctx);
   return 1;
 }
 
 REICH_API int32 reich_end_frame(reichContext* ctx) {
+  reichPresentStats* stats = &ctx->presentStats;
+  reichRect* r;
+  int32 i;
   reich_draw_decorations(ctx);
+  reich_dirty_collect(ctx);
+  if (ctx->presentRectCount < 0) {
+    stats->rectsPushed = 1;
+    stats->pixelsPushed = ctx->canvas.width * ctx->canvas.height;
+  } else {
+    stats->rectsPushed = ctx->presentRectCount;
+    stats->pixelsPushed = 0;
+    for (i = 0; i < ctx->presentRectCount; ++i) {
+      r = &ctx->presentRects[i];
+      stats->pixelsPushed += (r->x2 - r->x1) * (r->y2 - r->y1);
+    }
+  }
+  if (stats->rectsPushed > 0) {
+    stats->framesPresented++;
+  } else {
+    stats->framesSkipped++;
+  }
+  stats->totalPixelsPushed += stats->pixelsPushed;
+  reich_prof_begin("present");
   reich_sys_present(ctx);
+  reich_prof_end();
+  reich_prof_frame_end(ctx);
   return 1;
 }
 
@@ -2405,12 +4097,14 @@ REICH_API int32 reich_init(
 
   reich_memset(ctx, 0, sizeof(reichContext));
   ctx->scale = 1;
+  ctx->presentRectCount = -1;
   ctx->windowTitle = title;
   ctx->windowWidth = width;
   ctx->windowHeight = height;
   ctx->running = 1;
   ctx->fixedDt = 1.0 / targetFps;
   ctx->perfFreq = reich_sys_get_freq();
+  reich_simd_set_level(-1);
   ctx->lastCounter = reich_sys_get_ticks();
 
   memSize = (reichSize)1024 * 1024 * 1024;
@@ -2465,11 +4159,17 @@ REICH_API int32 reich_run(reichContext* ctx) {
   while (ctx->running) {
     if (!reich_begin_frame(ctx)) { break; }
     reich_timer_tick(ctx);
+    reich_prof_begin("update");
     while (reich_timer_step(ctx)) {
       if (ctx->userUpdate) { ctx->userUpdate(ctx); }
     }
+    reich_prof_end();
+    reich_prof_begin("input");
     if (ctx->userInput) { ctx->userInput(ctx); }
+    reich_prof_end();
+    reich_prof_begin("render");
     if (ctx->userRender) { ctx->userRender(ctx, reich_timer_alpha(ctx)); }
+    reich_prof_end();
     reich_end_frame(ctx);
   }
   return 1;
@@ -2810,6 +4510,84 @@ REICH_API reichCanvas reich_load_bmp(const char* filename) {
   return canvas;
 }
 
+REICH_API reichCanvas reich_load_bmp_ex(const char* filename, int32 format) {
+  reichCanvas canvas = reich_load_bmp(filename);
+  if (canvas.pixels && format == REICH_FORMAT_PREMUL) {
+    reich_canvas_premultiply(&canvas);
+  }
+  return canvas;
+}
+
+static void reich_put_u32(uint8* p, uint32 v) {
+  p[0] = (uint8)(v & 0xFF);
+  p[1] = (uint8)((v >> 8) & 0xFF);
+  p[2] = (uint8)((v >> 16) & 0xFF);
+  p[3] = (uint8)((v >> 24) & 0xFF);
+}
+
+REICH_API int32 reich_save_bmp(const char* filename, reichCanvas* canvas) {
+  uint8 header[54];
+  uint32 imageSize;
+  reichHandle f;
+  if (!canvas || !canvas->pixels || canvas->width <= 0 ||
+      canvas->height <= 0) {
+    return 0;
+  }
+  imageSize = (uint32)canvas->width * (uint32)canvas->height * 4;
+  reich_memset(header, 0, sizeof(header));
+  header[0] = 'B';
+  header[1] = 'M';
+  reich_put_u32(header + 2, 54 + imageSize);
+  reich_put_u32(header + 10, 54);
+  reich_put_u32(header + 14, 40);
+  reich_put_u32(header + 18, (uint32)canvas->width);
+  reich_put_u32(header + 22, (uint32)-canvas->height);
+  header[26] = 1;
+  header[28] = 32;
+  reich_put_u32(header + 34, imageSize);
+  f = reich_sys_file_open(filename, REICH_FILE_WRITE);
+  if (!f) {
+    reich_sys_log(
+        REICH_LOG_ERROR, "BMP Save: Failed to open file %s", filename);
+    return 0;
+  }
+  if (reich_sys_file_write(f, header, sizeof(header)) != sizeof(header)) {
+    reich_sys_log(REICH_LOG_ERROR, "BMP Save: Failed to write %s", filename);
+    reich_sys_file_close(f);
+    return 0;
+  }
+  if (canvas->format == REICH_FORMAT_PREMUL) {
+    /* BMP stores straight alpha, convert one row at a time. */
+    uint32 rowSize = (uint32)canvas->width * 4;
+    uint32* row = (uint32*)reich_sys_alloc(rowSize);
+    int32 x, y;
+    if (!row) {
+      reich_sys_file_close(f);
+      return 0;
+    }
+    for (y = 0; y < canvas->height; ++y) {
+      uint32* src = canvas->pixels + y * canvas->width;
+      for (x = 0; x < canvas->width; ++x) {
+        row[x] = reich_color_unpremultiply(src[x]);
+      }
+      if (reich_sys_file_write(f, row, rowSize) != rowSize) { break; }
+    }
+    reich_sys_free(row);
+    if (y < canvas->height) {
+      reich_sys_log(
+          REICH_LOG_ERROR, "BMP Save: Failed to write %s", filename);
+      reich_sys_file_close(f);
+      return 0;
+    }
+  } else if (reich_sys_file_write(f, canvas->pixels, imageSize) != imageSize) {
+    reich_sys_log(REICH_LOG_ERROR, "BMP Save: Failed to write %s", filename);
+    reich_sys_file_close(f);
+    return 0;
+  }
+  reich_sys_file_close(f);
+  return 1;
+}
+
 REICH_API uint8* reich_font_import(
     reichArena* a,
     uint32* pixels,
@@ -3013,7 +4791,12 @@ static const real32 REICH_GAUSS_NORM[25] = {
 #define REICH_DRAW_PIXEL_FAST(ctx, px, py, color)                          \
   do {                                                                     \
     uint32* _p = &(ctx)->canvas.pixels[(py) * (ctx)->canvas.width + (px)]; \
-    REICH_BLEND_FAST(color, *_p);                                          \
+    if ((ctx)->canvas.format == REICH_FORMAT_PREMUL) {                     \
+      REICH_BLEND_PREMUL(color, *_p);                                      \
+    } else {                                                               \
+      REICH_BLEND_FAST(color, *_p);                                        \
+    }                                                                      \
+    REICH_PROF_PIXELS(ctx, 1, REICH_GET_A(color));                         \
   } while (0)
 
 REICH_API uint32 reich_color_lerp(uint32 c1, uint32 c2, float t) {
@@ -3052,6 +4835,47 @@ REICH_API uint32 reich_color_lerp(uint32 c1, uint32 c2, float t) {
     }                                                               \
   } while (0)
 
+/* Premultiplied destinations composite without any per-pixel divide. */
+
+#define REICH_PREMUL(c)                                                 \
+  ((REICH_GET_A(c) << 24) |                                             \
+   (REICH_DIV255(REICH_GET_R(c) * REICH_GET_A(c)) << 16) |              \
+   (REICH_DIV255(REICH_GET_G(c) * REICH_GET_A(c)) << 8) |               \
+   REICH_DIV255(REICH_GET_B(c) * REICH_GET_A(c)))
+
+#define REICH_BLEND_PREMUL(src, dst)                                      \
+  do {                                                                    \
+    uint32 sa = REICH_GET_A(src);                                         \
+    if (sa == 255) {                                                      \
+      dst = src;                                                          \
+    } else if (sa > 0) {                                                  \
+      uint32 inv_sa = 255 - sa;                                           \
+      uint32 a = REICH_DIV255(255 * sa + REICH_GET_A(dst) * inv_sa);      \
+      uint32 r =                                                          \
+          REICH_DIV255(REICH_GET_R(src) * sa + REICH_GET_R(dst) * inv_sa); \
+      uint32 g =                                                          \
+          REICH_DIV255(REICH_GET_G(src) * sa + REICH_GET_G(dst) * inv_sa); \
+      uint32 b =                                                          \
+          REICH_DIV255(REICH_GET_B(src) * sa + REICH_GET_B(dst) * inv_sa); \
+      dst = (a << 24) | (r << 16) | (g << 8) | b;                         \
+    }                                                                     \
+  } while (0)
+
+#define REICH_BLEND_PREMUL_OVER(src, dst)                              \
+  do {                                                                 \
+    uint32 sa = REICH_GET_A(src);                                      \
+    if (sa == 255) {                                                   \
+      dst = src;                                                       \
+    } else if (src) {                                                  \
+      uint32 inv_sa = 255 - sa;                                        \
+      uint32 a = sa + REICH_DIV255(REICH_GET_A(dst) * inv_sa);         \
+      uint32 r = REICH_GET_R(src) + REICH_DIV255(REICH_GET_R(dst) * inv_sa); \
+      uint32 g = REICH_GET_G(src) + REICH_DIV255(REICH_GET_G(dst) * inv_sa); \
+      uint32 b = REICH_GET_B(src) + REICH_DIV255(REICH_GET_B(dst) * inv_sa); \
+      dst = (a << 24) | (r << 16) | (g << 8) | b;                      \
+    }                                                                  \
+  } while (0)
+
 real32 reich_blend_colour(
     real32 base, real32 blend, real32 alpha, int32 mode) {
   real32 res = base;
@@ -3069,6 +4893,469 @@ real32 reich_blend_colour(
   return base * (1.0f - alpha) + res * alpha;
 }
 
+/* DRAW::SPAN ****************************************************************/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define REICH_SIMD_X86
+#define REICH_TARGET_AVX2 __attribute__((target("avx2")))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define REICH_SIMD_X86
+#define REICH_TARGET_AVX2
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+typedef void (*PFREICHSPAN)(uint32* dst, int32 count, uint32 color);
+
+static void reich_span_fill_scalar(uint32* p, int32 n, uint32 color) {
+  while (n >= 4) {
+    *p++ = color;
+    *p++ = color;
+    *p++ = color;
+    *p++ = color;
+    n -= 4;
+  }
+  while (n-- > 0) { *p++ = color; }
+}
+
+static void reich_span_blend_scalar(uint32* p, int32 n, uint32 color) {
+  while (n-- > 0) {
+    REICH_BLEND_FAST(color, *p);
+    p++;
+  }
+}
+
+static void
+reich_span_blend_premul_scalar(uint32* p, int32 n, uint32 color) {
+  while (n-- > 0) {
+    REICH_BLEND_PREMUL(color, *p);
+    p++;
+  }
+}
+
+#if defined(REICH_SIMD_X86)
+
+/* The vector blends reproduce REICH_BLEND_FAST bit for bit. Every product
+ * stays below 2^24, so the float multiplies are exact, and the final
+ * quotient is never closer than 1/65025 to the next integer, so a single
+ * precision divide truncates to the same value as the integer divide. */
+
+#define REICH_DIV255_EPI32(x, one) \
+  _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 8)), one), 8)
+
+static __m128i reich_blend4_sse2(
+    __m128i d,
+    __m128i sa,
+    __m128 inv,
+    __m128i sr,
+    __m128i sg,
+    __m128i sb,
+    __m128i mask,
+    __m128i one) {
+  __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(d, 24)), inv);
+  __m128i oa = _mm_add_epi32(sa, REICH_DIV255_EPI32(_mm_cvtps_epi32(t), one));
+  __m128 oaf = _mm_cvtepi32_ps(oa);
+  __m128i dr = _mm_and_si128(_mm_srli_epi32(d, 16), mask);
+  __m128i dg = _mm_and_si128(_mm_srli_epi32(d, 8), mask);
+  __m128i db = _mm_and_si128(d, mask);
+  __m128i r, g, b;
+  dr = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(dr), t));
+  dg = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(dg), t));
+  db = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(db), t));
+  r = _mm_add_epi32(sr, REICH_DIV255_EPI32(dr, one));
+  g = _mm_add_epi32(sg, REICH_DIV255_EPI32(dg, one));
+  b = _mm_add_epi32(sb, REICH_DIV255_EPI32(db, one));
+  r = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(r), oaf));
+  g = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(g), oaf));
+  b = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(b), oaf));
+  return _mm_or_si128(
+      _mm_or_si128(_mm_slli_epi32(oa, 24), _mm_slli_epi32(r, 16)),
+      _mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+static void reich_span_fill_sse2(uint32* p, int32 n, uint32 color) {
+  __m128i c = _mm_set1_epi32((int)color);
+  while (n >= 16) {
+    _mm_storeu_si128((__m128i*)(p + 0), c);
+    _mm_storeu_si128((__m128i*)(p + 4), c);
+    _mm_storeu_si128((__m128i*)(p + 8), c);
+    _mm_storeu_si128((__m128i*)(p + 12), c);
+    p += 16;
+    n -= 16;
+  }
+  while (n >= 4) {
+    _mm_storeu_si128((__m128i*)p, c);
+    p += 4;
+    n -= 4;
+  }
+  while (n-- > 0) { *p++ = color; }
+}
+
+static void reich_span_blend_sse2(uint32* p, int32 n, uint32 color) {
+  uint32 a = REICH_GET_A(color);
+  __m128i sa, sr, sg, sb, mask, one;
+  __m128 inv;
+  if (a == 255) {
+    reich_span_fill_sse2(p, n, color);
+    return;
+  }
+  if (a == 0) { return; }
+  sa = _mm_set1_epi32((int)a);
+  inv = _mm_set1_ps((float)(255 - a));
+  sr = _mm_set1_epi32((int)(REICH_GET_R(color) * a));
+  sg = _mm_set1_epi32((int)(REICH_GET_G(color) * a));
+  sb = _mm_set1_epi32((int)(REICH_GET_B(color) * a));
+  mask = _mm_set1_epi32(0xFF);
+  one = _mm_set1_epi32(1);
+  while (n >= 8) {
+    __m128i d0 = _mm_loadu_si128((__m128i*)(p + 0));
+    __m128i d1 = _mm_loadu_si128((__m128i*)(p + 4));
+    d0 = reich_blend4_sse2(d0, sa, inv, sr, sg, sb, mask, one);
+    d1 = reich_blend4_sse2(d1, sa, inv, sr, sg, sb, mask, one);
+    _mm_storeu_si128((__m128i*)(p + 0), d0);
+    _mm_storeu_si128((__m128i*)(p + 4), d1);
+    p += 8;
+    n -= 8;
+  }
+  reich_span_blend_scalar(p, n, color);
+}
+
+/* Premultiplied blends fit in 16 bit lanes: c * inv_sa + s * sa <= 65025. */
+
+static __m128i
+reich_blend_premul4_sse2(__m128i d, __m128i s, __m128i inv, __m128i one) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_unpacklo_epi8(d, zero);
+  __m128i hi = _mm_unpackhi_epi8(d, zero);
+  lo = _mm_add_epi16(_mm_mullo_epi16(lo, inv), s);
+  hi = _mm_add_epi16(_mm_mullo_epi16(hi, inv), s);
+  lo = _mm_add_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), one);
+  hi = _mm_add_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), one);
+  return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+static void reich_span_blend_premul_sse2(uint32* p, int32 n, uint32 color) {
+  uint32 a = REICH_GET_A(color);
+  __m128i s, inv, one;
+  if (a == 255) {
+    reich_span_fill_sse2(p, n, color);
+    return;
+  }
+  if (a == 0) { return; }
+  s = _mm_set_epi16(
+      (short)(255 * a),
+      (short)(REICH_GET_R(color) * a),
+      (short)(REICH_GET_G(color) * a),
+      (short)(REICH_GET_B(color) * a),
+      (short)(255 * a),
+      (short)(REICH_GET_R(color) * a),
+      (short)(REICH_GET_G(color) * a),
+      (short)(REICH_GET_B(color) * a));
+  inv = _mm_set1_epi16((short)(255 - a));
+  one = _mm_set1_epi16(1);
+  while (n >= 8) {
+    __m128i d0 = _mm_loadu_si128((__m128i*)(p + 0));
+    __m128i d1 = _mm_loadu_si128((__m128i*)(p + 4));
+    d0 = reich_blend_premul4_sse2(d0, s, inv, one);
+    d1 = reich_blend_premul4_sse2(d1, s, inv, one);
+    _mm_storeu_si128((__m128i*)(p + 0), d0);
+    _mm_storeu_si128((__m128i*)(p + 4), d1);
+    p += 8;
+    n -= 8;
+  }
+  if (n >= 4) {
+    __m128i d0 = _mm_loadu_si128((__m128i*)p);
+    d0 = reich_blend_premul4_sse2(d0, s, inv, one);
+    _mm_storeu_si128((__m128i*)p, d0);
+    p += 4;
+    n -= 4;
+  }
+  reich_span_blend_premul_scalar(p, n, color);
+}
+
+#define REICH_DIV255_EPI32_AVX2(x, one) \
+  _mm256_srli_epi32(                    \
+      _mm256_add_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 8)), one), 8)
+
+REICH_TARGET_AVX2 static __m256i reich_blend8_avx2(
+    __m256i d,
+    __m256i sa,
+    __m256i inv,
+    __m256i sr,
+    __m256i sg,
+    __m256i sb,
+    __m256i mask,
+    __m256i one) {
+  __m256i t = _mm256_mullo_epi32(_mm256_srli_epi32(d, 24), inv);
+  __m256i oa = _mm256_add_epi32(sa, REICH_DIV255_EPI32_AVX2(t, one));
+  __m256 oaf = _mm256_cvtepi32_ps(oa);
+  __m256i dr = _mm256_and_si256(_mm256_srli_epi32(d, 16), mask);
+  __m256i dg = _mm256_and_si256(_mm256_srli_epi32(d, 8), mask);
+  __m256i db = _mm256_and_si256(d, mask);
+  __m256i r, g, b;
+  dr = _mm256_mullo_epi32(dr, t);
+  dg = _mm256_mullo_epi32(dg, t);
+  db = _mm256_mullo_epi32(db, t);
+  r = _mm256_add_epi32(sr, REICH_DIV255_EPI32_AVX2(dr, one));
+  g = _mm256_add_epi32(sg, REICH_DIV255_EPI32_AVX2(dg, one));
+  b = _mm256_add_epi32(sb, REICH_DIV255_EPI32_AVX2(db, one));
+  r = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(r), oaf));
+  g = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(g), oaf));
+  b = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(b), oaf));
+  return _mm256_or_si256(
+      _mm256_or_si256(_mm256_slli_epi32(oa, 24), _mm256_slli_epi32(r, 16)),
+      _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+REICH_TARGET_AVX2 static void
+reich_span_fill_avx2(uint32* p, int32 n, uint32 color) {
+  __m256i c = _mm256_set1_epi32((int)color);
+  while (n >= 16) {
+    _mm256_storeu_si256((__m256i*)(p + 0), c);
+    _mm256_storeu_si256((__m256i*)(p + 8), c);
+    p += 16;
+    n -= 16;
+  }
+  if (n >= 8) {
+    _mm256_storeu_si256((__m256i*)p, c);
+    p += 8;
+    n -= 8;
+  }
+  while (n-- > 0) { *p++ = color; }
+}
+
+REICH_TARGET_AVX2 static void
+reich_span_blend_avx2(uint32* p, int32 n, uint32 color) {
+  uint32 a = REICH_GET_A(color);
+  __m256i sa, inv, sr, sg, sb, mask, one;
+  if (a == 255) {
+    reich_span_fill_avx2(p, n, color);
+    return;
+  }
+  if (a == 0) { return; }
+  sa = _mm256_set1_epi32((int)a);
+  inv = _mm256_set1_epi32((int)(255 - a));
+  sr = _mm256_set1_epi32((int)(REICH_GET_R(color) * a));
+  sg = _mm256_set1_epi32((int)(REICH_GET_G(color) * a));
+  sb = _mm256_set1_epi32((int)(REICH_GET_B(color) * a));
+  mask = _mm256_set1_epi32(0xFF);
+  one = _mm256_set1_epi32(1);
+  while (n >= 16) {
+    __m256i d0 = _mm256_loadu_si256((__m256i*)(p + 0));
+    __m256i d1 = _mm256_loadu_si256((__m256i*)(p + 8));
+    d0 = reich_blend8_avx2(d0, sa, inv, sr, sg, sb, mask, one);
+    d1 = reich_blend8_avx2(d1, sa, inv, sr, sg, sb, mask, one);
+    _mm256_storeu_si256((__m256i*)(p + 0), d0);
+    _mm256_storeu_si256((__m256i*)(p + 8), d1);
+    p += 16;
+    n -= 16;
+  }
+  if (n >= 8) {
+    __m256i d0 = _mm256_loadu_si256((__m256i*)p);
+    d0 = reich_blend8_avx2(d0, sa, inv, sr, sg, sb, mask, one);
+    _mm256_storeu_si256((__m256i*)p, d0);
+    p += 8;
+    n -= 8;
+  }
+  reich_span_blend_scalar(p, n, color);
+}
+
+REICH_TARGET_AVX2 static __m256i
+reich_blend_premul8_avx2(__m256i d, __m256i s, __m256i inv, __m256i one) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i lo = _mm256_unpacklo_epi8(d, zero);
+  __m256i hi = _mm256_unpackhi_epi8(d, zero);
+  lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, inv), s);
+  hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, inv), s);
+  lo = _mm256_add_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), one);
+  hi = _mm256_add_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), one);
+  return _mm256_packus_epi16(
+      _mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+}
+
+REICH_TARGET_AVX2 static void
+reich_span_blend_premul_avx2(uint32* p, int32 n, uint32 color) {
+  uint32 a = REICH_GET_A(color);
+  __m256i s, inv, one;
+  short sa, sr, sg, sb;
+  if (a == 255) {
+    reich_span_fill_avx2(p, n, color);
+    return;
+  }
+  if (a == 0) { return; }
+  sa = (short)(255 * a);
+  sr = (short)(REICH_GET_R(color) * a);
+  sg = (short)(REICH_GET_G(color) * a);
+  sb = (short)(REICH_GET_B(color) * a);
+  s = _mm256_set_epi16(
+      sa, sr, sg, sb, sa, sr, sg, sb, sa, sr, sg, sb, sa, sr, sg, sb);
+  inv = _mm256_set1_epi16((short)(255 - a));
+  one = _mm256_set1_epi16(1);
+  while (n >= 16) {
+    __m256i d0 = _mm256_loadu_si256((__m256i*)(p + 0));
+    __m256i d1 = _mm256_loadu_si256((__m256i*)(p + 8));
+    d0 = reich_blend_premul8_avx2(d0, s, inv, one);
+    d1 = reich_blend_premul8_avx2(d1, s, inv, one);
+    _mm256_storeu_si256((__m256i*)(p + 0), d0);
+    _mm256_storeu_si256((__m256i*)(p + 8), d1);
+    p += 16;
+    n -= 16;
+  }
+  if (n >= 8) {
+    __m256i d0 = _mm256_loadu_si256((__m256i*)p);
+    d0 = reich_blend_premul8_avx2(d0, s, inv, one);
+    _mm256_storeu_si256((__m256i*)p, d0);
+    p += 8;
+    n -= 8;
+  }
+  reich_span_blend_premul_scalar(p, n, color);
+}
+
+#endif
+
+static int32 REICH_SIMD_LEVEL = -1;
+static PFREICHSPAN REICH_SPAN_FILL = reich_span_fill_scalar;
+static PFREICHSPAN REICH_SPAN_BLEND = reich_span_blend_scalar;
+static PFREICHSPAN REICH_SPAN_BLEND_PREMUL = reich_span_blend_premul_scalar;
+
+REICH_API int32 reich_simd_detect(void) {
+#if defined(REICH_SIMD_X86)
+  uint32 regs[4];
+  uint32 xcr0;
+#if defined(_MSC_VER)
+  __cpuidex((int*)regs, 1, 0);
+#else
+  __cpuid_count(1, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  /* OSXSAVE and AVX, then make sure the OS saves the ymm state. */
+  if ((regs[2] & (1u << 27)) == 0 || (regs[2] & (1u << 28)) == 0) {
+    return REICH_SIMD_SSE2;
+  }
+#if defined(_MSC_VER)
+  xcr0 = (uint32)_xgetbv(0);
+#else
+  __asm__ __volatile__("xgetbv" : "=a"(xcr0) : "c"(0) : "edx");
+#endif
+  if ((xcr0 & 6) != 6) { return REICH_SIMD_SSE2; }
+#if defined(_MSC_VER)
+  __cpuidex((int*)regs, 7, 0);
+#else
+  __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  if (regs[1] & (1u << 5)) { return REICH_SIMD_AVX2; }
+  return REICH_SIMD_SSE2;
+#else
+  return REICH_SIMD_SCALAR;
+#endif
+}
+
+REICH_API int32 reich_simd_set_level(int32 level) {
+  int32 best = reich_simd_detect();
+  if (level < 0 || level > best) { level = best; }
+  REICH_SPAN_FILL = reich_span_fill_scalar;
+  REICH_SPAN_BLEND = reich_span_blend_scalar;
+  REICH_SPAN_BLEND_PREMUL = reich_span_blend_premul_scalar;
+#if defined(REICH_SIMD_X86)
+  if (level == REICH_SIMD_SSE2) {
+    REICH_SPAN_FILL = reich_span_fill_sse2;
+    REICH_SPAN_BLEND = reich_span_blend_sse2;
+    REICH_SPAN_BLEND_PREMUL = reich_span_blend_premul_sse2;
+  } else if (level == REICH_SIMD_AVX2) {
+    REICH_SPAN_FILL = reich_span_fill_avx2;
+    REICH_SPAN_BLEND = reich_span_blend_avx2;
+    REICH_SPAN_BLEND_PREMUL = reich_span_blend_premul_avx2;
+  }
+#endif
+  REICH_SIMD_LEVEL = level;
+  return level;
+}
+
+REICH_API int32 reich_simd_level(void) {
+  if (REICH_SIMD_LEVEL < 0) { reich_simd_set_level(-1); }
+  return REICH_SIMD_LEVEL;
+}
+
+REICH_API int32 reich_span_fill(uint32* dst, int32 count, uint32 color) {
+  if (!dst || count <= 0) { return 0; }
+  if (REICH_SIMD_LEVEL < 0) { reich_simd_set_level(-1); }
+  REICH_SPAN_FILL(dst, count, color);
+  return 1;
+}
+
+REICH_API int32 reich_span_blend(uint32* dst, int32 count, uint32 color) {
+  if (!dst || count <= 0) { return 0; }
+  if (REICH_SIMD_LEVEL < 0) { reich_simd_set_level(-1); }
+  REICH_SPAN_BLEND(dst, count, color);
+  return 1;
+}
+
+REICH_API int32
+reich_span_blend_premul(uint32* dst, int32 count, uint32 color) {
+  if (!dst || count <= 0) { return 0; }
+  if (REICH_SIMD_LEVEL < 0) { reich_simd_set_level(-1); }
+  REICH_SPAN_BLEND_PREMUL(dst, count, color);
+  return 1;
+}
+
+REICH_API uint32 reich_color_premultiply(uint32 color) {
+  return REICH_PREMUL(color);
+}
+
+REICH_API uint32 reich_color_unpremultiply(uint32 color) {
+  uint32 a = REICH_GET_A(color), r, g, b;
+  if (a == 255) { return color; }
+  if (a == 0) { return 0; }
+  r = (REICH_GET_R(color) * 255 + a / 2) / a;
+  g = (REICH_GET_G(color) * 255 + a / 2) / a;
+  b = (REICH_GET_B(color) * 255 + a / 2) / a;
+  if (r > 255) { r = 255; }
+  if (g > 255) { g = 255; }
+  if (b > 255) { b = 255; }
+  return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+REICH_API int32 reich_canvas_premultiply(reichCanvas* canvas) {
+  int32 count;
+  uint32* p;
+  if (!canvas || !canvas->pixels) { return 0; }
+  if (canvas->format == REICH_FORMAT_PREMUL) { return 1; }
+  count = canvas->width * canvas->height;
+  p = canvas->pixels;
+  while (count--) {
+    if (REICH_GET_A(*p) != 255) { *p = REICH_PREMUL(*p); }
+    p++;
+  }
+  canvas->format = REICH_FORMAT_PREMUL;
+  return 1;
+}
+
+REICH_API int32 reich_canvas_unpremultiply(reichCanvas* canvas) {
+  int32 count;
+  uint32* p;
+  if (!canvas || !canvas->pixels) { return 0; }
+  if (canvas->format == REICH_FORMAT_STRAIGHT) { return 1; }
+  count = canvas->width * canvas->height;
+  p = canvas->pixels;
+  while (count--) {
+    *p = reich_color_unpremultiply(*p);
+    p++;
+  }
+  canvas->format = REICH_FORMAT_STRAIGHT;
+  return 1;
+}
+
+REICH_API int32 reich_set_canvas_format(reichContext* ctx, int32 format) {
+  if (!ctx) { return 0; }
+  reich_dirty_add(ctx, 0, 0, ctx->canvas.width, ctx->canvas.height);
+  if (format == REICH_FORMAT_PREMUL) {
+    return reich_canvas_premultiply(&ctx->canvas);
+  }
+  return reich_canvas_unpremultiply(&ctx->canvas);
+}
+
 static int32 reich_draw_span(
     reichContext* ctx,
     int32 py,
@@ -3077,32 +5364,25 @@ static int32 reich_draw_span(
     uint32 color,
     uint32 alpha) {
   uint32* p;
-  int32 n;
   REICH_CLAMP_X_INCL(ctx, sx, ex);
   if (sx > ex) { return 0; }
+  if (REICH_SIMD_LEVEL < 0) { reich_simd_set_level(-1); }
   p = ctx->canvas.pixels + py * ctx->canvas.width + sx;
-  n = ex - sx + 1;
   if (alpha == 255) {
-    while (n >= 4) {
-      *p++ = color;
-      *p++ = color;
-      *p++ = color;
-      *p++ = color;
-      n -= 4;
-    }
-    while (n--) { *p++ = color; }
+    REICH_SPAN_FILL(p, ex - sx + 1, color);
+  } else if (ctx->canvas.format == REICH_FORMAT_PREMUL) {
+    REICH_SPAN_BLEND_PREMUL(p, ex - sx + 1, color);
   } else {
-    while (n--) {
-      REICH_BLEND_FAST(color, *p);
-      p++;
-    }
+    REICH_SPAN_BLEND(p, ex - sx + 1, color);
   }
+  REICH_PROF_PIXELS(ctx, ex - sx + 1, alpha);
   reich_dirty_add(ctx, sx, py, ex + 1, py + 1);
   return 1;
 }
 
 REICH_API int32
 reich_draw_pixel(reichContext* ctx, int32 x, int32 y, uint32 color) {
+  REICH_PROF_PRIM(ctx, REICH_PRIM_PIXEL);
   if (REICH_PIXEL_IN_CLIP(ctx, x, y)) {
     REICH_DRAW_PIXEL_FAST(ctx, x, y, color);
     reich_dirty_add(ctx, x, y, x + 1, y + 1);
@@ -3113,6 +5393,11 @@ reich_draw_pixel(reichContext* ctx, int32 x, int32 y, uint32 color) {
 REICH_API int32 reich_draw_clear(reichContext* ctx, uint32 color) {
   int32 count = ctx->canvas.width * ctx->canvas.height;
   uint32* p = ctx->canvas.pixels;
+  REICH_PROF_PRIM(ctx, REICH_PRIM_CLEAR);
+  if (ctx->canvas.format == REICH_FORMAT_PREMUL) {
+    color = REICH_PREMUL(color);
+  }
+  REICH_PROF_PIXELS(ctx, count, 255);
   while (count--) { *p++ = color; }
   reich_dirty_add(ctx, 0, 0, ctx->canvas.width, ctx->canvas.height);
   return 1;
@@ -3128,6 +5413,7 @@ REICH_API int32 reich_draw_line(
   float dx, dy, step, x, y;
   int32 i, steps, ix, iy;
   uint32 alpha = REICH_GET_A(colour);
+  REICH_PROF_PRIM(ctx, REICH_PRIM_LINE);
   if (alpha == 0) { return 0; }
 
   dx = x2 - x1;
@@ -3175,6 +5461,7 @@ REICH_API int32 reich_draw_line_thick(
   int32 minX, minY, maxX, maxY, px, py;
   uint32 alpha = REICH_GET_A(color);
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_LINE);
   if (thickness <= 1.0f) {
     return reich_draw_line(ctx, x1, y1, x2, y2, color);
   }
@@ -3237,6 +5524,7 @@ REICH_API int32 reich_draw_rect_fill(
   uint32 alpha;
   if (!ctx || !ctx->canvas.pixels || w <= 0.0f || h <= 0.0f) { return 0; }
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_RECT);
   alpha = REICH_GET_A(color);
   if (alpha == 0) { return 0; }
 
@@ -3265,6 +5553,7 @@ REICH_API int32 reich_draw_rect_gradient(
   uint32 outColor;
   float a1, r1, g1, b1, a2, r2, g2, b2, a3, r3, g3, b3, a4, r4, g4, b4;
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_RECT);
   if (w <= 0.0f || h <= 0.0f) { return 0; }
   REICH_CALC_BOUNDS_INCL(x, w, startX, endX);
   REICH_CALC_BOUNDS_INCL(y, h, startY, endY);
@@ -3320,6 +5609,7 @@ REICH_API int32 reich_draw_rect_gradient(
 
 REICH_API int32 reich_draw_rect(
     reichContext* ctx, float x, float y, float w, float h, uint32 color) {
+  REICH_PROF_PRIM(ctx, REICH_PRIM_RECT);
   reich_draw_line(ctx, x, y, x + w, y, color);
   reich_draw_line(ctx, x, y + h, x + w, y + h, color);
   reich_draw_line(ctx, x, y, x, y + h, color);
@@ -3333,6 +5623,7 @@ REICH_API int32 reich_draw_circle_fill(
   double r2, dy, dx;
   uint32 alpha = REICH_GET_A(color);
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_ELLIPSE);
   if (r <= 0.0f || alpha == 0) { return 0; }
   r2 = (double)r * (double)r;
 
@@ -3354,6 +5645,7 @@ REICH_API int32 reich_draw_circle(
   double r2, rin2, dy, dx_out, dx_in, rin;
   uint32 alpha = REICH_GET_A(color);
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_ELLIPSE);
   if (r <= 0.0f || t <= 0.0f || alpha == 0) { return 0; }
   if (t >= r) { return reich_draw_circle_fill(ctx, cx, cy, r, color); }
 
@@ -3406,6 +5698,7 @@ REICH_API int32 reich_draw_rect_rounded(
   float cx, cy, hx, hy, r_in, hx_in, hy_in;
   uint32 alpha = REICH_GET_A(color);
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_RECT);
   if (w <= 0.0f || h <= 0.0f || alpha == 0) { return 0; }
 
   cx = x + w * 0.5f;
@@ -3499,12 +5792,135 @@ REICH_API int32 reich_draw_triangle(
     float x3,
     float y3,
     uint32 color) {
+  REICH_PROF_PRIM(ctx, REICH_PRIM_TRIANGLE);
   reich_draw_line(ctx, x1, y1, x2, y2, color);
   reich_draw_line(ctx, x2, y2, x3, y3, color);
   reich_draw_line(ctx, x3, y3, x1, y1, color);
   return 1;
 }
 
+/* Triangles are rasterized in 28.4 fixed point with the top-left fill rule,
+ * so triangles sharing an edge never touch the same pixel twice. The
+ * bounding box is walked in 8x8 blocks: blocks wholly outside an edge are
+ * skipped, blocks wholly inside are merged into horizontal runs and the
+ * rest step the edge functions per pixel. Every row segment goes through
+ * reich_draw_span. */
+#define REICH_TRI_SUBPIXEL_BITS 4
+#define REICH_TRI_SUBPIXEL      (1 << REICH_TRI_SUBPIXEL_BITS)
+#define REICH_TRI_BLOCK         8
+#define REICH_TRI_COORD_LIMIT   16777216.0
+
+typedef struct reichTriEdges {
+  int64 vx[3], vy[3];
+  int64 stepX[3], stepY[3];
+  int64 origin[3];
+  int64 area;
+  int32 minX, minY, maxX, maxY;
+  int32 swapped;
+} reichTriEdges;
+
+static int64 reich_tri_snap(float v) {
+  double d = (double)v;
+  if (d < -REICH_TRI_COORD_LIMIT) { d = -REICH_TRI_COORD_LIMIT; }
+  if (d > REICH_TRI_COORD_LIMIT) { d = REICH_TRI_COORD_LIMIT; }
+  return reich_floord(d * (double)REICH_TRI_SUBPIXEL + 0.5);
+}
+
+/* Snaps the vertices, orders them so the interior is positive and sets up
+ * the biased edge functions at the centre of the clipped box's first
+ * pixel. Returns 0 when nothing inside the clip can be covered. */
+static int32 reich_tri_setup(
+    reichContext* ctx,
+    float x1,
+    float y1,
+    float x2,
+    float y2,
+    float x3,
+    float y3,
+    reichTriEdges* t) {
+  int64 t64, lo, hi, sampleX, sampleY, dx, dy;
+  int32 i, j;
+
+  t->vx[0] = reich_tri_snap(x1);
+  t->vy[0] = reich_tri_snap(y1);
+  t->vx[1] = reich_tri_snap(x2);
+  t->vy[1] = reich_tri_snap(y2);
+  t->vx[2] = reich_tri_snap(x3);
+  t->vy[2] = reich_tri_snap(y3);
+
+  t->area = (t->vx[1] - t->vx[0]) * (t->vy[2] - t->vy[0]) -
+            (t->vy[1] - t->vy[0]) * (t->vx[2] - t->vx[0]);
+  if (t->area == 0) { return 0; }
+  t->swapped = 0;
+  if (t->area < 0) {
+    t64 = t->vx[1]; t->vx[1] = t->vx[2]; t->vx[2] = t64;
+    t64 = t->vy[1]; t->vy[1] = t->vy[2]; t->vy[2] = t64;
+    t->area = -t->area;
+    t->swapped = 1;
+  }
+
+  /* Pixel centres at (px + 0.5) in fixed point lie in [min, max]. */
+  lo = t->vx[0]; hi = t->vx[0];
+  for (i = 1; i < 3; ++i) {
+    if (t->vx[i] < lo) { lo = t->vx[i]; }
+    if (t->vx[i] > hi) { hi = t->vx[i]; }
+  }
+  t->minX = (int32)reich_floord((double)lo / REICH_TRI_SUBPIXEL - 0.5);
+  t->maxX = (int32)reich_floord((double)hi / REICH_TRI_SUBPIXEL - 0.5);
+  lo = t->vy[0]; hi = t->vy[0];
+  for (i = 1; i < 3; ++i) {
+    if (t->vy[i] < lo) { lo = t->vy[i]; }
+    if (t->vy[i] > hi) { hi = t->vy[i]; }
+  }
+  t->minY = (int32)reich_floord((double)lo / REICH_TRI_SUBPIXEL - 0.5);
+  t->maxY = (int32)reich_floord((double)hi / REICH_TRI_SUBPIXEL - 0.5);
+  REICH_CLAMP_BOUNDS_INCL(ctx, t->minX, t->minY, t->maxX, t->maxY);
+  if (t->minX > t->maxX || t->minY > t->maxY) { return 0; }
+
+  /* E(p) = dx * (p.y - a.y) - dy * (p.x - a.x) is positive inside. Edges
+   * that are not top or left get a -1 bias so E == 0 is rejected there. */
+  sampleX = ((int64)t->minX << REICH_TRI_SUBPIXEL_BITS) +
+            REICH_TRI_SUBPIXEL / 2;
+  sampleY = ((int64)t->minY << REICH_TRI_SUBPIXEL_BITS) +
+            REICH_TRI_SUBPIXEL / 2;
+  for (i = 0; i < 3; ++i) {
+    j = (i + 1) % 3;
+    dx = t->vx[j] - t->vx[i];
+    dy = t->vy[j] - t->vy[i];
+    t->stepX[i] = -dy * REICH_TRI_SUBPIXEL;
+    t->stepY[i] = dx * REICH_TRI_SUBPIXEL;
+    t->origin[i] = dx * (sampleY - t->vy[i]) - dy * (sampleX - t->vx[i]);
+    if (!(dy < 0 || (dy == 0 && dx > 0))) { t->origin[i] -= 1; }
+  }
+  return 1;
+}
+
+/* Solves the three edge inequalities along one row. `e` holds the edge
+ * values at minX; the covered run is returned in [*sx, *ex]. */
+static int32 reich_tri_row(
+    const reichTriEdges* t, const int64* e, int32* sx, int32* ex) {
+  int64 lo = 0, hi = t->maxX - t->minX, k;
+  int32 i;
+  for (i = 0; i < 3; ++i) {
+    if (t->stepX[i] > 0) {
+      if (e[i] < 0) {
+        k = (-e[i] + t->stepX[i] - 1) / t->stepX[i];
+        if (k > lo) { lo = k; }
+      }
+    } else {
+      if (e[i] < 0) { return 0; }
+      if (t->stepX[i] < 0) {
+        k = e[i] / -t->stepX[i];
+        if (k < hi) { hi = k; }
+      }
+    }
+  }
+  if (lo > hi) { return 0; }
+  *sx = t->minX + (int32)lo;
+  *ex = t->minX + (int32)hi;
+  return 1;
+}
+
 REICH_API int32 reich_draw_triangle_fill(
     reichContext* ctx,
     float x1,
@@ -3514,47 +5930,893 @@ REICH_API int32 reich_draw_triangle_fill(
     float x3,
     float y3,
     uint32 color) {
-  float minX_f, minY_f, maxX_f, maxY_f;
-  int32 minX, minY, maxX, maxY, px, py;
+  reichTriEdges t;
+  int64 band[3], blk[3], e[3];
+  int64 cx, cy, lo, hi;
+  int32 bx, by, bw, bh, r, c, i;
+  int32 runX, runEnd, sx, ex, full, reject;
   uint32 alpha = REICH_GET_A(color);
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_TRIANGLE);
   if (alpha == 0) { return 0; }
-  minX_f = x1;
-  minY_f = y1;
-  maxX_f = x1;
-  maxY_f = y1;
-  if (x2 < minX_f) { minX_f = x2; }
-  if (x3 < minX_f) { minX_f = x3; }
-  if (y2 < minY_f) { minY_f = y2; }
-  if (y3 < minY_f) { minY_f = y3; }
-  if (x2 > maxX_f) { maxX_f = x2; }
-  if (x3 > maxX_f) { maxX_f = x3; }
-  if (y2 > maxY_f) { maxY_f = y2; }
-  if (y3 > maxY_f) { maxY_f = y3; }
+  if (!reich_tri_setup(ctx, x1, y1, x2, y2, x3, y3, &t)) { return 1; }
+  band[0] = t.origin[0];
+  band[1] = t.origin[1];
+  band[2] = t.origin[2];
+
+  for (by = t.minY; by <= t.maxY; by += REICH_TRI_BLOCK) {
+    bh = t.maxY - by + 1;
+    if (bh > REICH_TRI_BLOCK) { bh = REICH_TRI_BLOCK; }
+    runX = -1;
+    runEnd = -1;
+    blk[0] = band[0];
+    blk[1] = band[1];
+    blk[2] = band[2];
+    for (bx = t.minX; bx <= t.maxX; bx += REICH_TRI_BLOCK) {
+      bw = t.maxX - bx + 1;
+      if (bw > REICH_TRI_BLOCK) { bw = REICH_TRI_BLOCK; }
+      full = 1;
+      reject = 0;
+      for (i = 0; i < 3; ++i) {
+        cx = t.stepX[i] * (bw - 1);
+        cy = t.stepY[i] * (bh - 1);
+        lo = blk[i] + (cx < 0 ? cx : 0) + (cy < 0 ? cy : 0);
+        hi = blk[i] + (cx > 0 ? cx : 0) + (cy > 0 ? cy : 0);
+        if (hi < 0) { reject = 1; }
+        if (lo < 0) { full = 0; }
+      }
 
-  minX = reich_floor((double)minX_f - 0.5);
-  minY = reich_floor((double)minY_f - 0.5);
-  maxX = reich_ceil((double)maxX_f + 0.5);
-  maxY = reich_ceil((double)maxY_f + 0.5);
-  REICH_CLAMP_BOUNDS_INCL(ctx, minX, minY, maxX, maxY);
+      if (full) {
+        if (runX < 0) { runX = bx; }
+        runEnd = bx + bw - 1;
+      } else {
+        if (runX >= 0) {
+          for (r = 0; r < bh; ++r) {
+            reich_draw_span(ctx, by + r, runX, runEnd, color, alpha);
+          }
+          runX = -1;
+        }
+        if (!reject) {
+          for (r = 0; r < bh; ++r) {
+            e[0] = blk[0] + t.stepY[0] * r;
+            e[1] = blk[1] + t.stepY[1] * r;
+            e[2] = blk[2] + t.stepY[2] * r;
+            sx = -1;
+            ex = -1;
+            for (c = 0; c < bw; ++c) {
+              if ((e[0] | e[1] | e[2]) >= 0) {
+                if (sx < 0) { sx = c; }
+                ex = c;
+              } else if (sx >= 0) {
+                break;
+              }
+              e[0] += t.stepX[0];
+              e[1] += t.stepX[1];
+              e[2] += t.stepX[2];
+            }
+            if (sx >= 0) {
+              reich_draw_span(ctx, by + r, bx + sx, bx + ex, color, alpha);
+            }
+          }
+        }
+      }
+      blk[0] += t.stepX[0] * REICH_TRI_BLOCK;
+      blk[1] += t.stepX[1] * REICH_TRI_BLOCK;
+      blk[2] += t.stepX[2] * REICH_TRI_BLOCK;
+    }
+    if (runX >= 0) {
+      for (r = 0; r < bh; ++r) {
+        reich_draw_span(ctx, by + r, runX, runEnd, color, alpha);
+      }
+    }
+    band[0] += t.stepY[0] * REICH_TRI_BLOCK;
+    band[1] += t.stepY[1] * REICH_TRI_BLOCK;
+    band[2] += t.stepY[2] * REICH_TRI_BLOCK;
+  }
+  return 1;
+}
 
-  for (py = minY; py <= maxY; ++py) {
-    float py_f = (float)py + 0.5f;
-    for (px = minX; px <= maxX; ++px) {
-      float px_f = (float)px + 0.5f;
-      float w0 = (x2 - x1) * (py_f - y1) - (y2 - y1) * (px_f - x1);
-      float w1 = (x3 - x2) * (py_f - y2) - (y3 - y2) * (px_f - x2);
-      float w2 = (x1 - x3) * (py_f - y3) - (y1 - y3) * (px_f - x3);
-      if ((w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) ||
-          (w0 <= 0.0f && w1 <= 0.0f && w2 <= 0.0f)) {
-        REICH_DRAW_PIXEL_FAST(ctx, px, py, color);
+/* NOISE::SIMD ***************************************************************/
+
+/* Batched Perlin noise. The lanes run the float operations of reich_noise2
+ * and reich_noise3 in the same order, so results are bit-identical to the
+ * scalar calls. Only the permutation lookups stay scalar; they are packed
+ * four hashes to a word so the vector code needs a single load per lane. */
+
+#define REICH_NOISE_TILE 64
+
+typedef struct reichNoiseRow {
+  const real32* fx;
+  const real32* u;
+  const int32* cell;
+  const uint32* hashes;
+  real32 fy;
+  real32 v;
+  real32 amplitude;
+} reichNoiseRow;
+
+typedef void (*PFREICHNOISEROW)(
+    real32* out, int32 n, const reichNoiseRow* row);
+
+static uint32 reich_noise_hash2(int32 X, int32 Y) {
+  int32 A = REICH_NOISE_PERM[X] + Y;
+  int32 B = REICH_NOISE_PERM[X + 1] + Y;
+  return (uint32)REICH_NOISE_PERM[A] |
+      ((uint32)REICH_NOISE_PERM[B] << 8) |
+      ((uint32)REICH_NOISE_PERM[A + 1] << 16) |
+      ((uint32)REICH_NOISE_PERM[B + 1] << 24);
+}
+
+static void
+reich_noise_hash3(int32 X, int32 Y, int32 Z, uint32* h0, uint32* h1) {
+  int32 A = REICH_NOISE_PERM[X] + Y, B = REICH_NOISE_PERM[X + 1] + Y;
+  int32 AA = REICH_NOISE_PERM[A] + Z, AB = REICH_NOISE_PERM[A + 1] + Z;
+  int32 BA = REICH_NOISE_PERM[B] + Z, BB = REICH_NOISE_PERM[B + 1] + Z;
+  *h0 = (uint32)REICH_NOISE_PERM[AA] | ((uint32)REICH_NOISE_PERM[BA] << 8) |
+      ((uint32)REICH_NOISE_PERM[AB] << 16) |
+      ((uint32)REICH_NOISE_PERM[BB] << 24);
+  *h1 = (uint32)REICH_NOISE_PERM[AA + 1] |
+      ((uint32)REICH_NOISE_PERM[BA + 1] << 8) |
+      ((uint32)REICH_NOISE_PERM[AB + 1] << 16) |
+      ((uint32)REICH_NOISE_PERM[BB + 1] << 24);
+}
+
+static void
+reich_noise2_row_scalar(real32* out, int32 n, const reichNoiseRow* row) {
+  real32 fy = row->fy, fy1 = row->fy - 1.0f, v = row->v;
+  real32 g00, g10, g01, g11, nx0, nx1, fx, fx1, u;
+  uint32 hp;
+  int32 i;
+  for (i = 0; i < n; ++i) {
+    hp = row->hashes[row->cell[i]];
+    fx = row->fx[i];
+    fx1 = fx - 1.0f;
+    u = row->u[i];
+    REICH_GRAD2_TABLE(g00, hp, fx, fy);
+    REICH_GRAD2_TABLE(g10, hp >> 8, fx1, fy);
+    REICH_GRAD2_TABLE(g01, hp >> 16, fx, fy1);
+    REICH_GRAD2_TABLE(g11, hp >> 24, fx1, fy1);
+    nx0 = g00 + u * (g10 - g00);
+    nx1 = g01 + u * (g11 - g01);
+    out[i] += (nx0 + v * (nx1 - nx0)) * row->amplitude;
+  }
+}
+
+#if defined(REICH_SIMD_X86)
+
+/* REICH_FAST_FLOOR per lane: truncate, then step down where that rounded
+ * up. Returns the fraction and stores the lattice coordinate. */
+static __m128 reich_noise_floor_sse2(__m128 x, __m128i* xi) {
+  __m128i t = _mm_cvttps_epi32(x);
+  t = _mm_add_epi32(
+      t, _mm_castps_si128(_mm_cmplt_ps(x, _mm_cvtepi32_ps(t))));
+  *xi = t;
+  return _mm_sub_ps(x, _mm_cvtepi32_ps(t));
+}
+
+static __m128 reich_noise_fade_sse2(__m128 t) {
+  __m128 p = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+  p = _mm_add_ps(_mm_mul_ps(t, p), _mm_set1_ps(10.0f));
+  return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), p);
+}
+
+/* REICH_GRAD3_TABLE on the low four bits of h; z is zero for 2D. */
+static __m128 reich_noise_grad_sse2(__m128i h, __m128 x, __m128 y, __m128 z) {
+  __m128i lt8, lt4, hx;
+  __m128 u, v;
+  h = _mm_and_si128(h, _mm_set1_epi32(15));
+  lt8 = _mm_cmplt_epi32(h, _mm_set1_epi32(8));
+  lt4 = _mm_cmplt_epi32(h, _mm_set1_epi32(4));
+  hx = _mm_or_si128(
+      _mm_cmpeq_epi32(h, _mm_set1_epi32(12)),
+      _mm_cmpeq_epi32(h, _mm_set1_epi32(14)));
+  u = _mm_or_ps(
+      _mm_and_ps(_mm_castsi128_ps(lt8), x),
+      _mm_andnot_ps(_mm_castsi128_ps(lt8), y));
+  v = _mm_or_ps(
+      _mm_and_ps(_mm_castsi128_ps(hx), x),
+      _mm_andnot_ps(_mm_castsi128_ps(hx), z));
+  v = _mm_or_ps(
+      _mm_and_ps(_mm_castsi128_ps(lt4), y),
+      _mm_andnot_ps(_mm_castsi128_ps(lt4), v));
+  u = _mm_xor_ps(u, _mm_castsi128_ps(_mm_slli_epi32(h, 31)));
+  v = _mm_xor_ps(
+      v, _mm_castsi128_ps(_mm_slli_epi32(_mm_srli_epi32(h, 1), 31)));
+  return _mm_add_ps(u, v);
+}
+
+static __m128 reich_noise_lerp_sse2(__m128 a, __m128 b, __m128 t) {
+  return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+static __m128 reich_noise2_quad_sse2(
+    __m128i hp, __m128 fx, __m128 fy, __m128 u, __m128 v) {
+  __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+  __m128 fx1 = _mm_sub_ps(fx, one), fy1 = _mm_sub_ps(fy, one);
+  __m128 g00 = reich_noise_grad_sse2(hp, fx, fy, zero);
+  __m128 g10 = reich_noise_grad_sse2(_mm_srli_epi32(hp, 8), fx1, fy, zero);
+  __m128 g01 = reich_noise_grad_sse2(_mm_srli_epi32(hp, 16), fx, fy1, zero);
+  __m128 g11 = reich_noise_grad_sse2(_mm_srli_epi32(hp, 24), fx1, fy1, zero);
+  return reich_noise_lerp_sse2(
+      reich_noise_lerp_sse2(g00, g10, u), reich_noise_lerp_sse2(g01, g11, u),
+      v);
+}
+
+static void
+reich_noise2_row_sse2(real32* out, int32 n, const reichNoiseRow* row) {
+  __m128 fy = _mm_set1_ps(row->fy), v = _mm_set1_ps(row->v);
+  __m128 amp = _mm_set1_ps(row->amplitude);
+  const int32* cell = row->cell;
+  int32 i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i hp = _mm_set_epi32(
+        (int)row->hashes[cell[i + 3]],
+        (int)row->hashes[cell[i + 2]],
+        (int)row->hashes[cell[i + 1]],
+        (int)row->hashes[cell[i]]);
+    __m128 r = reich_noise2_quad_sse2(
+        hp, _mm_loadu_ps(row->fx + i), fy, _mm_loadu_ps(row->u + i), v);
+    _mm_storeu_ps(
+        out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(r, amp)));
+  }
+  if (i < n) {
+    reichNoiseRow tail = *row;
+    tail.fx += i;
+    tail.u += i;
+    tail.cell += i;
+    reich_noise2_row_scalar(out + i, n - i, &tail);
+  }
+}
+
+static void reich_noise2_n_sse2(
+    const real32* xs, const real32* ys, real32* out, int32 n) {
+  int32 i, k, X[4], Y[4];
+  uint32 hp[4];
+  __m128i xi, yi, mask = _mm_set1_epi32(255);
+  __m128 fx, fy;
+  for (i = 0; i + 4 <= n; i += 4) {
+    fx = reich_noise_floor_sse2(_mm_loadu_ps(xs + i), &xi);
+    fy = reich_noise_floor_sse2(_mm_loadu_ps(ys + i), &yi);
+    _mm_storeu_si128((__m128i*)X, _mm_and_si128(xi, mask));
+    _mm_storeu_si128((__m128i*)Y, _mm_and_si128(yi, mask));
+    for (k = 0; k < 4; ++k) { hp[k] = reich_noise_hash2(X[k], Y[k]); }
+    _mm_storeu_ps(
+        out + i,
+        reich_noise2_quad_sse2(
+            _mm_loadu_si128((const __m128i*)hp),
+            fx,
+            fy,
+            reich_noise_fade_sse2(fx),
+            reich_noise_fade_sse2(fy)));
+  }
+  for (; i < n; ++i) { out[i] = reich_noise2(xs[i], ys[i]); }
+}
+
+static void reich_noise3_n_sse2(
+    const real32* xs, const real32* ys, const real32* zs, real32* out,
+    int32 n) {
+  int32 i, k, X[4], Y[4], Z[4];
+  uint32 h0[4], h1[4];
+  __m128i xi, yi, zi, hp0, hp1, mask = _mm_set1_epi32(255);
+  __m128 fx, fy, fz, fx1, fy1, fz1, u, v, w;
+  __m128 one = _mm_set1_ps(1.0f);
+  for (i = 0; i + 4 <= n; i += 4) {
+    fx = reich_noise_floor_sse2(_mm_loadu_ps(xs + i), &xi);
+    fy = reich_noise_floor_sse2(_mm_loadu_ps(ys + i), &yi);
+    fz = reich_noise_floor_sse2(_mm_loadu_ps(zs + i), &zi);
+    _mm_storeu_si128((__m128i*)X, _mm_and_si128(xi, mask));
+    _mm_storeu_si128((__m128i*)Y, _mm_and_si128(yi, mask));
+    _mm_storeu_si128((__m128i*)Z, _mm_and_si128(zi, mask));
+    for (k = 0; k < 4; ++k) {
+      reich_noise_hash3(X[k], Y[k], Z[k], &h0[k], &h1[k]);
+    }
+    hp0 = _mm_loadu_si128((const __m128i*)h0);
+    hp1 = _mm_loadu_si128((const __m128i*)h1);
+    fx1 = _mm_sub_ps(fx, one);
+    fy1 = _mm_sub_ps(fy, one);
+    fz1 = _mm_sub_ps(fz, one);
+    u = reich_noise_fade_sse2(fx);
+    v = reich_noise_fade_sse2(fy);
+    w = reich_noise_fade_sse2(fz);
+    _mm_storeu_ps(
+        out + i,
+        reich_noise_lerp_sse2(
+            reich_noise_lerp_sse2(
+                reich_noise_lerp_sse2(
+                    reich_noise_grad_sse2(hp0, fx, fy, fz),
+                    reich_noise_grad_sse2(
+                        _mm_srli_epi32(hp0, 8), fx1, fy, fz),
+                    u),
+                reich_noise_lerp_sse2(
+                    reich_noise_grad_sse2(
+                        _mm_srli_epi32(hp0, 16), fx, fy1, fz),
+                    reich_noise_grad_sse2(
+                        _mm_srli_epi32(hp0, 24), fx1, fy1, fz),
+                    u),
+                v),
+            reich_noise_lerp_sse2(
+                reich_noise_lerp_sse2(
+                    reich_noise_grad_sse2(hp1, fx, fy, fz1),
+                    reich_noise_grad_sse2(
+                        _mm_srli_epi32(hp1, 8), fx1, fy, fz1),
+                    u),
+                reich_noise_lerp_sse2(
+                    reich_noise_grad_sse2(
+                        _mm_srli_epi32(hp1, 16), fx, fy1, fz1),
+                    reich_noise_grad_sse2(
+                        _mm_srli_epi32(hp1, 24), fx1, fy1, fz1),
+                    u),
+                v),
+            w));
+  }
+  for (; i < n; ++i) { out[i] = reich_noise3(xs[i], ys[i], zs[i]); }
+}
+
+REICH_TARGET_AVX2 static __m256 reich_noise_floor_avx2(__m256 x, __m256i* xi) {
+  __m256i t = _mm256_cvttps_epi32(x);
+  t = _mm256_add_epi32(
+      t,
+      _mm256_castps_si256(
+          _mm256_cmp_ps(x, _mm256_cvtepi32_ps(t), _CMP_LT_OQ)));
+  *xi = t;
+  return _mm256_sub_ps(x, _mm256_cvtepi32_ps(t));
+}
+
+REICH_TARGET_AVX2 static __m256 reich_noise_fade_avx2(__m256 t) {
+  __m256 p = _mm256_sub_ps(
+      _mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f));
+  p = _mm256_add_ps(_mm256_mul_ps(t, p), _mm256_set1_ps(10.0f));
+  return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), p);
+}
+
+REICH_TARGET_AVX2 static __m256
+reich_noise_grad_avx2(__m256i h, __m256 x, __m256 y, __m256 z) {
+  __m256 lt8, lt4, hx, u, v;
+  h = _mm256_and_si256(h, _mm256_set1_epi32(15));
+  lt8 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+  lt4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+  hx = _mm256_castsi256_ps(_mm256_or_si256(
+      _mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)),
+      _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+  u = _mm256_blendv_ps(y, x, lt8);
+  v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, hx), y, lt4);
+  u = _mm256_xor_ps(u, _mm256_castsi256_ps(_mm256_slli_epi32(h, 31)));
+  v = _mm256_xor_ps(
+      v, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_srli_epi32(h, 1), 31)));
+  return _mm256_add_ps(u, v);
+}
+
+REICH_TARGET_AVX2 static __m256
+reich_noise_lerp_avx2(__m256 a, __m256 b, __m256 t) {
+  return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+REICH_TARGET_AVX2 static __m256 reich_noise2_oct_avx2(
+    __m256i hp, __m256 fx, __m256 fy, __m256 u, __m256 v) {
+  __m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+  __m256 fx1 = _mm256_sub_ps(fx, one), fy1 = _mm256_sub_ps(fy, one);
+  __m256 g00 = reich_noise_grad_avx2(hp, fx, fy, zero);
+  __m256 g10 = reich_noise_grad_avx2(_mm256_srli_epi32(hp, 8), fx1, fy, zero);
+  __m256 g01 = reich_noise_grad_avx2(_mm256_srli_epi32(hp, 16), fx, fy1, zero);
+  __m256 g11 =
+      reich_noise_grad_avx2(_mm256_srli_epi32(hp, 24), fx1, fy1, zero);
+  return reich_noise_lerp_avx2(
+      reich_noise_lerp_avx2(g00, g10, u), reich_noise_lerp_avx2(g01, g11, u),
+      v);
+}
+
+/* The packed hashes of a row are plain 32-bit words, so they can be
+ * gathered straight from the per-cell table. */
+REICH_TARGET_AVX2 static void
+reich_noise2_row_avx2(real32* out, int32 n, const reichNoiseRow* row) {
+  __m256 fy = _mm256_set1_ps(row->fy), v = _mm256_set1_ps(row->v);
+  __m256 amp = _mm256_set1_ps(row->amplitude);
+  int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i hp = _mm256_i32gather_epi32(
+        (const int*)row->hashes,
+        _mm256_loadu_si256((const __m256i*)(row->cell + i)),
+        4);
+    __m256 r = reich_noise2_oct_avx2(
+        hp, _mm256_loadu_ps(row->fx + i), fy, _mm256_loadu_ps(row->u + i), v);
+    _mm256_storeu_ps(
+        out + i,
+        _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(r, amp)));
+  }
+  if (i < n) {
+    reichNoiseRow tail = *row;
+    tail.fx += i;
+    tail.u += i;
+    tail.cell += i;
+    reich_noise2_row_scalar(out + i, n - i, &tail);
+  }
+}
+
+REICH_TARGET_AVX2 static void reich_noise2_n_avx2(
+    const real32* xs, const real32* ys, real32* out, int32 n) {
+  int32 i, k, X[8], Y[8];
+  uint32 hp[8];
+  __m256i xi, yi, mask = _mm256_set1_epi32(255);
+  __m256 fx, fy;
+  for (i = 0; i + 8 <= n; i += 8) {
+    fx = reich_noise_floor_avx2(_mm256_loadu_ps(xs + i), &xi);
+    fy = reich_noise_floor_avx2(_mm256_loadu_ps(ys + i), &yi);
+    _mm256_storeu_si256((__m256i*)X, _mm256_and_si256(xi, mask));
+    _mm256_storeu_si256((__m256i*)Y, _mm256_and_si256(yi, mask));
+    for (k = 0; k < 8; ++k) { hp[k] = reich_noise_hash2(X[k], Y[k]); }
+    _mm256_storeu_ps(
+        out + i,
+        reich_noise2_oct_avx2(
+            _mm256_loadu_si256((const __m256i*)hp),
+            fx,
+            fy,
+            reich_noise_fade_avx2(fx),
+            reich_noise_fade_avx2(fy)));
+  }
+  reich_noise2_n_sse2(xs + i, ys + i, out + i, n - i);
+}
+
+REICH_TARGET_AVX2 static void reich_noise3_n_avx2(
+    const real32* xs, const real32* ys, const real32* zs, real32* out,
+    int32 n) {
+  int32 i, k, X[8], Y[8], Z[8];
+  uint32 h0[8], h1[8];
+  __m256i xi, yi, zi, hp0, hp1, mask = _mm256_set1_epi32(255);
+  __m256 fx, fy, fz, fx1, fy1, fz1, u, v, w;
+  __m256 one = _mm256_set1_ps(1.0f);
+  for (i = 0; i + 8 <= n; i += 8) {
+    fx = reich_noise_floor_avx2(_mm256_loadu_ps(xs + i), &xi);
+    fy = reich_noise_floor_avx2(_mm256_loadu_ps(ys + i), &yi);
+    fz = reich_noise_floor_avx2(_mm256_loadu_ps(zs + i), &zi);
+    _mm256_storeu_si256((__m256i*)X, _mm256_and_si256(xi, mask));
+    _mm256_storeu_si256((__m256i*)Y, _mm256_and_si256(yi, mask));
+    _mm256_storeu_si256((__m256i*)Z, _mm256_and_si256(zi, mask));
+    for (k = 0; k < 8; ++k) {
+      reich_noise_hash3(X[k], Y[k], Z[k], &h0[k], &h1[k]);
+    }
+    hp0 = _mm256_loadu_si256((const __m256i*)h0);
+    hp1 = _mm256_loadu_si256((const __m256i*)h1);
+    fx1 = _mm256_sub_ps(fx, one);
+    fy1 = _mm256_sub_ps(fy, one);
+    fz1 = _mm256_sub_ps(fz, one);
+    u = reich_noise_fade_avx2(fx);
+    v = reich_noise_fade_avx2(fy);
+    w = reich_noise_fade_avx2(fz);
+    _mm256_storeu_ps(
+        out + i,
+        reich_noise_lerp_avx2(
+            reich_noise_lerp_avx2(
+                reich_noise_lerp_avx2(
+                    reich_noise_grad_avx2(hp0, fx, fy, fz),
+                    reich_noise_grad_avx2(
+                        _mm256_srli_epi32(hp0, 8), fx1, fy, fz),
+                    u),
+                reich_noise_lerp_avx2(
+                    reich_noise_grad_avx2(
+                        _mm256_srli_epi32(hp0, 16), fx, fy1, fz),
+                    reich_noise_grad_avx2(
+                        _mm256_srli_epi32(hp0, 24), fx1, fy1, fz),
+                    u),
+                v),
+            reich_noise_lerp_avx2(
+                reich_noise_lerp_avx2(
+                    reich_noise_grad_avx2(hp1, fx, fy, fz1),
+                    reich_noise_grad_avx2(
+                        _mm256_srli_epi32(hp1, 8), fx1, fy, fz1),
+                    u),
+                reich_noise_lerp_avx2(
+                    reich_noise_grad_avx2(
+                        _mm256_srli_epi32(hp1, 16), fx, fy1, fz1),
+                    reich_noise_grad_avx2(
+                        _mm256_srli_epi32(hp1, 24), fx1, fy1, fz1),
+                    u),
+                v),
+            w));
+  }
+  reich_noise3_n_sse2(xs + i, ys + i, zs + i, out + i, n - i);
+}
+
+#endif
+
+REICH_API int32
+reich_noise2_n(const real32* xs, const real32* ys, real32* out, int32 count) {
+  int32 i;
+  if (!xs || !ys || !out || count < 0) { return 0; }
+#if defined(REICH_SIMD_X86)
+  if (reich_simd_level() == REICH_SIMD_AVX2) {
+    reich_noise2_n_avx2(xs, ys, out, count);
+    return 1;
+  }
+  if (reich_simd_level() == REICH_SIMD_SSE2) {
+    reich_noise2_n_sse2(xs, ys, out, count);
+    return 1;
+  }
+#endif
+  for (i = 0; i < count; ++i) { out[i] = reich_noise2(xs[i], ys[i]); }
+  return 1;
+}
+
+REICH_API int32 reich_noise3_n(
+    const real32* xs, const real32* ys, const real32* zs, real32* out,
+    int32 count) {
+  int32 i;
+  if (!xs || !ys || !zs || !out || count < 0) { return 0; }
+#if defined(REICH_SIMD_X86)
+  if (reich_simd_level() == REICH_SIMD_AVX2) {
+    reich_noise3_n_avx2(xs, ys, zs, out, count);
+    return 1;
+  }
+  if (reich_simd_level() == REICH_SIMD_SSE2) {
+    reich_noise3_n_sse2(xs, ys, zs, out, count);
+    return 1;
+  }
+#endif
+  for (i = 0; i < count; ++i) { out[i] = reich_noise3(xs[i], ys[i], zs[i]); }
+  return 1;
+}
+
+REICH_API int32 reich_noise_fbm2_n(
+    const real32* xs, const real32* ys, real32* out, int32 count,
+    int32 octaves, real32 lacunarity, real32 gain) {
+  real32 px[REICH_NOISE_TILE], py[REICH_NOISE_TILE], n[REICH_NOISE_TILE];
+  real32 amplitude, frequency, maxVal;
+  int32 base, len, o, i;
+  if (!xs || !ys || !out || count < 0) { return 0; }
+  for (base = 0; base < count; base += REICH_NOISE_TILE) {
+    len = REICH_MIN(REICH_NOISE_TILE, count - base);
+    amplitude = 1.0f;
+    frequency = 1.0f;
+    maxVal = 0.0f;
+    for (i = 0; i < len; ++i) { out[base + i] = 0.0f; }
+    for (o = 0; o < octaves; ++o) {
+      for (i = 0; i < len; ++i) {
+        px[i] = xs[base + i] * frequency;
+        py[i] = ys[base + i] * frequency;
       }
+      reich_noise2_n(px, py, n, len);
+      for (i = 0; i < len; ++i) { out[base + i] += n[i] * amplitude; }
+      maxVal += amplitude;
+      amplitude *= gain;
+      frequency *= lacunarity;
+    }
+    for (i = 0; i < len; ++i) {
+      out[base + i] = maxVal > 0.0f ? (out[base + i] / maxVal) : 0.0f;
     }
   }
-  reich_dirty_add(ctx, minX, minY, maxX + 1, maxY + 1);
   return 1;
 }
 
+/* fbm2 over the rectangle xs x ys, row-major into out. Work is tiled so
+ * that, per octave, the x lattice and fade terms are computed once per
+ * column and the y terms once per row. Columns that land in the same
+ * lattice cell share one packed hash word per row. */
+REICH_API int32 reich_noise_fbm2_grid(
+    real32* out, const real32* xs, int32 w, const real32* ys, int32 h,
+    int32 octaves, real32 lacunarity, real32 gain) {
+  real32 fx[REICH_NOISE_TILE], u[REICH_NOISE_TILE];
+  int32 cell[REICH_NOISE_TILE], cellX[REICH_NOISE_TILE];
+  uint32 hashes[REICH_NOISE_TILE];
+  real32 amplitude, frequency, maxVal, x, y;
+  reichNoiseRow row;
+  PFREICHNOISEROW kernel = reich_noise2_row_scalar;
+  int32 tx, ty, tw, th, i, j, o, X, Y, cells;
+  real32* dst;
+
+  if (!out || !xs || !ys || w < 0 || h < 0) { return 0; }
+#if defined(REICH_SIMD_X86)
+  if (reich_simd_level() == REICH_SIMD_AVX2) {
+    kernel = reich_noise2_row_avx2;
+  } else if (reich_simd_level() == REICH_SIMD_SSE2) {
+    kernel = reich_noise2_row_sse2;
+  }
+#endif
+  row.fx = fx;
+  row.u = u;
+  row.cell = cell;
+  row.hashes = hashes;
+
+  for (ty = 0; ty < h; ty += REICH_NOISE_TILE) {
+    th = REICH_MIN(REICH_NOISE_TILE, h - ty);
+    for (tx = 0; tx < w; tx += REICH_NOISE_TILE) {
+      tw = REICH_MIN(REICH_NOISE_TILE, w - tx);
+      for (j = 0; j < th; ++j) {
+        dst = out + (reichSize)(ty + j) * w + tx;
+        for (i = 0; i < tw; ++i) { dst[i] = 0.0f; }
+      }
+      amplitude = 1.0f;
+      frequency = 1.0f;
+      maxVal = 0.0f;
+      for (o = 0; o < octaves; ++o) {
+        cells = 0;
+        for (i = 0; i < tw; ++i) {
+          x = xs[tx + i] * frequency;
+          X = REICH_FAST_FLOOR(x);
+          fx[i] = x - X;
+          u[i] = fx[i] * fx[i] * fx[i] *
+              (fx[i] * (fx[i] * 6.0f - 15.0f) + 10.0f);
+          X &= 255;
+          if (cells == 0 || cellX[cells - 1] != X) { cellX[cells++] = X; }
+          cell[i] = cells - 1;
+        }
+        row.amplitude = amplitude;
+        for (j = 0; j < th; ++j) {
+          y = ys[ty + j] * frequency;
+          Y = REICH_FAST_FLOOR(y);
+          row.fy = y - Y;
+          row.v = row.fy * row.fy * row.fy *
+              (row.fy * (row.fy * 6.0f - 15.0f) + 10.0f);
+          Y &= 255;
+          for (i = 0; i < cells; ++i) {
+            hashes[i] = reich_noise_hash2(cellX[i], Y);
+          }
+          kernel(out + (reichSize)(ty + j) * w + tx, tw, &row);
+        }
+        maxVal += amplitude;
+        amplitude *= gain;
+        frequency *= lacunarity;
+      }
+      for (j = 0; j < th; ++j) {
+        dst = out + (reichSize)(ty + j) * w + tx;
+        for (i = 0; i < tw; ++i) {
+          dst[i] = maxVal > 0.0f ? (dst[i] / maxVal) : 0.0f;
+        }
+      }
+    }
+  }
+  return 1;
+}
+
+/* TEXTURE *******************************************************************/
+
+REICH_API int32 reich_texture_mip_pixels(int32 w, int32 h) {
+  int32 total = 0;
+  while (w > 1 || h > 1) {
+    w = w > 1 ? w >> 1 : 1;
+    h = h > 1 ? h >> 1 : 1;
+    total += w * h;
+  }
+  return total;
+}
+
+REICH_API int32 reich_texture_init(
+    reichTexture* tex, uint32* pixels, int32 w, int32 h, uint32* mipPixels) {
+  int32 level, x, y, sw, sh, dw, dh, x1, y1;
+  uint32 *src, *dst, a, b, c, d;
+
+  if (!tex || !pixels || w <= 0 || h <= 0 || w > 32768 || h > 32768) {
+    reich_sys_log(REICH_LOG_ERROR, "Texture size must be 1 to 32768");
+    return 0;
+  }
+  reich_memset(tex, 0, sizeof(*tex));
+  tex->width = w;
+  tex->height = h;
+  tex->levels = 1;
+  tex->mips[0] = pixels;
+  if (!mipPixels) { return 1; }
+
+  sw = w;
+  sh = h;
+  dst = mipPixels;
+  for (level = 1; (sw > 1 || sh > 1) && level < REICH_TEX_MAX_LEVELS;
+       ++level) {
+    src = tex->mips[level - 1];
+    dw = sw > 1 ? sw >> 1 : 1;
+    dh = sh > 1 ? sh >> 1 : 1;
+    for (y = 0; y < dh; ++y) {
+      y1 = sh > 1 ? 1 : 0;
+      for (x = 0; x < dw; ++x) {
+        x1 = sw > 1 ? 1 : 0;
+        a = src[(y * 2) * sw + x * 2];
+        b = src[(y * 2) * sw + x * 2 + x1];
+        c = src[(y * 2 + y1) * sw + x * 2];
+        d = src[(y * 2 + y1) * sw + x * 2 + x1];
+        dst[y * dw + x] =
+            ((((a >> 24) + (b >> 24) + (c >> 24) + (d >> 24) + 2) >> 2)
+             << 24) |
+            (((((a >> 16) & 0xFF) + ((b >> 16) & 0xFF) + ((c >> 16) & 0xFF) +
+               ((d >> 16) & 0xFF) + 2) >> 2) << 16) |
+            (((((a >> 8) & 0xFF) + ((b >> 8) & 0xFF) + ((c >> 8) & 0xFF) +
+               ((d >> 8) & 0xFF) + 2) >> 2) << 8) |
+            (((a & 0xFF) + (b & 0xFF) + (c & 0xFF) + (d & 0xFF) + 2) >> 2);
+      }
+    }
+    tex->mips[level] = dst;
+    tex->levels = level + 1;
+    dst += dw * dh;
+    sw = dw;
+    sh = dh;
+  }
+  return 1;
+}
+
+static uint32 reich_tex_lerp(uint32 a, uint32 b, uint32 f) {
+  uint32 rb = (((a & 0xFF00FF) * (256 - f) + (b & 0xFF00FF) * f) >> 8);
+  uint32 g = (((a & 0x00FF00) * (256 - f) + (b & 0x00FF00) * f) >> 8);
+  return (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+static uint32 reich_tex_wrap(int32 i, int32 n) {
+  i %= n;
+  return (uint32)(i < 0 ? i + n : i);
+}
+
+/* Texture coordinates are carried as 16.16 texels in uint32 so wrapping is
+ * the natural integer overflow followed by a power-of-two mask. Other sizes
+ * take the integer texel as signed and wrap it with a modulo. Attributes
+ * are divided by w exactly every REICH_TEX_SUBSPAN pixels, aligned to
+ * absolute screen x so the result does not depend on the clip, and stepped
+ * linearly in between. */
+#define REICH_TEX_SUBSPAN_BITS 4
+#define REICH_TEX_SUBSPAN      (1 << REICH_TEX_SUBSPAN_BITS)
+
+REICH_API int32 reich_draw_triangle_tex(
+    reichContext* ctx,
+    const reichTexture* tex,
+    const reichTexVertex* p0,
+    const reichTexVertex* p1,
+    const reichTexVertex* p2,
+    uint32 tint,
+    int32 flags) {
+  reichTriEdges t;
+  const reichTexVertex* v[3];
+  real64 px[3], py[3], q[3], uq[3], vq[3];
+  real64 ax, ay, bx, by, inv, dqdx, dqdy, duqdx, duqdy, dvqdx, dvqdy;
+  real64 qRow, uqRow, vqRow, qb, qMin, qMax, uA, vA, uB, vB, su, sv, ratio;
+  int64 e[3];
+  int32 level, lw, lh, shiftW, maskW, maskH, row, x, sx, ex, bx0, n, k, i;
+  int32 bilinear, pot, drawn;
+  uint32 dU, dV, U, V, texel, fu, fv, tx, ty, tx1, ty1, color;
+  uint32 tintR = REICH_GET_R(tint), tintG = REICH_GET_G(tint);
+  uint32 tintB = REICH_GET_B(tint), alpha = REICH_GET_A(tint);
+  const uint32* texels;
+  uint32* dst;
+
+  REICH_PROF_PRIM(ctx, REICH_PRIM_TEXTURED);
+  if (!tex || tex->levels <= 0 || alpha == 0) { return 0; }
+  if (p0->w <= 0.0f || p1->w <= 0.0f || p2->w <= 0.0f) { return 0; }
+  if (!reich_tri_setup(ctx, p0->x, p0->y, p1->x, p1->y, p2->x, p2->y, &t)) {
+    return 1;
+  }
+  v[0] = p0;
+  v[1] = t.swapped ? p2 : p1;
+  v[2] = t.swapped ? p1 : p2;
+
+  /* One mip level per triangle: each level quarters the texel area, so
+   * step down while the texel to pixel area ratio stays above 2. */
+  level = 0;
+  if ((flags & REICH_TEX_MIPMAP) && tex->levels > 1) {
+    ratio = ((real64)v[1]->u - v[0]->u) * ((real64)v[2]->v - v[0]->v) -
+            ((real64)v[2]->u - v[0]->u) * ((real64)v[1]->v - v[0]->v);
+    if (ratio < 0.0) { ratio = -ratio; }
+    ratio *= (real64)tex->width * (real64)tex->height *
+             (real64)(REICH_TRI_SUBPIXEL * REICH_TRI_SUBPIXEL) /
+             (real64)t.area;
+    while (level < tex->levels - 1 && ratio > 2.0) {
+      ratio *= 0.25;
+      ++level;
+    }
+  }
+  lw = tex->width >> level;
+  lh = tex->height >> level;
+  if (lw < 1) { lw = 1; }
+  if (lh < 1) { lh = 1; }
+  pot = (lw & (lw - 1)) == 0 && (lh & (lh - 1)) == 0;
+  for (shiftW = 0; (1 << shiftW) < lw; ++shiftW) {}
+  maskW = lw - 1;
+  maskH = lh - 1;
+  texels = tex->mips[level];
+  bilinear = (flags & REICH_TEX_BILINEAR) != 0;
+
+  /* Screen space planes for 1/w, u/w and v/w through the snapped
+   * vertices. */
+  for (i = 0; i < 3; ++i) {
+    px[i] = (real64)t.vx[i] / REICH_TRI_SUBPIXEL;
+    py[i] = (real64)t.vy[i] / REICH_TRI_SUBPIXEL;
+    q[i] = 1.0 / (real64)v[i]->w;
+    uq[i] = (real64)v[i]->u * q[i];
+    vq[i] = (real64)v[i]->v * q[i];
+  }
+  /* 1/w inside the triangle stays within the vertex range; clamping the
+   * extrapolated subspan ends keeps the divide away from zero. */
+  qMin = REICH_MIN(q[0], REICH_MIN(q[1], q[2]));
+  qMax = REICH_MAX(q[0], REICH_MAX(q[1], q[2]));
+  ax = px[1] - px[0];
+  ay = py[1] - py[0];
+  bx = px[2] - px[0];
+  by = py[2] - py[0];
+  inv = 1.0 / (ax * by - bx * ay);
+  dqdx = ((q[1] - q[0]) * by - (q[2] - q[0]) * ay) * inv;
+  dqdy = ((q[2] - q[0]) * ax - (q[1] - q[0]) * bx) * inv;
+  duqdx = ((uq[1] - uq[0]) * by - (uq[2] - uq[0]) * ay) * inv;
+  duqdy = ((uq[2] - uq[0]) * ax - (uq[1] - uq[0]) * bx) * inv;
+  dvqdx = ((vq[1] - vq[0]) * by - (vq[2] - vq[0]) * ay) * inv;
+  dvqdy = ((vq[2] - vq[0]) * ax - (vq[1] - vq[0]) * bx) * inv;
+
+  su = (real64)lw * 65536.0;
+  sv = (real64)lh * 65536.0;
+  e[0] = t.origin[0];
+  e[1] = t.origin[1];
+  e[2] = t.origin[2];
+  drawn = 0;
+  for (row = t.minY; row <= t.maxY; ++row) {
+    if (reich_tri_row(&t, e, &sx, &ex)) {
+      /* Plane values at the centre of pixel (0, row). */
+      ay = (real64)row + 0.5 - py[0];
+      ax = 0.5 - px[0];
+      qRow = q[0] + dqdx * ax + dqdy * ay;
+      uqRow = uq[0] + duqdx * ax + duqdy * ay;
+      vqRow = vq[0] + dvqdx * ax + dvqdy * ay;
+      dst = ctx->canvas.pixels + row * ctx->canvas.width + sx;
+      x = sx;
+      while (x <= ex) {
+        bx0 = x & ~(REICH_TEX_SUBSPAN - 1);
+        qb = qRow + dqdx * bx0;
+        qb = REICH_CLAMP(qb, qMin, qMax);
+        uA = (uqRow + duqdx * bx0) / qb * su;
+        vA = (vqRow + dvqdx * bx0) / qb * sv;
+        qb = qRow + dqdx * (bx0 + REICH_TEX_SUBSPAN);
+        qb = REICH_CLAMP(qb, qMin, qMax);
+        uB = (uqRow + duqdx * (bx0 + REICH_TEX_SUBSPAN)) / qb * su;
+        vB = (vqRow + dvqdx * (bx0 + REICH_TEX_SUBSPAN)) / qb * sv;
+        dU = (uint32)(int64)((uB - uA) / REICH_TEX_SUBSPAN);
+        dV = (uint32)(int64)((vB - vA) / REICH_TEX_SUBSPAN);
+        U = (uint32)(int64)uA + dU * (uint32)(x - bx0);
+        V = (uint32)(int64)vA + dV * (uint32)(x - bx0);
+        n = bx0 + REICH_TEX_SUBSPAN - x;
+        if (n > ex - x + 1) { n = ex - x + 1; }
+        if (bilinear) {
+          U -= 32768;
+          V -= 32768;
+        }
+        for (k = 0; k < n; ++k) {
+          if (pot) {
+            tx = (U >> 16) & (uint32)maskW;
+            ty = ((V >> 16) & (uint32)maskH) << shiftW;
+          } else {
+            tx = reich_tex_wrap((int32)U >> 16, lw);
+            ty = reich_tex_wrap((int32)V >> 16, lh) * (uint32)lw;
+          }
+          if (bilinear) {
+            fu = (U >> 8) & 0xFF;
+            fv = (V >> 8) & 0xFF;
+            tx1 = tx < (uint32)maskW ? tx + 1 : 0;
+            ty1 = ty < (uint32)(maskH * lw) ? ty + (uint32)lw : 0;
+            texel = reich_tex_lerp(
+                reich_tex_lerp(texels[ty + tx], texels[ty + tx1], fu),
+                reich_tex_lerp(texels[ty1 + tx], texels[ty1 + tx1], fu),
+                fv);
+          } else {
+            texel = texels[ty + tx];
+          }
+          color = (((((texel >> 16) & 0xFF) * tintR) >> 8) << 16) |
+                  (((((texel >> 8) & 0xFF) * tintG) >> 8) << 8) |
+                  (((texel & 0xFF) * tintB) >> 8);
+          if (alpha == 255) {
+            *dst = 0xFF000000 | color;
+          } else {
+            color |= alpha << 24;
+            if (ctx->canvas.format == REICH_FORMAT_PREMUL) {
+              REICH_BLEND_PREMUL(color, *dst);
+            } else {
+              REICH_BLEND_FAST(color, *dst);
+            }
+          }
+          ++dst;
+          U += dU;
+          V += dV;
+        }
+        REICH_PROF_PIXELS(ctx, n, alpha);
+        x += n;
+      }
+      drawn = 1;
+    }
+    e[0] += t.stepY[0];
+    e[1] += t.stepY[1];
+    e[2] += t.stepY[2];
+  }
+  if (drawn) { reich_dirty_add(ctx, t.minX, t.minY, t.maxX + 1, t.maxY + 1); }
+  return 1;
+}
 
 REICH_API void reich_draw_triangle_textured(
     reichContext* ctx,
@@ -3565,73 +6827,36 @@ REICH_API void reich_draw_triangle_textured(
     int texWidth,
     int texHeight,
     uint32 tintColor) {
-
-  int minPixelX, maxPixelX, minPixelY, maxPixelY, px, py, sampleX, sampleY;
-  real64 determinant, invDeterminant, pixelX, pixelY, barycentric1, barycentric2, barycentric3;
-  uint32 finalR, finalG, finalB, texColor;
-  uint32 tintR = (tintColor >> 16) & 0xFF, tintG = (tintColor >> 8) & 0xFF, tintB = tintColor & 0xFF;
-	uint32* pix = NULL;
-  minPixelX = (int)reich_floor((float)REICH_MIN(v0X, REICH_MIN(v1X, v2X)));
-  maxPixelX = (int)reich_ceil((float)REICH_MAX(v0X, REICH_MAX(v1X, v2X)));
-  minPixelY = (int)reich_floor((float)REICH_MIN(v0Y, REICH_MIN(v1Y, v2Y)));
-  maxPixelY = (int)reich_ceil((float)REICH_MAX(v0Y, REICH_MAX(v1Y, v2Y)));
-
-  if (minPixelX < ctx->clip.x1) { minPixelX = ctx->clip.x1; }
-  if (maxPixelX > ctx->clip.x2) { maxPixelX = ctx->clip.x2; }
-  if (minPixelY < ctx->clip.y1) { minPixelY = ctx->clip.y1; }
-  if (maxPixelY > ctx->clip.y2) { maxPixelY = ctx->clip.y2; }
-
-  determinant = (v1Y - v2Y) * (v0X - v2X) + (v2X - v1X) * (v0Y - v2Y);
-  if (determinant > -0.0001 && determinant < 0.0001) { return; }
-
-  invDeterminant = 1.0 / determinant;
-
-  for (py = minPixelY; py <= maxPixelY; py++) {
-    pix = &ctx->canvas.pixels[minPixelX + py*ctx->canvas.width];
-		for (px = minPixelX; px <= maxPixelX; px++) {
-      pixelX = (real64)px;
-      pixelY = (real64)py;
-
-      barycentric1 = ((v1Y - v2Y) * (pixelX - v2X) + (v2X - v1X) * (pixelY - v2Y)) * invDeterminant;
-      barycentric2 = ((v2Y - v0Y) * (pixelX - v2X) + (v0X - v2X) * (pixelY - v2Y)) * invDeterminant;
-      barycentric3 = 1.0 - barycentric1 - barycentric2;
-
-      if (barycentric1 >= 0.0 && barycentric2 >= 0.0 && barycentric3 >= 0.0) {
-        sampleX = (int)((barycentric1 * u0 + barycentric2 * u1 + barycentric3 * u2) * texWidth) % texWidth;
-        sampleY = (int)((barycentric1 * v0 + barycentric2 * v1 + barycentric3 * v2) * texHeight) % texHeight;
-
-        if (sampleX < 0) { sampleX += texWidth; }
-        if (sampleY < 0) { sampleY += texHeight; }
-
-        texColor = textureData[sampleY * texWidth + sampleX];
-
-        finalR = (((texColor >> 16) & 0xFF) * tintR) >> 8;
-        finalG = (((texColor >> 8) & 0xFF) * tintG) >> 8;
-        finalB = ((texColor & 0xFF) * tintB) >> 8;
-				*pix =  0xFF000000 | (finalR << 16) | (finalG << 8) | finalB;
-      }
-			pix++;
-    }
+  reichTexture tex;
+  reichTexVertex p[3];
+  if (!reich_texture_init(&tex, textureData, texWidth, texHeight, NULL)) {
+    return;
   }
+  p[0].x = (real32)v0X; p[0].y = (real32)v0Y; p[0].w = 1.0f;
+  p[0].u = u0; p[0].v = v0;
+  p[1].x = (real32)v1X; p[1].y = (real32)v1Y; p[1].w = 1.0f;
+  p[1].u = u1; p[1].v = v1;
+  p[2].x = (real32)v2X; p[2].y = (real32)v2Y; p[2].w = 1.0f;
+  p[2].u = u2; p[2].v = v2;
+  reich_draw_triangle_tex(
+      ctx, &tex, &p[0], &p[1], &p[2], tintColor | 0xFF000000,
+      REICH_TEX_NEAREST);
 }
 
 
 int32 reich_draw_quad_fill(reichContext* ctx,
     real32 x0, real32 y0, real32 x1, real32 y1, real32 x2, real32 y2,
     real32 x3, real32 y3, uint32 colour) {
-  int32 y, x;
-  int32 i, j, cnt;
+  int32 y, i, j, cnt, startY, endY;
   real32 yi, xi, yj, xj;
   real32 minY, maxY, xMin, xMax;
   real32 vx[4];
   real32 vy[4];
-  uint32 *data = ctx->canvas.pixels;
-  int32 width = ctx->canvas.width;
-  uint32 col = colour;
+  uint32 alpha = REICH_GET_A(colour);
   real32 inters[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-  int32 inBounds = 0;
-	uint32* pix = NULL;
-	vx[0] = x0;
+  REICH_PROF_PRIM(ctx, REICH_PRIM_QUAD);
+  if (alpha == 0) { return FALSE; }
+  vx[0] = x0;
   vx[1] = x1;
   vx[2] = x2;
   vx[3] = x3;
@@ -3643,20 +6868,16 @@ int32 reich_draw_quad_fill(reichContext* ctx,
 
   minY = vy[0];
   maxY = vy[0];
-	inBounds =
-		x0 >= ctx->clip.x1 && x0 < ctx->clip.x2 &&
-		x1 >= ctx->clip.x1 && x1 < ctx->clip.x2 &&
-		x2 >= ctx->clip.x1 && x2 < ctx->clip.x2 &&
-		x3 >= ctx->clip.x1 && x3 < ctx->clip.x2 &&
-		y0 >= ctx->clip.y1 && y0 < ctx->clip.y2 &&
-		y1 >= ctx->clip.y1 && y1 < ctx->clip.y2 &&
-		y2 >= ctx->clip.y1 && y2 < ctx->clip.y2 &&
-		y3 >= ctx->clip.y1 && y3 < ctx->clip.y2;
   for (i = 1; i < 4; i++) {
     if (vy[i] < minY) { minY = vy[i]; }
     if (vy[i] > maxY) { maxY = vy[i]; }
   }
-  for (y = (int32)(reich_ceild(minY)); y <= (int32)(REICH_FAST_FLOOR(maxY)); y++) {
+  /* Rows and spans are clamped to the clip rect, so a tile clip confines
+   * the quad exactly to its own pixels. */
+  startY = (int32)(reich_ceild(minY));
+  endY = (int32)(REICH_FAST_FLOOR(maxY));
+  REICH_CLAMP_Y_INCL(ctx, startY, endY);
+  for (y = startY; y <= endY; y++) {
     inters[0] = 0.0f;
     inters[1] = 0.0f;
     inters[2] = 0.0f;
@@ -3668,7 +6889,7 @@ int32 reich_draw_quad_fill(reichContext* ctx,
       if ((yi <= y && yj > y) || (yj <= y && yi > y)) {
         xi = vx[i];
         xj = vx[j];
-				inters[cnt++] = xi + (y - yi) * (xj - xi) / (yj - yi);
+        inters[cnt++] = xi + (y - yi) * (xj - xi) / (yj - yi);
       }
     }
     if (cnt < 2) { continue; }
@@ -3678,19 +6899,13 @@ int32 reich_draw_quad_fill(reichContext* ctx,
       if (inters[i] < xMin) { xMin = inters[i]; }
       if (inters[i] > xMax) { xMax = inters[i]; }
     }
-    if (xMin < 0) { xMin = 0; }
-    if (xMax >= width) { xMax = width - 1; }
-    if(inBounds) {
-			x = (int32)(reich_ceild(xMin));
-			pix = &data[x + y * width];
-      for (x = (int32)(reich_ceild(xMin)); x <= (int32)(REICH_FAST_FLOOR(xMax)); x++) {
-        *pix++ = col;
-    	}
-		} else {
-	  	for (x = (int32)(reich_ceild(xMin)); x <= (int32)(REICH_FAST_FLOOR(xMax)); x++) {
-        reich_draw_pixel(ctx, x, y, colour);
-    	}		
-		}
+    reich_draw_span(
+        ctx,
+        y,
+        (int32)(reich_ceild(xMin)),
+        (int32)(REICH_FAST_FLOOR(xMax)),
+        colour,
+        alpha);
   }
 
   return TRUE;
@@ -3699,6 +6914,7 @@ int32 reich_draw_quad_fill(reichContext* ctx,
 int32 reich_draw_quad(reichContext* ctx,
     real32 x0, real32 y0, real32 x1, real32 y1, real32 x2, real32 y2,
     real32 x3, real32 y3, uint32 col) {
+  REICH_PROF_PRIM(ctx, REICH_PRIM_QUAD);
   reich_draw_line(ctx, x0, y0, x1, y1, col);
   reich_draw_line(ctx, x1, y1, x2, y2, col);
   reich_draw_line(ctx, x2, y2, x3, y3, col);
@@ -3713,6 +6929,7 @@ REICH_API int32 reich_draw_ellipse_fill(
   uint32 alpha = REICH_GET_A(color);
   float ry2;
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_ELLIPSE);
   if (alpha == 0 || rx <= 0.0f || ry <= 0.0f) { return 0; }
 
   REICH_CALC_BOUNDS_RAD_INCL(cy, ry, minY, maxY);
@@ -3744,6 +6961,7 @@ REICH_API int32 reich_draw_ellipse(
   uint32 alpha = REICH_GET_A(color);
   float ry2, in_rx, in_ry, in_ry2;
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_ELLIPSE);
   if (alpha == 0 || rx <= 0.0f || ry <= 0.0f || thickness <= 0.0f) {
     return 0;
   }
@@ -3804,6 +7022,7 @@ REICH_API int32 reich_draw_bezier_quad(
     uint32 color) {
   int32 i;
   float t, invT, px, py, lastX, lastY;
+  REICH_PROF_PRIM(ctx, REICH_PRIM_CURVE);
   if (segments < 1) { segments = 1; }
   lastX = x1;
   lastY = y1;
@@ -3834,6 +7053,7 @@ REICH_API int32 reich_draw_bezier_cubic(
     uint32 color) {
   int32 i;
   float t, invT, px, py, lastX, lastY;
+  REICH_PROF_PRIM(ctx, REICH_PRIM_CURVE);
   if (segments < 1) { segments = 1; }
   lastX = x1;
   lastY = y1;
@@ -3857,6 +7077,7 @@ REICH_API int32 reich_draw_text(
   uint8 c, *font;
   uint32 kern = 4;
   if (!ctx || !str || ctx->activeFont >= ctx->fontCount) { return 0; }
+  REICH_PROF_PRIM(ctx, REICH_PRIM_TEXT);
   font = ctx->fonts[ctx->activeFont];
   fw = font[0];
   fh = font[1];
@@ -4261,8 +7482,11 @@ void reich_screen_to_world(reichContext* ctx, reichCamera* cam, real64 sX, real6
   real64 cEnY = (real64)ctx->canvas.height * 0.5;
   real64 rX = (sX - cX) / cam->zoom;
   real64 rY = ((sY - cEnY) / cam->zoom + dZ * cP) / sP;
-  *wX = cam->x + rX * cY + rY * sinY;
-  *wY = cam->y - rX * sinY + rY * cY;
+  /* reich_sin and reich_cos are approximations, so undo the rotation with
+   * its true inverse rather than its transpose */
+  real64 invDet = 1.0 / (cY * cY + sinY * sinY);
+  *wX = cam->x + (rX * cY + rY * sinY) * invDet;
+  *wY = cam->y + (rY * cY - rX * sinY) * invDet;
 }
 
 REICH_API uint32 reich_apply_lighting(
@@ -4443,6 +7667,7 @@ reich_canvas_create(reichArena* arena, int32 w, int32 h) {
   reichCanvas c;
   c.width = w;
   c.height = h;
+  c.format = REICH_FORMAT_STRAIGHT;
   c.pixels =
       (uint32*)reich_arena_alloc(arena, (reichSize)w * h * sizeof(uint32));
   if (c.pixels) {
@@ -4451,10 +7676,28 @@ reich_canvas_create(reichArena* arena, int32 w, int32 h) {
   return c;
 }
 
+static void reich_canvas_blend_pixel(
+    uint32* dst, uint32 s, int32 srcFormat, int32 dstFormat) {
+  if (srcFormat == REICH_FORMAT_PREMUL) {
+    if (dstFormat == REICH_FORMAT_PREMUL) {
+      REICH_BLEND_PREMUL_OVER(s, *dst);
+      return;
+    }
+    s = reich_color_unpremultiply(s);
+  } else if (dstFormat == REICH_FORMAT_PREMUL) {
+    REICH_BLEND_PREMUL(s, *dst);
+    return;
+  }
+  REICH_BLEND_FAST(s, *dst);
+}
+
 REICH_API int32
 reich_draw_canvas(reichContext* ctx, reichCanvas* src, int32 x, int32 y) {
   int32 sx, sy, dy, startX = 0, startY = 0, endX = src->width,
                     endY = src->height;
+  uint32* row;
+  uint32* srcRow;
+  REICH_PROF_PRIM(ctx, REICH_PRIM_CANVAS);
   if (x < ctx->clip.x1) { startX = ctx->clip.x1 - x; }
   if (y < ctx->clip.y1) { startY = ctx->clip.y1 - y; }
   if (x + endX > ctx->clip.x2) { endX = ctx->clip.x2 - x; }
@@ -4463,11 +7706,16 @@ reich_draw_canvas(reichContext* ctx, reichCanvas* src, int32 x, int32 y) {
 
   for (sy = startY; sy < endY; ++sy) {
     dy = y + sy;
-    for (sx = startX; sx < endX; ++sx) {
-      uint32 s = src->pixels[sy * src->width + sx];
-      if (REICH_GET_A(s) > 0) { REICH_DRAW_PIXEL_FAST(ctx, x + sx, dy, s); }
+    row = ctx->canvas.pixels + dy * ctx->canvas.width + x + startX;
+    srcRow = src->pixels + sy * src->width + startX;
+    for (sx = startX; sx < endX; ++sx, ++row) {
+      uint32 s = *srcRow++;
+      if (REICH_GET_A(s) > 0) {
+        reich_canvas_blend_pixel(row, s, src->format, ctx->canvas.format);
+      }
     }
   }
+  REICH_PROF_PIXELS(ctx, (endX - startX) * (endY - startY), 0);
   reich_dirty_add(ctx, x + startX, y + startY, x + endX, y + endY);
   return 1;
 }
@@ -4476,6 +7724,7 @@ REICH_API int32 reich_draw_canvas_scaled(
     reichContext* ctx, reichCanvas* src, int32 x, int32 y, int32 w, int32 h) {
   int32 dx, dy, startX, startY, endX, endY;
   float ratioX, ratioY;
+  REICH_PROF_PRIM(ctx, REICH_PRIM_CANVAS);
   startX = x;
   startY = y;
   endX = x + w;
@@ -4515,9 +7764,14 @@ REICH_API int32 reich_draw_canvas_scaled(
           (REICH_GET_B(c10) * (1.0f - sxf) + REICH_GET_B(c11) * sxf) * syf;
       s = ((uint32)fa << 24) | ((uint32)fr << 16) | ((uint32)fg << 8) |
           (uint32)fb;
-      REICH_DRAW_PIXEL_FAST(ctx, dx, dy, s);
+      reich_canvas_blend_pixel(
+          ctx->canvas.pixels + dy * ctx->canvas.width + dx,
+          s,
+          src->format,
+          ctx->canvas.format);
     }
   }
+  REICH_PROF_PIXELS(ctx, (endX - startX) * (endY - startY), 0);
   reich_dirty_add(ctx, startX, startY, endX, endY);
   return 1;
 }
@@ -4735,7 +7989,9 @@ REICH_API int32 reich_draw_glass_end(reichContext* ctx) {
   real32 mag, refStr, bDepth, bShape, bSmooth, bInt, boxCx, boxCy;
   reichCanvas* srcBg = &REICH_GLASS_CANVAS;
   reichDrawGlassConfig* config = &REICH_GLASS_CONFIG;
+  int32 premul = ctx->canvas.format == REICH_FORMAT_PREMUL;
 
+  REICH_PROF_PRIM(ctx, REICH_PRIM_GLASS);
   if (!REICH_SDF_BUFFER || !srcBg->pixels) { return 0; }
 
   bgW = srcBg->width;
@@ -4872,6 +8128,29 @@ REICH_API int32 reich_draw_glass_end(reichContext* ctx) {
         shapeAlpha = reich_smoothstep(1.5f, 0.0f, s);
         origBg = bgPix[idx];
 
+        if (premul) {
+          /* The background is already weighted by its own alpha, so the
+           * edge can be composited with plain multiply-adds. */
+          real32 inv = 1.0f - shapeAlpha;
+          uint32 ca;
+          rR = REICH_CLAMP(rR, 0.0f, 1.0f) * 255.0f * shapeAlpha +
+              (real32)REICH_GET_R(origBg) * inv;
+          gG = REICH_CLAMP(gG, 0.0f, 1.0f) * 255.0f * shapeAlpha +
+              (real32)REICH_GET_G(origBg) * inv;
+          bB = REICH_CLAMP(bB, 0.0f, 1.0f) * 255.0f * shapeAlpha +
+              (real32)REICH_GET_B(origBg) * inv;
+          ca = (uint32)(255.0f * shapeAlpha +
+                        (real32)REICH_GET_A(origBg) * inv);
+          finalColor = (ca << 24) | ((uint32)rR << 16) | ((uint32)gG << 8) |
+              (uint32)bB;
+          if (REICH_PIXEL_IN_CLIP(ctx, x, y)) {
+            ctx->canvas.pixels[y * ctx->canvas.width + x] = finalColor;
+            REICH_PROF_PIXELS(ctx, 1, 0);
+            reich_dirty_add(ctx, x, y, x + 1, y + 1);
+          }
+          continue;
+        }
+
         if (shapeAlpha < 1.0f) {
           real32 bgR = (real32)REICH_GET_R(origBg) / 255.0f;
           real32 bgG = (real32)REICH_GET_G(origBg) / 255.0f;
@@ -4885,7 +8164,10 @@ REICH_API int32 reich_draw_glass_end(reichContext* ctx) {
         cg = (uint32)(REICH_CLAMP(gG, 0.0f, 1.0f) * 255.0f);
         cb = (uint32)(REICH_CLAMP(bB, 0.0f, 1.0f) * 255.0f);
         finalColor = 0xFF000000 | (cr << 16) | (cg << 8) | cb;
-        reich_draw_pixel(ctx, x, y, finalColor);
+        if (REICH_PIXEL_IN_CLIP(ctx, x, y)) {
+          REICH_DRAW_PIXEL_FAST(ctx, x, y, finalColor);
+          reich_dirty_add(ctx, x, y, x + 1, y + 1);
+        }
       }
     }
   }
@@ -4910,6 +8192,7 @@ REICH_API int32 reich_draw_glass_begin(reichContext* ctx) {
     REICH_GLASS_CANVAS.width = bgW;
     REICH_GLASS_CANVAS.height = bgH;
     REICH_GLASS_CANVAS.pixels = bgPixels;
+    REICH_GLASS_CANVAS.format = ctx->canvas.format;
     REICH_SDF_BUFFER = sdfPixels;
 
     for (i = 0; i < total; ++i) { REICH_SDF_BUFFER[i] = 999999.0f; }
@@ -14,6 +14,7 @@ int main(void) {
   int r, g, b;
   int frame_counter = 0;
   char buffer[128];
+  tb_canvas_t canvas;
 
   /* Audio state */
   float phase = 0.0f;
@@ -31,6 +32,9 @@ int main(void) {
   /* Initialize Audio at 44.1kHz */
   tb_audio_init(44100);
 
+  /* Half-block canvas: two gradient pixels per cell */
+  tb_canvas_init(&canvas, tb_width(), tb_height(), TB_CANVAS_HALF);
+
   while (tb_update()) {
     /* Input Handling */
     if (tb_key_pressed(TB_KEY_ESCAPE)) { break; }
@@ -38,6 +42,11 @@ int main(void) {
     w = tb_width();
     h = tb_height();
 
+    if (canvas.width != w || canvas.height != h * 2) {
+      tb_canvas_free(&canvas);
+      tb_canvas_init(&canvas, w, h, TB_CANVAS_HALF);
+    }
+
     /* 1. Audio Synthesis Logic
        Generate a sine wave based on current frequency */
     samples_to_write = tb_audio_free_space();
@@ -62,21 +71,20 @@ int main(void) {
 
     /* Draw Full Gamut Gradient
        X axis = Red, Y axis = Green, Time = Blue */
-    for (y = 0; y < h; ++y) {
-      for (x = 0; x < w; ++x) {
+    for (y = 0; y < canvas.height; ++y) {
+      for (x = 0; x < canvas.width; ++x) {
         /* Calculate colors */
-        r = (x * 255) / (w > 0 ? w : 1);
-        g = (y * 255) / (h > 0 ? h : 1);
+        r = (x * 255) / (canvas.width > 0 ? canvas.width : 1);
+        g = (y * 255) / (canvas.height > 0 ? canvas.height : 1);
         b = (frame_counter * 2) % 256;
 
         /* Create a bouncing effect for Blue to avoid hard snapping */
         if (((frame_counter * 2) / 256) % 2 == 1) { b = 255 - b; }
 
-        /* We use a block character or similar to make it look solid,
-           or just tint the background of a space */
-        tb_put(x, y, ' ', TB_RGB(255, 255, 255), TB_RGB(r, g, b));
+        canvas.pixels[y * canvas.width + x] = TB_RGB(r, g, b);
       }
     }
+    tb_canvas_present(&canvas, 0, 0);
 
     /* 3. Text & Mouse Info Overlay */
     {
@@ -119,6 +127,7 @@ int main(void) {
     tb_sleep(16); /* Cap at ~60 FPS */
   }
 
+  tb_canvas_free(&canvas);
   tb_shutdown();
   return 0;
 }
@@ -38,6 +38,13 @@ extern "C" {
 #define TB_MOUSE_RIGHT  2
 #define TB_MOUSE_MIDDLE 3
 
+#define TB_OUTPUT_TRUECOLOR 0
+#define TB_OUTPUT_256       1
+#define TB_OUTPUT_16        2
+
+#define TB_CANVAS_HALF    0
+#define TB_CANVAS_BRAILLE 1
+
 #define TB_RGB(r, g, b) \
   ((((r) & 0xFF) << 16) | (((g) & 0xFF) << 8) | ((b) & 0xFF))
 
@@ -50,14 +57,50 @@ typedef struct {
   int wheel;
 } tb_mouse_state_t;
 
+typedef struct {
+  int bytes_written;
+  int cells_changed;
+  int runs;
+  int full_redraw;
+  int write_calls;
+  int write_stalls;
+  unsigned long total_bytes;
+  unsigned long frames;
+} tb_stats_t;
+
+/* Pixels drawn into cells: TB_CANVAS_HALF gives 1x2 pixels per cell with
+ * the upper half block, TB_CANVAS_BRAILLE 2x4 with braille dots. Braille
+ * pixels equal to background are unlit; the lit ones share one colour. */
+typedef struct {
+  unsigned int* pixels;
+  int width;
+  int height;
+  int mode;
+  unsigned int background;
+} tb_canvas_t;
+
 int tb_init(int width, int height, const char* title);
 void tb_shutdown(void);
 int tb_update(void);
 void tb_present(void);
+void tb_set_redraw_threshold(int percent);
+void tb_set_output_mode(int mode);
+void tb_set_sync_update(int enabled);
+tb_stats_t tb_stats(void);
 
 void tb_clear(unsigned int fg, unsigned int bg, char c);
 void tb_put(int x, int y, char c, unsigned int fg, unsigned int bg);
 void tb_print(int x, int y, const char* str, unsigned int fg, unsigned int bg);
+void tb_put_codepoint(
+    int x, int y, unsigned int cp, unsigned int fg, unsigned int bg);
+void tb_print_utf8(
+    int x, int y, const char* str, unsigned int fg, unsigned int bg);
+
+int tb_canvas_init(tb_canvas_t* canvas, int cells_w, int cells_h, int mode);
+void tb_canvas_free(tb_canvas_t* canvas);
+void tb_canvas_clear(tb_canvas_t* canvas, unsigned int color);
+void tb_canvas_put(tb_canvas_t* canvas, int x, int y, unsigned int color);
+void tb_canvas_present(const tb_canvas_t* canvas, int x, int y);
 int tb_width(void);
 int tb_height(void);
 
@@ -103,17 +146,52 @@ void tb_sleep(int ms);
 #define MAX_KEYS          512
 #define MAX_AUDIO_BUFFER  32768
 #define AUDIO_BUFFER_MASK (MAX_AUDIO_BUFFER - 1)
-
+#define REDRAW_THRESHOLD  50
+#define DIFF_MERGE_GAP    4
+#define CELL_BYTES_MAX    56
+#define OUT_SEGMENT_SIZE  65536
+#define OUT_IOV_MAX       64
+#define OUT_POLL_MS       100
+#define GLYPH_CACHE_SIZE  256
+
+/* A codepoint and the columns it covers: 1, or 2 for a wide glyph whose
+ * right half is a width 0 continuation cell. 12 bytes per cell. */
 typedef struct {
-  char ch;
+  unsigned int ch : 21;
+  unsigned int width : 2;
   unsigned int fg;
   unsigned int bg;
 } eng_cell_t;
 
+typedef struct {
+  unsigned int cp;
+  char utf8[4];
+} eng_glyph_t;
+
+typedef struct {
+  char* data;
+  int len;
+} eng_segment_t;
+
+typedef struct {
+  unsigned int fg_rgb;
+  unsigned int bg_rgb;
+  int fg;
+  int bg;
+} eng_sgr_t;
+
 typedef struct {
   int width;
   int height;
   eng_cell_t* back_buffer;
+  eng_cell_t* front_buffer;
+  int front_buffer_cap;
+  int force_redraw;
+  int redraw_threshold;
+  int output_mode;
+  int sync_update;
+  eng_glyph_t glyph_cache[GLYPH_CACHE_SIZE];
+  tb_stats_t stats;
   int keys[MAX_KEYS];
   int prev_keys[MAX_KEYS];
   tb_mouse_state_t mouse;
@@ -129,8 +207,9 @@ typedef struct {
 
   tb_thread_t audio_thread;
   int audio_sample_rate;
-  char* render_buffer;
-  int render_buffer_cap;
+  eng_segment_t* out_segments;
+  int out_segment_count;
+  int out_used;
 } eng_state_t;
 
 static eng_state_t g_engine;
@@ -141,6 +220,8 @@ static void eng_handle_input(int key, int down);
 static void eng_handle_mouse(int x, int y, int btn, int wheel, int down);
 static void eng_handle_resize(int w, int h);
 static void eng_audio_mix(float* output, int frames, int channels);
+static void eng_init_dec_lut(void);
+static int eng_encode_frame(const eng_cell_t* buffer, int w, int h);
 
 #ifdef _WIN32
 
@@ -447,59 +528,27 @@ static void pf_poll_events(void) {
 }
 
 static void pf_present_buffer(const eng_cell_t* buffer, int w, int h) {
-  if (!buffer) { return; }
-
-  int est_size = w * h * 45;
-
-  if (g_engine.render_buffer_cap < est_size) {
-    char* temp = (char*)realloc(g_engine.render_buffer, est_size);
-    if (!temp) { return; }
-    g_engine.render_buffer = temp;
-    g_engine.render_buffer_cap = est_size;
-  }
-
-  if (!g_engine.render_buffer) { return; }
-
-  char* ptr = g_engine.render_buffer;
-  char* end = g_engine.render_buffer + g_engine.render_buffer_cap;
-  int last_fg = -1;
-  int last_bg = -1;
-  int i;
-  int count = w * h;
-  int written_bytes;
-
-  written_bytes = _snprintf(ptr, (size_t)(end - ptr), "\x1b[H");
-  if (written_bytes > 0) { ptr += written_bytes; }
-
-  for (i = 0; i < count; ++i) {
-    eng_cell_t c = buffer[i];
-
-    if (c.fg != last_fg || c.bg != last_bg) {
-      written_bytes = _snprintf(
-          ptr,
-          (size_t)(end - ptr),
-          "\x1b[38;2;%d;%d;%dm\x1b[48;2;%d;%d;%dm",
-          (c.fg >> 16) & 0xFF,
-          (c.fg >> 8) & 0xFF,
-          c.fg & 0xFF,
-          (c.bg >> 16) & 0xFF,
-          (c.bg >> 8) & 0xFF,
-          c.bg & 0xFF);
-      if (written_bytes > 0) { ptr += written_bytes; }
-      last_fg = c.fg;
-      last_bg = c.bg;
+  DWORD written;
+  int i, off;
+  eng_segment_t* seg;
+  if (eng_encode_frame(buffer, w, h) <= 0) { return; }
+
+  for (i = 0; i < g_engine.out_used; ++i) {
+    seg = &g_engine.out_segments[i];
+    for (off = 0; off < seg->len; off += (int)written) {
+      g_engine.stats.write_calls++;
+      if (!WriteConsoleA(
+              g_platform.h_out,
+              seg->data + off,
+              (DWORD)(seg->len - off),
+              &written,
+              NULL) ||
+          written == 0) {
+        g_engine.force_redraw = 1;
+        return;
+      }
     }
-
-    if (ptr < end - 1) { *ptr++ = c.ch; }
   }
-
-  DWORD written;
-  WriteConsoleA(
-      g_platform.h_out,
-      g_engine.render_buffer,
-      (DWORD)(ptr - g_engine.render_buffer),
-      &written,
-      NULL);
 }
 
 static const CLSID CLSID_MMDeviceEnumerator_Local = {
@@ -794,12 +843,15 @@ static int tb_update_platform(void) {
 
 #else
 
+#include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
@@ -810,6 +862,7 @@ static int tb_update_platform(void) {
 
 typedef struct {
   struct termios orig_termios;
+  int orig_stdout_flags;
   int console_initialized;
 #ifndef TB_NO_AUDIO
   snd_pcm_t* audio_handle;
@@ -909,6 +962,14 @@ static int pf_init_console(int w, int h, const char* title) {
   signal(SIGTERM, pf_signal_handler);
   signal(SIGWINCH, pf_winch_handler);
 
+  /* Frames are flushed with writev and poll, so a slow pty stalls the
+   * present instead of blocking inside a half-written escape sequence */
+  g_platform.orig_stdout_flags = fcntl(STDOUT_FILENO, F_GETFL);
+  if (g_platform.orig_stdout_flags != -1) {
+    fcntl(
+        STDOUT_FILENO, F_SETFL, g_platform.orig_stdout_flags | O_NONBLOCK);
+  }
+
   if (w == 0 || h == 0) {
     if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != -1) {
       w = ws.ws_col;
@@ -927,6 +988,10 @@ static int pf_init_console(int w, int h, const char* title) {
 static void pf_close_console(void) {
   if (!g_platform.console_initialized) { return; }
 
+  if (g_platform.orig_stdout_flags != -1) {
+    fcntl(STDOUT_FILENO, F_SETFL, g_platform.orig_stdout_flags);
+  }
+
   printf("\x1b[?1006l\x1b[?1015l\x1b[?1002l\x1b[?1000l");
   printf("\x1b[?25h\x1b[?1049l");
   fflush(stdout);
@@ -1130,57 +1195,57 @@ static void pf_poll_events(void) {
   }
 }
 
+/* Hands the frame segments to writev as they are, resuming mid-segment
+ * after a short write and waiting in poll while the pty is full. Gives up
+ * on a hard error or shutdown and redraws everything next frame. */
 static void pf_present_buffer(const eng_cell_t* buffer, int w, int h) {
-  if (!buffer) { return; }
-
-  int est_size = w * h * 45;
-
-  if (g_engine.render_buffer_cap < est_size) {
-    char* temp = (char*)realloc(g_engine.render_buffer, est_size);
-    if (!temp) { return; }
-    g_engine.render_buffer = temp;
-    g_engine.render_buffer_cap = est_size;
-  }
-
-  if (!g_engine.render_buffer) { return; }
-
-  char* ptr = g_engine.render_buffer;
-  char* end = g_engine.render_buffer + g_engine.render_buffer_cap;
-  int last_fg = -1;
-  int last_bg = -1;
-  int i;
-  int count = w * h;
-  int written_bytes;
-
-  written_bytes = snprintf(ptr, (size_t)(end - ptr), "\x1b[H");
-  if (written_bytes > 0) { ptr += written_bytes; }
+  struct iovec iov[OUT_IOV_MAX];
+  struct pollfd pfd;
+  eng_segment_t* seg;
+  int first = 0;
+  int off = 0;
+  int i, cnt;
+  ssize_t n;
+
+  if (eng_encode_frame(buffer, w, h) <= 0) { return; }
+
+  while (first < g_engine.out_used) {
+    cnt = 0;
+    for (i = first; i < g_engine.out_used && cnt < OUT_IOV_MAX; ++i) {
+      seg = &g_engine.out_segments[i];
+      iov[cnt].iov_base = seg->data + (i == first ? off : 0);
+      iov[cnt].iov_len = (size_t)(seg->len - (i == first ? off : 0));
+      ++cnt;
+    }
 
-  for (i = 0; i < count; ++i) {
-    eng_cell_t c = buffer[i];
-
-    if (c.fg != last_fg || c.bg != last_bg) {
-      written_bytes = snprintf(
-          ptr,
-          (size_t)(end - ptr),
-          "\x1b[38;2;%d;%d;%dm\x1b[48;2;%d;%d;%dm",
-          (c.fg >> 16) & 0xFF,
-          (c.fg >> 8) & 0xFF,
-          c.fg & 0xFF,
-          (c.bg >> 16) & 0xFF,
-          (c.bg >> 8) & 0xFF,
-          c.bg & 0xFF);
-      if (written_bytes > 0) { ptr += written_bytes; }
-      last_fg = c.fg;
-      last_bg = c.bg;
+    g_engine.stats.write_calls++;
+    n = writev(STDOUT_FILENO, iov, cnt);
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+          __sync_add_and_fetch(&g_engine.running, 0)) {
+        g_engine.stats.write_stalls++;
+        pfd.fd = STDOUT_FILENO;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, OUT_POLL_MS);
+        continue;
+      }
+      g_engine.force_redraw = 1;
+      return;
     }
 
-    if (ptr < end - 1) { *ptr++ = c.ch; }
+    while (n > 0 && first < g_engine.out_used) {
+      seg = &g_engine.out_segments[first];
+      if (n >= seg->len - off) {
+        n -= seg->len - off;
+        off = 0;
+        ++first;
+      } else {
+        off += (int)n;
+        n = 0;
+      }
+    }
   }
-
-  if (write(
-          STDOUT_FILENO,
-          g_engine.render_buffer,
-          ptr - g_engine.render_buffer) == -1) {}
 }
 
 #ifndef TB_NO_AUDIO
@@ -1328,8 +1393,17 @@ static void eng_init(int w, int h) {
   g_engine.width = w;
   g_engine.height = h;
   g_engine.back_buffer = (eng_cell_t*)malloc(sizeof(eng_cell_t) * w * h);
-  g_engine.render_buffer = NULL;
-  g_engine.render_buffer_cap = 0;
+  g_engine.front_buffer = NULL;
+  g_engine.front_buffer_cap = 0;
+  g_engine.force_redraw = 1;
+  g_engine.redraw_threshold = REDRAW_THRESHOLD;
+  g_engine.output_mode = TB_OUTPUT_TRUECOLOR;
+  memset(&g_engine.stats, 0, sizeof(tb_stats_t));
+  g_engine.sync_update = 1;
+  memset(g_engine.glyph_cache, 0, sizeof(g_engine.glyph_cache));
+  g_engine.out_segments = NULL;
+  g_engine.out_segment_count = 0;
+  g_engine.out_used = 0;
   memset(g_engine.keys, 0, sizeof(g_engine.keys));
   memset(g_engine.prev_keys, 0, sizeof(g_engine.prev_keys));
   memset(&g_engine.mouse, 0, sizeof(tb_mouse_state_t));
@@ -1346,6 +1420,7 @@ static void eng_init(int w, int h) {
   g_engine.gain_ramp = 0.0f;
   g_engine.is_starving = 1;
 
+  eng_init_dec_lut();
   eng_resize_buffer(w, h);
 }
 
@@ -1356,6 +1431,7 @@ static void eng_resize_buffer(int w, int h) {
 
   for (i = 0; i < safe_size; ++i) {
     g_engine.back_buffer[i].ch = ' ';
+    g_engine.back_buffer[i].width = 1;
     g_engine.back_buffer[i].fg = TB_RGB(200, 200, 200);
     g_engine.back_buffer[i].bg = TB_RGB(0, 0, 0);
   }
@@ -1371,6 +1447,7 @@ static void eng_handle_resize(int w, int h) {
     g_engine.back_buffer = new_buffer;
     g_engine.width = w;
     g_engine.height = h;
+    g_engine.force_redraw = 1;
     eng_resize_buffer(w, h);
   }
 }
@@ -1433,23 +1510,519 @@ static void eng_audio_mix(float* output, int frames, int channels) {
   g_engine.audio_read_idx = read_ptr;
 }
 
+static int eng_cell_equal(const eng_cell_t* a, const eng_cell_t* b) {
+  return a->ch == b->ch && a->width == b->width && a->fg == b->fg &&
+         a->bg == b->bg;
+}
+
+static int eng_utf8_encode(char* out, unsigned int cp) {
+  if (cp < 0x80) {
+    out[0] = (char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = (char)(0xC0 | (cp >> 6));
+    out[1] = (char)(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = (char)(0xE0 | (cp >> 12));
+    out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | (cp >> 18));
+  out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+  out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+  out[3] = (char)(0x80 | (cp & 0x3F));
+  return 4;
+}
+
+/* Decodes one codepoint and advances past it. Malformed, overlong and
+ * surrogate sequences consume a single byte and decode as U+FFFD. */
+static unsigned int eng_utf8_decode(const unsigned char** str) {
+  const unsigned char* s = *str;
+  unsigned int cp;
+  int len, i;
+
+  if (s[0] < 0x80) {
+    *str = s + 1;
+    return s[0];
+  }
+  if ((s[0] & 0xE0) == 0xC0) {
+    cp = s[0] & 0x1F;
+    len = 2;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    cp = s[0] & 0x0F;
+    len = 3;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    cp = s[0] & 0x07;
+    len = 4;
+  } else {
+    *str = s + 1;
+    return 0xFFFD;
+  }
+
+  for (i = 1; i < len; ++i) {
+    if ((s[i] & 0xC0) != 0x80) {
+      *str = s + 1;
+      return 0xFFFD;
+    }
+    cp = (cp << 6) | (s[i] & 0x3F);
+  }
+
+  if ((len == 2 && cp < 0x80) || (len == 3 && cp < 0x800) ||
+      (len == 4 && cp < 0x10000) || cp > 0x10FFFF ||
+      (cp >= 0xD800 && cp <= 0xDFFF)) {
+    *str = s + 1;
+    return 0xFFFD;
+  }
+  *str = s + len;
+  return cp;
+}
+
+static const unsigned int eng_wide_ranges[][2] = {
+    {0x1100, 0x115F},   {0x2E80, 0x303E},   {0x3041, 0x33FF},
+    {0x3400, 0x4DBF},   {0x4E00, 0x9FFF},   {0xA000, 0xA4CF},
+    {0xAC00, 0xD7A3},   {0xF900, 0xFAFF},   {0xFE30, 0xFE4F},
+    {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},   {0x1F300, 0x1F64F},
+    {0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}};
+
+/* Columns a codepoint takes: 0 for controls and combining marks, which a
+ * cell cannot hold, 2 for East Asian wide and emoji ranges, otherwise 1 */
+static int eng_cp_width(unsigned int cp) {
+  int i;
+  if (cp < 0x20 || (cp >= 0x7F && cp < 0xA0)) { return 0; }
+  if (cp < 0x300) { return 1; }
+  if ((cp >= 0x300 && cp <= 0x36F) || (cp >= 0x200B && cp <= 0x200F) ||
+      (cp >= 0xFE00 && cp <= 0xFE0F)) {
+    return 0;
+  }
+  for (i = 0; i < (int)(sizeof(eng_wide_ranges) / sizeof(eng_wide_ranges[0]));
+       ++i) {
+    if (cp < eng_wide_ranges[i][0]) { break; }
+    if (cp <= eng_wide_ranges[i][1]) { return 2; }
+  }
+  return 1;
+}
+
+/* Replaces the glyph that covers x with a blank when x is half of a wide
+ * glyph, so no orphaned half is left behind */
+static void eng_break_wide(eng_cell_t* row, int x, int w) {
+  if (row[x].width == 0 && x > 0) {
+    row[x - 1].ch = ' ';
+    row[x - 1].width = 1;
+  } else if (row[x].width == 2 && x + 1 < w) {
+    row[x + 1].ch = ' ';
+    row[x + 1].width = 1;
+  }
+}
+
+static void eng_set_cell(
+    int x,
+    int y,
+    unsigned int cp,
+    int width,
+    unsigned int fg,
+    unsigned int bg) {
+  eng_cell_t* row;
+  int w = g_engine.width;
+
+  if (x < 0 || x >= w || y < 0 || y >= g_engine.height) { return; }
+  if (width == 2 && x == w - 1) {
+    cp = ' ';
+    width = 1;
+  }
+
+  row = g_engine.back_buffer + y * w;
+  eng_break_wide(row, x, w);
+  row[x].ch = cp;
+  row[x].width = width;
+  row[x].fg = fg;
+  row[x].bg = bg;
+  if (width == 2) {
+    eng_break_wide(row, x + 1, w);
+    row[x + 1].ch = 0;
+    row[x + 1].width = 0;
+    row[x + 1].fg = fg;
+    row[x + 1].bg = bg;
+  }
+}
+
+/* UTF-8 for a non-ASCII codepoint from a direct-mapped cache. Entries stay
+ * valid across frames, so box drawing and block glyphs are encoded once. */
+static char* eng_put_glyph(char* ptr, unsigned int cp) {
+  eng_glyph_t* g =
+      &g_engine.glyph_cache[(cp ^ (cp >> 8)) & (GLYPH_CACHE_SIZE - 1)];
+  if (g->cp != cp) {
+    g->cp = cp;
+    memset(g->utf8, 0, 4);
+    eng_utf8_encode(g->utf8, cp);
+  }
+  memcpy(ptr, g->utf8, 4);
+  return ptr + (cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4);
+}
+
+/* "0".."255" as up to three digits, with the length in the last byte */
+static char eng_dec_lut[256][4];
+
+static void eng_init_dec_lut(void) {
+  int i;
+  for (i = 0; i < 256; ++i) {
+    char* d = eng_dec_lut[i];
+    if (i >= 100) {
+      d[0] = (char)('0' + i / 100);
+      d[1] = (char)('0' + i / 10 % 10);
+      d[2] = (char)('0' + i % 10);
+      d[3] = 3;
+    } else if (i >= 10) {
+      d[0] = (char)('0' + i / 10);
+      d[1] = (char)('0' + i % 10);
+      d[3] = 2;
+    } else {
+      d[0] = (char)('0' + i);
+      d[3] = 1;
+    }
+  }
+}
+
+static char* eng_put_byte_dec(char* ptr, int v) {
+  memcpy(ptr, eng_dec_lut[v], 3);
+  return ptr + eng_dec_lut[v][3];
+}
+
+static char* eng_put_dec(char* ptr, int v) {
+  char tmp[12];
+  int n = 0;
+  if (v < 256) { return eng_put_byte_dec(ptr, v); }
+  while (v > 0) {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  }
+  while (n > 0) { *ptr++ = tmp[--n]; }
+  return ptr;
+}
+
+static const unsigned int eng_ansi16[16] = {
+    0x000000, 0x800000, 0x008000, 0x808000, 0x000080, 0x800080,
+    0x008080, 0xC0C0C0, 0x808080, 0xFF0000, 0x00FF00, 0xFFFF00,
+    0x0000FF, 0xFF00FF, 0x00FFFF, 0xFFFFFF};
+
+static int eng_rgb_dist(unsigned int a, unsigned int b) {
+  int dr = (int)((a >> 16) & 0xFF) - (int)((b >> 16) & 0xFF);
+  int dg = (int)((a >> 8) & 0xFF) - (int)((b >> 8) & 0xFF);
+  int db = (int)(a & 0xFF) - (int)(b & 0xFF);
+  return dr * dr + dg * dg + db * db;
+}
+
+static int eng_cube_level(int v) {
+  if (v < 48) { return 0; }
+  if (v < 115) { return 1; }
+  return (v - 35) / 40;
+}
+
+/* Nearest xterm-256 entry from the 6x6x6 cube or the grey ramp */
+static int eng_quantize_256(unsigned int rgb) {
+  static const int levels[6] = {0, 95, 135, 175, 215, 255};
+  int r = (rgb >> 16) & 0xFF;
+  int g = (rgb >> 8) & 0xFF;
+  int b = rgb & 0xFF;
+  int cr = eng_cube_level(r);
+  int cg = eng_cube_level(g);
+  int cb = eng_cube_level(b);
+  int grey = (r + g + b) / 3;
+  int gi = grey < 8 ? 0 : grey > 238 ? 23 : (grey - 3) / 10;
+  int gv = 8 + gi * 10;
+  unsigned int cube = TB_RGB(levels[cr], levels[cg], levels[cb]);
+
+  if (eng_rgb_dist(TB_RGB(gv, gv, gv), rgb) < eng_rgb_dist(cube, rgb)) {
+    return 232 + gi;
+  }
+  return 16 + cr * 36 + cg * 6 + cb;
+}
+
+static int eng_quantize_16(unsigned int rgb) {
+  int i, d;
+  int best = 0;
+  int best_dist = eng_rgb_dist(eng_ansi16[0], rgb);
+  for (i = 1; i < 16; ++i) {
+    d = eng_rgb_dist(eng_ansi16[i], rgb);
+    if (d < best_dist) {
+      best_dist = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+static int eng_color_code(unsigned int rgb) {
+  switch (g_engine.output_mode) {
+  case TB_OUTPUT_256:
+    return eng_quantize_256(rgb);
+  case TB_OUTPUT_16:
+    return eng_quantize_16(rgb);
+  default:
+    return (int)(rgb & 0xFFFFFF);
+  }
+}
+
+/* One SGR parameter group for a colour code: "38;2;r;g;b", "38;5;n" or
+ * "3n"/"9n" for the foreground, base is 0 for fg and 10 for bg */
+static char* eng_put_color(char* ptr, int code, int base) {
+  switch (g_engine.output_mode) {
+  case TB_OUTPUT_256:
+    *ptr++ = base ? '4' : '3';
+    memcpy(ptr, "8;5;", 4);
+    return eng_put_byte_dec(ptr + 4, code);
+  case TB_OUTPUT_16:
+    return eng_put_byte_dec(ptr, (code < 8 ? 30 : 82) + base + code);
+  default:
+    *ptr++ = base ? '4' : '3';
+    memcpy(ptr, "8;2;", 4);
+    ptr = eng_put_byte_dec(ptr + 4, (code >> 16) & 0xFF);
+    *ptr++ = ';';
+    ptr = eng_put_byte_dec(ptr, (code >> 8) & 0xFF);
+    *ptr++ = ';';
+    return eng_put_byte_dec(ptr, code & 0xFF);
+  }
+}
+
+/* Writes the SGR for whichever of fg/bg changed, then the character. The
+ * render buffer is sized for CELL_BYTES_MAX per cell, so nothing here
+ * checks for space. */
+static char* eng_emit_cell(char* ptr, const eng_cell_t* c, eng_sgr_t* sgr) {
+  int set_fg, set_bg;
+
+  /* The right half of a wide glyph was drawn with its left half */
+  if (c->width == 0) { return ptr; }
+
+  if (c->fg != sgr->fg_rgb || sgr->fg < 0) {
+    int code = eng_color_code(c->fg);
+    sgr->fg_rgb = c->fg;
+    set_fg = code != sgr->fg;
+    sgr->fg = code;
+  } else {
+    set_fg = 0;
+  }
+  if (c->bg != sgr->bg_rgb || sgr->bg < 0) {
+    int code = eng_color_code(c->bg);
+    sgr->bg_rgb = c->bg;
+    set_bg = code != sgr->bg;
+    sgr->bg = code;
+  } else {
+    set_bg = 0;
+  }
+
+  if (set_fg || set_bg) {
+    *ptr++ = '\x1b';
+    *ptr++ = '[';
+    if (set_fg) { ptr = eng_put_color(ptr, sgr->fg, 0); }
+    if (set_fg && set_bg) { *ptr++ = ';'; }
+    if (set_bg) { ptr = eng_put_color(ptr, sgr->bg, 10); }
+    *ptr++ = 'm';
+  }
+
+  if (c->ch < 0x80) {
+    *ptr++ = (char)c->ch;
+  } else {
+    ptr = eng_put_glyph(ptr, c->ch);
+  }
+  return ptr;
+}
+
+/* Makes sure enough output segments exist for a frame of up to the given
+ * size. Segments are kept between frames and only ever added. */
+static int eng_out_reserve(long bytes) {
+  int need = (int)(bytes / (OUT_SEGMENT_SIZE - CELL_BYTES_MAX)) + 1;
+  eng_segment_t* temp;
+
+  if (need > g_engine.out_segment_count) {
+    temp = (eng_segment_t*)realloc(
+        g_engine.out_segments, sizeof(eng_segment_t) * need);
+    if (!temp) { return 0; }
+    g_engine.out_segments = temp;
+    while (g_engine.out_segment_count < need) {
+      temp = &g_engine.out_segments[g_engine.out_segment_count];
+      temp->data = (char*)malloc(OUT_SEGMENT_SIZE);
+      temp->len = 0;
+      if (!temp->data) { return 0; }
+      g_engine.out_segment_count++;
+    }
+  }
+  g_engine.out_used = 0;
+  return 1;
+}
+
+/* Closes the current segment at ptr and continues in the next one */
+static char* eng_out_next(char* ptr, char** end) {
+  eng_segment_t* seg;
+  if (g_engine.out_used > 0) {
+    seg = &g_engine.out_segments[g_engine.out_used - 1];
+    seg->len = (int)(ptr - seg->data);
+  }
+  seg = &g_engine.out_segments[g_engine.out_used++];
+  *end = seg->data + OUT_SEGMENT_SIZE;
+  return seg->data;
+}
+
+/* Encodes the cells that differ from what the terminal already shows into
+ * the output segments and returns the byte count. Changed cells are grouped
+ * into runs per row, with short unchanged gaps folded in so they cost less
+ * than a cursor move; past redraw_threshold percent of changed cells, or
+ * after a resize, the whole screen is rewritten from the home position
+ * instead. With sync_update the frame is wrapped in CSI ?2026 h/l so the
+ * terminal shows it all at once. */
+static int eng_encode_frame(const eng_cell_t* buffer, int w, int h) {
+  char* ptr;
+  char* end;
+  eng_sgr_t sgr;
+  long bytes;
+  int cursor_x = -1;
+  int cursor_y = -1;
+  int count = w * h;
+  int limit, changed, runs, full;
+  int i, x, y, start, stop, row;
+
+  if (!buffer || count <= 0) { return 0; }
+  g_engine.out_used = 0;
+
+  if (g_engine.front_buffer_cap < count) {
+    eng_cell_t* temp = (eng_cell_t*)realloc(
+        g_engine.front_buffer, sizeof(eng_cell_t) * count);
+    if (!temp) { return 0; }
+    g_engine.front_buffer = temp;
+    g_engine.front_buffer_cap = count;
+    g_engine.force_redraw = 1;
+  }
+
+  sgr.fg_rgb = sgr.bg_rgb = 0;
+  sgr.fg = sgr.bg = -1;
+
+  /* Count changes only until the threshold decides a full redraw */
+  full = g_engine.force_redraw;
+  changed = 0;
+  limit = (int)((long)count * g_engine.redraw_threshold / 100);
+  for (i = 0; i < count && !full; ++i) {
+    if (!eng_cell_equal(&buffer[i], &g_engine.front_buffer[i])) {
+      if (++changed > limit) { full = 1; }
+    }
+  }
+
+  /* Runs cover at most DIFF_MERGE_GAP cells per changed cell */
+  if (full || changed * DIFF_MERGE_GAP > count) {
+    bytes = (long)CELL_BYTES_MAX * count;
+  } else {
+    bytes = (long)CELL_BYTES_MAX * changed * DIFF_MERGE_GAP;
+  }
+  if (bytes > 0 && !eng_out_reserve(bytes + CELL_BYTES_MAX)) { return 0; }
+
+  runs = 0;
+  ptr = end = NULL;
+  if (bytes > 0) {
+    ptr = eng_out_next(NULL, &end);
+    if (g_engine.sync_update) {
+      memcpy(ptr, "\x1b[?2026h", 8);
+      ptr += 8;
+    }
+  }
+
+  if (full) {
+    memcpy(ptr, "\x1b[H", 3);
+    ptr += 3;
+
+    for (i = 0; i < count; ++i) {
+      if (end - ptr < CELL_BYTES_MAX) { ptr = eng_out_next(ptr, &end); }
+      ptr = eng_emit_cell(ptr, &buffer[i], &sgr);
+    }
+    changed = count;
+    runs = 1;
+  } else {
+    for (y = 0; y < h; ++y) {
+      row = y * w;
+      x = 0;
+      while (x < w) {
+        if (eng_cell_equal(&buffer[row + x], &g_engine.front_buffer[row + x])) {
+          ++x;
+          continue;
+        }
+
+        start = x;
+        stop = x + 1;
+        for (x = start + 1; x < w && x - stop < DIFF_MERGE_GAP; ++x) {
+          if (!eng_cell_equal(
+                  &buffer[row + x], &g_engine.front_buffer[row + x])) {
+            stop = x + 1;
+          }
+        }
+
+        /* Runs start and end on whole glyphs */
+        if (buffer[row + start].width == 0 && start > 0) { --start; }
+        if (stop < w && buffer[row + stop].width == 0) { ++stop; }
+
+        if (end - ptr < CELL_BYTES_MAX) { ptr = eng_out_next(ptr, &end); }
+        if (cursor_x != start || cursor_y != y) {
+          *ptr++ = '\x1b';
+          *ptr++ = '[';
+          ptr = eng_put_dec(ptr, y + 1);
+          *ptr++ = ';';
+          ptr = eng_put_dec(ptr, start + 1);
+          *ptr++ = 'H';
+        }
+        for (i = start; i < stop; ++i) {
+          if (end - ptr < CELL_BYTES_MAX) { ptr = eng_out_next(ptr, &end); }
+          ptr = eng_emit_cell(ptr, &buffer[row + i], &sgr);
+        }
+
+        /* The cursor is left pending a wrap after the last column */
+        cursor_x = stop < w ? stop : -1;
+        cursor_y = y;
+        x = stop;
+        ++runs;
+      }
+    }
+  }
+
+  bytes = 0;
+  if (ptr) {
+    if (g_engine.sync_update) {
+      if (end - ptr < CELL_BYTES_MAX) { ptr = eng_out_next(ptr, &end); }
+      memcpy(ptr, "\x1b[?2026l", 8);
+      ptr += 8;
+    }
+    g_engine.out_segments[g_engine.out_used - 1].len =
+        (int)(ptr - g_engine.out_segments[g_engine.out_used - 1].data);
+    for (i = 0; i < g_engine.out_used; ++i) {
+      bytes += g_engine.out_segments[i].len;
+    }
+  }
+
+  memcpy(g_engine.front_buffer, buffer, sizeof(eng_cell_t) * count);
+  g_engine.force_redraw = 0;
+
+  g_engine.stats.bytes_written = (int)bytes;
+  g_engine.stats.write_calls = 0;
+  g_engine.stats.write_stalls = 0;
+  g_engine.stats.cells_changed = changed;
+  g_engine.stats.runs = runs;
+  g_engine.stats.full_redraw = full;
+  g_engine.stats.total_bytes += (unsigned long)g_engine.stats.bytes_written;
+  g_engine.stats.frames++;
+  return g_engine.stats.bytes_written;
+}
+
 void tb_clear(unsigned int fg, unsigned int bg, char c) {
   int i;
   int size = g_engine.width * g_engine.height;
   for (i = 0; i < size; ++i) {
-    g_engine.back_buffer[i].ch = c;
+    g_engine.back_buffer[i].ch = (unsigned char)c;
+    g_engine.back_buffer[i].width = 1;
     g_engine.back_buffer[i].fg = fg;
     g_engine.back_buffer[i].bg = bg;
   }
 }
 
 void tb_put(int x, int y, char c, unsigned int fg, unsigned int bg) {
-  if (x >= 0 && x < g_engine.width && y >= 0 && y < g_engine.height) {
-    int idx = y * g_engine.width + x;
-    g_engine.back_buffer[idx].ch = c;
-    g_engine.back_buffer[idx].fg = fg;
-    g_engine.back_buffer[idx].bg = bg;
-  }
+  eng_set_cell(x, y, (unsigned char)c, 1, fg, bg);
 }
 
 void tb_print(
@@ -1458,6 +2031,170 @@ void tb_print(
   while (*str) { tb_put(cx++, y, *str++, fg, bg); }
 }
 
+void tb_put_codepoint(
+    int x, int y, unsigned int cp, unsigned int fg, unsigned int bg) {
+  int width;
+  if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) { cp = 0xFFFD; }
+  width = eng_cp_width(cp);
+  if (width > 0) { eng_set_cell(x, y, cp, width, fg, bg); }
+}
+
+void tb_print_utf8(
+    int x, int y, const char* str, unsigned int fg, unsigned int bg) {
+  const unsigned char* s = (const unsigned char*)str;
+  unsigned int cp;
+  int width;
+
+  while (*s) {
+    cp = eng_utf8_decode(&s);
+    width = eng_cp_width(cp);
+    if (width == 0) { continue; }
+    eng_set_cell(x, y, cp, width, fg, bg);
+    x += width;
+  }
+}
+
+static void eng_canvas_half_row(
+    eng_cell_t* dst,
+    const unsigned int* top,
+    const unsigned int* bottom,
+    int n) {
+  int i;
+  for (i = 0; i < n; ++i) {
+    dst[i].ch = top[i] == bottom[i] ? ' ' : 0x2580;
+    dst[i].width = 1;
+    dst[i].fg = top[i];
+    dst[i].bg = bottom[i];
+  }
+}
+
+/* Each 2x4 block becomes one braille glyph: a dot per pixel that differs
+ * from bg, drawn in the average colour of those pixels. Selected with
+ * masks throughout, since a noisy canvas would mispredict branches. */
+static void eng_canvas_braille_row(
+    eng_cell_t* dst,
+    const unsigned int* src,
+    int pitch,
+    int n,
+    unsigned int bg) {
+  static const unsigned int recip[9] = {
+      0, 65536, 32768, 21846, 16384, 13108, 10923, 9363, 8192};
+  const unsigned int* p0 = src;
+  const unsigned int* p1 = src + pitch;
+  const unsigned int* p2 = src + pitch * 2;
+  const unsigned int* p3 = src + pitch * 3;
+  unsigned int px[8], bits, mask, r, g, b, cnt;
+  eng_cell_t cell;
+  int i, k;
+
+  cell.width = 1;
+  cell.bg = bg;
+  for (i = 0; i < n; ++i) {
+    /* Braille dot order: left column top down, right column, then row 4 */
+    px[0] = p0[i * 2];
+    px[1] = p1[i * 2];
+    px[2] = p2[i * 2];
+    px[3] = p0[i * 2 + 1];
+    px[4] = p1[i * 2 + 1];
+    px[5] = p2[i * 2 + 1];
+    px[6] = p3[i * 2];
+    px[7] = p3[i * 2 + 1];
+
+    bits = r = g = b = cnt = 0;
+    for (k = 0; k < 8; ++k) {
+      mask = 0u - (px[k] != bg);
+      bits |= (1u << k) & mask;
+      r += (px[k] >> 16 & 0xFF) & mask;
+      g += (px[k] >> 8 & 0xFF) & mask;
+      b += (px[k] & 0xFF) & mask;
+      cnt -= mask;
+    }
+
+    mask = 0u - (cnt != 0);
+    cell.ch = ((0x2800 + bits) & mask) | (' ' & ~mask);
+    cell.fg = (TB_RGB(
+                   (r * recip[cnt]) >> 16,
+                   (g * recip[cnt]) >> 16,
+                   (b * recip[cnt]) >> 16) &
+               mask) |
+              (bg & ~mask);
+    dst[i] = cell;
+  }
+}
+
+int tb_canvas_init(tb_canvas_t* canvas, int cells_w, int cells_h, int mode) {
+  int sub_w = mode == TB_CANVAS_BRAILLE ? 2 : 1;
+  int sub_h = mode == TB_CANVAS_BRAILLE ? 4 : 2;
+
+  canvas->pixels = NULL;
+  canvas->width = 0;
+  canvas->height = 0;
+  canvas->mode = mode;
+  canvas->background = TB_RGB(0, 0, 0);
+  if (cells_w <= 0 || cells_h <= 0) { return 0; }
+
+  canvas->pixels = (unsigned int*)malloc(
+      sizeof(unsigned int) * cells_w * sub_w * cells_h * sub_h);
+  if (!canvas->pixels) { return 0; }
+  canvas->width = cells_w * sub_w;
+  canvas->height = cells_h * sub_h;
+  tb_canvas_clear(canvas, canvas->background);
+  return 1;
+}
+
+void tb_canvas_free(tb_canvas_t* canvas) {
+  if (canvas->pixels) {
+    free(canvas->pixels);
+    canvas->pixels = NULL;
+  }
+  canvas->width = 0;
+  canvas->height = 0;
+}
+
+void tb_canvas_clear(tb_canvas_t* canvas, unsigned int color) {
+  int i;
+  int size = canvas->width * canvas->height;
+  for (i = 0; i < size; ++i) { canvas->pixels[i] = color; }
+}
+
+void tb_canvas_put(tb_canvas_t* canvas, int x, int y, unsigned int color) {
+  if (x >= 0 && x < canvas->width && y >= 0 && y < canvas->height) {
+    canvas->pixels[y * canvas->width + x] = color;
+  }
+}
+
+/* Converts the canvas into the cells at x,y, clipped to the screen */
+void tb_canvas_present(const tb_canvas_t* canvas, int x, int y) {
+  int braille = canvas->mode == TB_CANVAS_BRAILLE;
+  int sub_w = braille ? 2 : 1;
+  int sub_h = braille ? 4 : 2;
+  int cells_w = canvas->width / sub_w;
+  int cells_h = canvas->height / sub_h;
+  int x0 = x < 0 ? 0 : x;
+  int y0 = y < 0 ? 0 : y;
+  int x1 = x + cells_w < g_engine.width ? x + cells_w : g_engine.width;
+  int y1 = y + cells_h < g_engine.height ? y + cells_h : g_engine.height;
+  const unsigned int* src;
+  eng_cell_t* row;
+  int cy;
+
+  if (!canvas->pixels || x0 >= x1 || y0 >= y1) { return; }
+
+  for (cy = y0; cy < y1; ++cy) {
+    row = g_engine.back_buffer + cy * g_engine.width;
+    eng_break_wide(row, x0, g_engine.width);
+    eng_break_wide(row, x1 - 1, g_engine.width);
+
+    src = canvas->pixels + (cy - y) * sub_h * canvas->width + (x0 - x) * sub_w;
+    if (braille) {
+      eng_canvas_braille_row(
+          row + x0, src, canvas->width, x1 - x0, canvas->background);
+    } else {
+      eng_canvas_half_row(row + x0, src, src + canvas->width, x1 - x0);
+    }
+  }
+}
+
 int tb_width(void) {
   return g_engine.width;
 }
@@ -1496,9 +2233,18 @@ void tb_shutdown(void) {
     free(g_engine.back_buffer);
     g_engine.back_buffer = NULL;
   }
-  if (g_engine.render_buffer) {
-    free(g_engine.render_buffer);
-    g_engine.render_buffer = NULL;
+  if (g_engine.front_buffer) {
+    free(g_engine.front_buffer);
+    g_engine.front_buffer = NULL;
+  }
+  if (g_engine.out_segments) {
+    int i;
+    for (i = 0; i < g_engine.out_segment_count; ++i) {
+      free(g_engine.out_segments[i].data);
+    }
+    free(g_engine.out_segments);
+    g_engine.out_segments = NULL;
+    g_engine.out_segment_count = 0;
   }
 }
 
@@ -1514,6 +2260,26 @@ void tb_present(void) {
   pf_present_buffer(g_engine.back_buffer, g_engine.width, g_engine.height);
 }
 
+void tb_set_redraw_threshold(int percent) {
+  if (percent < 0) { percent = 0; }
+  if (percent > 100) { percent = 100; }
+  g_engine.redraw_threshold = percent;
+}
+
+void tb_set_output_mode(int mode) {
+  if (mode < TB_OUTPUT_TRUECOLOR || mode > TB_OUTPUT_16) { return; }
+  if (mode != g_engine.output_mode) { g_engine.force_redraw = 1; }
+  g_engine.output_mode = mode;
+}
+
+void tb_set_sync_update(int enabled) {
+  g_engine.sync_update = enabled != 0;
+}
+
+tb_stats_t tb_stats(void) {
+  return g_engine.stats;
+}
+
 void tb_audio_init(int sample_rate) {
   g_engine.audio_sample_rate = sample_rate;
   g_engine.audio_thread = tb_thread_create(pf_audio_thread_proc, NULL);